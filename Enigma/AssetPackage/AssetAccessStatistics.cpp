@@ -0,0 +1,151 @@
+﻿#include "AssetAccessStatistics.hpp"
+#include "AssetPackageErrors.hpp"
+#include <algorithm>
+#include <fstream>
+
+using namespace AssetPackage;
+
+static size_t getDecompressHistogramBucket(std::chrono::nanoseconds elapsed)
+{
+    auto microseconds = static_cast<std::uint64_t>(std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), 0));
+    size_t bucket = 0;
+    while ((microseconds > 1) && (bucket + 1 < AssetAccessStatistics::DECOMPRESS_HISTOGRAM_BUCKET_COUNT))
+    {
+        microseconds >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static std::uint64_t toNanoseconds(std::chrono::nanoseconds elapsed)
+{
+    return static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(elapsed.count(), 0));
+}
+
+static void writeLockWait(std::ofstream& statistics_file, const char* locker_name, const AssetAccessStatistics::LockWaitStatistics& lock_wait)
+{
+    statistics_file << "lock_wait\t" << locker_name << '\t' << lock_wait.m_acquireCount << '\t' << lock_wait.m_contendedCount
+        << '\t' << lock_wait.m_waitNanoseconds << '\t' << lock_wait.m_maxWaitNanoseconds << '\n';
+}
+
+AssetAccessStatistics::AssetAccessStatistics() : m_decompressHistogram{}, m_bundleLockWait{}, m_headerLockWait{}
+{
+}
+
+AssetAccessStatistics::~AssetAccessStatistics() noexcept
+{
+    clear();
+}
+
+void AssetAccessStatistics::recordAccess(const std::string& asset_key)
+{
+    if (asset_key.empty()) return;
+    const std::lock_guard<std::mutex> locker{ m_statisticsLocker };
+    getAssetStatistics(asset_key).m_hitCount++;
+}
+
+void AssetAccessStatistics::recordRead(const std::string& asset_key, std::uint64_t read_bytes)
+{
+    if (asset_key.empty()) return;
+    const std::lock_guard<std::mutex> locker{ m_statisticsLocker };
+    getAssetStatistics(asset_key).m_readBytes += read_bytes;
+}
+
+void AssetAccessStatistics::recordDecompress(const std::string& asset_key, std::uint64_t decompressed_bytes, std::chrono::nanoseconds elapsed)
+{
+    const std::uint64_t nanoseconds = toNanoseconds(elapsed);
+    const size_t bucket = getDecompressHistogramBucket(elapsed);
+    const std::lock_guard<std::mutex> locker{ m_statisticsLocker };
+    m_decompressHistogram[bucket]++;
+    if (asset_key.empty()) return;
+    AssetStatistics& statistics = getAssetStatistics(asset_key);
+    statistics.m_decompressCount++;
+    statistics.m_decompressedBytes += decompressed_bytes;
+    statistics.m_decompressNanoseconds += nanoseconds;
+    statistics.m_maxDecompressNanoseconds = std::max(statistics.m_maxDecompressNanoseconds, nanoseconds);
+}
+
+void AssetAccessStatistics::recordLockWait(FileLocker file_locker, bool is_contended, std::chrono::nanoseconds elapsed)
+{
+    const std::uint64_t nanoseconds = toNanoseconds(elapsed);
+    const std::lock_guard<std::mutex> locker{ m_statisticsLocker };
+    LockWaitStatistics& lock_wait = file_locker == FileLocker::bundleFile ? m_bundleLockWait : m_headerLockWait;
+    lock_wait.m_acquireCount++;
+    if (!is_contended) return;
+    lock_wait.m_contendedCount++;
+    lock_wait.m_waitNanoseconds += nanoseconds;
+    lock_wait.m_maxWaitNanoseconds = std::max(lock_wait.m_maxWaitNanoseconds, nanoseconds);
+}
+
+AssetAccessStatistics::Snapshot AssetAccessStatistics::getSnapshot() const
+{
+    Snapshot snapshot{};
+    {
+        const std::lock_guard<std::mutex> locker{ m_statisticsLocker };
+        snapshot.m_assets.reserve(m_assets.size());
+        for (const auto& [asset_key, statistics] : m_assets)
+        {
+            snapshot.m_assets.push_back(statistics);
+        }
+        snapshot.m_decompressHistogram = m_decompressHistogram;
+        snapshot.m_bundleLockWait = m_bundleLockWait;
+        snapshot.m_headerLockWait = m_headerLockWait;
+    }
+    for (const auto& statistics : snapshot.m_assets)
+    {
+        snapshot.m_hitCount += statistics.m_hitCount;
+        snapshot.m_readBytes += statistics.m_readBytes;
+        snapshot.m_decompressCount += statistics.m_decompressCount;
+        snapshot.m_decompressedBytes += statistics.m_decompressedBytes;
+        snapshot.m_decompressNanoseconds += statistics.m_decompressNanoseconds;
+    }
+    // hit count 一樣的依 key 排, 每次輸出的順序才會固定
+    std::sort(snapshot.m_assets.begin(), snapshot.m_assets.end(), [](const AssetStatistics& a, const AssetStatistics& b)
+        {
+            if (a.m_hitCount != b.m_hitCount) return a.m_hitCount > b.m_hitCount;
+            return a.m_key < b.m_key;
+        });
+    return snapshot;
+}
+
+void AssetAccessStatistics::clear()
+{
+    const std::lock_guard<std::mutex> locker{ m_statisticsLocker };
+    m_assets.clear();
+    m_decompressHistogram.fill(0);
+    m_bundleLockWait = {};
+    m_headerLockWait = {};
+}
+
+error AssetAccessStatistics::exportToFile(const Snapshot& snapshot, const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    std::ofstream statistics_file{ file_path, std::fstream::out | std::fstream::binary | std::fstream::trunc };
+    if (!statistics_file) return ErrorCode::fileOpenFail;
+    statistics_file << "total\t" << snapshot.m_hitCount << '\t' << snapshot.m_readBytes << '\t' << snapshot.m_decompressCount
+        << '\t' << snapshot.m_decompressedBytes << '\t' << snapshot.m_decompressNanoseconds << '\n';
+    statistics_file << "decompress_histogram";
+    for (const std::uint64_t count : snapshot.m_decompressHistogram)
+    {
+        statistics_file << '\t' << count;
+    }
+    statistics_file << '\n';
+    writeLockWait(statistics_file, "bundle", snapshot.m_bundleLockWait);
+    writeLockWait(statistics_file, "header", snapshot.m_headerLockWait);
+    for (const auto& statistics : snapshot.m_assets)
+    {
+        statistics_file << "asset\t" << statistics.m_hitCount << '\t' << statistics.m_readBytes << '\t' << statistics.m_decompressCount
+            << '\t' << statistics.m_decompressedBytes << '\t' << statistics.m_decompressNanoseconds << '\t' << statistics.m_maxDecompressNanoseconds
+            << '\t' << statistics.m_key << '\n';
+    }
+    statistics_file.flush();
+    if (!statistics_file) return ErrorCode::fileWriteFail;
+    return ErrorCode::ok;
+}
+
+AssetAccessStatistics::AssetStatistics& AssetAccessStatistics::getAssetStatistics(const std::string& asset_key)
+{
+    auto [it, is_inserted] = m_assets.try_emplace(asset_key);
+    if (is_inserted) it->second.m_key = asset_key;
+    return it->second;
+}
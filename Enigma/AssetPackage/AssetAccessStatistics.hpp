@@ -0,0 +1,97 @@
+﻿/*****************************************************************
+ * \file   AssetAccessStatistics.hpp
+ * \brief  記錄 asset 的讀取次數, 讀取 bytes, 解壓時間分布跟 file lock 的等待時間,
+ *         給 layout 調整, cache 大小設定跟找載入卡頓用
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_ACCESS_STATISTICS_HPP
+#define ASSET_ACCESS_STATISTICS_HPP
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class AssetAccessStatistics
+    {
+    public:
+        /** bucket i 是解壓時間在 [2^i, 2^(i+1)) microseconds, 第一個也包含 1 microsecond 以下, 最後一個包含之後全部 */
+        constexpr static size_t DECOMPRESS_HISTOGRAM_BUCKET_COUNT = 20;
+        enum class FileLocker
+        {
+            bundleFile,
+            headerFile,
+        };
+        struct AssetStatistics
+        {
+            std::string m_key;
+            std::uint64_t m_hitCount;
+            std::uint64_t m_readBytes;  ///< 從 bundle 讀取的 (壓縮後) bytes, 從 cache 取得的不算
+            std::uint64_t m_decompressCount;
+            std::uint64_t m_decompressedBytes;
+            std::uint64_t m_decompressNanoseconds;
+            std::uint64_t m_maxDecompressNanoseconds;
+        };
+        struct LockWaitStatistics
+        {
+            std::uint64_t m_acquireCount;
+            std::uint64_t m_contendedCount;  ///< 沒辦法馬上取得, 需要等待的次數
+            std::uint64_t m_waitNanoseconds;
+            std::uint64_t m_maxWaitNanoseconds;
+        };
+        struct Snapshot
+        {
+            std::vector<AssetStatistics> m_assets;  ///< 依 hit count 由多到少
+            std::uint64_t m_hitCount;
+            std::uint64_t m_readBytes;
+            std::uint64_t m_decompressCount;
+            std::uint64_t m_decompressedBytes;
+            std::uint64_t m_decompressNanoseconds;
+            std::array<std::uint64_t, DECOMPRESS_HISTOGRAM_BUCKET_COUNT> m_decompressHistogram;
+            LockWaitStatistics m_bundleLockWait;
+            LockWaitStatistics m_headerLockWait;
+        };
+    public:
+        AssetAccessStatistics();
+        AssetAccessStatistics(const AssetAccessStatistics&) = delete;
+        AssetAccessStatistics(AssetAccessStatistics&&) = delete;
+        ~AssetAccessStatistics() noexcept;
+
+        AssetAccessStatistics& operator=(const AssetAccessStatistics&) = delete;
+        AssetAccessStatistics& operator=(AssetAccessStatistics&&) = delete;
+
+        /** 以下 record 都是 thread safe */
+        void recordAccess(const std::string& asset_key);
+        void recordRead(const std::string& asset_key, std::uint64_t read_bytes);
+        void recordDecompress(const std::string& asset_key, std::uint64_t decompressed_bytes, std::chrono::nanoseconds elapsed);
+        void recordLockWait(FileLocker file_locker, bool is_contended, std::chrono::nanoseconds elapsed);
+
+        [[nodiscard]] Snapshot getSnapshot() const;
+        /** 全部歸零; 每個 frame 取 snapshot 後 clear, 就是每個 frame 的數字 */
+        void clear();
+
+        /** 文字檔, 一行一筆, 欄位以 tab 分隔, 第一欄是這一行的種類; asset 那一行 key 放在最後 */
+        static error exportToFile(const Snapshot& snapshot, const std::string& file_path);
+
+    private:
+        AssetStatistics& getAssetStatistics(const std::string& asset_key);
+
+    private:
+        mutable std::mutex m_statisticsLocker;
+        std::unordered_map<std::string, AssetStatistics> m_assets;
+        std::array<std::uint64_t, DECOMPRESS_HISTOGRAM_BUCKET_COUNT> m_decompressHistogram;
+        LockWaitStatistics m_bundleLockWait;
+        LockWaitStatistics m_headerLockWait;
+    };
+}
+
+#endif // ASSET_ACCESS_STATISTICS_HPP
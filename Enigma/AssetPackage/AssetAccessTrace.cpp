@@ -0,0 +1,70 @@
+﻿#include "AssetAccessTrace.hpp"
+#include "AssetPackageErrors.hpp"
+#include <fstream>
+
+using namespace AssetPackage;
+
+AssetAccessTrace::AssetAccessTrace() = default;
+
+AssetAccessTrace::~AssetAccessTrace() noexcept
+{
+    clear();
+}
+
+void AssetAccessTrace::recordAccess(const std::string& asset_key)
+{
+    if (asset_key.empty()) return;
+    const std::lock_guard<std::mutex> locker{ m_traceLocker };
+    if (!m_recordedKeys.insert(asset_key).second) return;
+    m_accessOrder.push_back(asset_key);
+}
+
+std::vector<std::string> AssetAccessTrace::getAccessOrder() const
+{
+    const std::lock_guard<std::mutex> locker{ m_traceLocker };
+    return m_accessOrder;
+}
+
+size_t AssetAccessTrace::getRecordCount() const
+{
+    const std::lock_guard<std::mutex> locker{ m_traceLocker };
+    return m_accessOrder.size();
+}
+
+void AssetAccessTrace::clear()
+{
+    const std::lock_guard<std::mutex> locker{ m_traceLocker };
+    m_accessOrder.clear();
+    m_recordedKeys.clear();
+}
+
+error AssetAccessTrace::exportToFile(const std::string& file_path) const
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    std::ofstream trace_file{ file_path, std::fstream::out | std::fstream::binary | std::fstream::trunc };
+    if (!trace_file) return ErrorCode::fileOpenFail;
+    const std::lock_guard<std::mutex> locker{ m_traceLocker };
+    for (const auto& asset_key : m_accessOrder)
+    {
+        trace_file << asset_key << '\n';
+    }
+    trace_file.flush();
+    if (!trace_file) return ErrorCode::fileWriteFail;
+    return ErrorCode::ok;
+}
+
+error AssetAccessTrace::importFromFile(const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    std::ifstream trace_file{ file_path, std::fstream::in | std::fstream::binary };
+    if (!trace_file) return ErrorCode::fileOpenFail;
+    std::string asset_key;
+    while (std::getline(trace_file, asset_key))
+    {
+        // 在 windows 上編輯過的檔案行尾會有 '\r'
+        if ((!asset_key.empty()) && (asset_key.back() == '\r')) asset_key.pop_back();
+        recordAccess(asset_key);
+    }
+    if (trace_file.bad()) return ErrorCode::fileReadFail;
+    return ErrorCode::ok;
+}
@@ -0,0 +1,49 @@
+﻿/*****************************************************************
+ * \file   AssetAccessTrace.hpp
+ * \brief  記錄 asset 第一次被讀取的順序, 離線時用來重新排列 bundle
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_ACCESS_TRACE_HPP
+#define ASSET_ACCESS_TRACE_HPP
+
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class AssetAccessTrace
+    {
+    public:
+        AssetAccessTrace();
+        AssetAccessTrace(const AssetAccessTrace&) = delete;
+        AssetAccessTrace(AssetAccessTrace&&) = delete;
+        ~AssetAccessTrace() noexcept;
+
+        AssetAccessTrace& operator=(const AssetAccessTrace&) = delete;
+        AssetAccessTrace& operator=(AssetAccessTrace&&) = delete;
+
+        /** 只記第一次讀取, 之後重複讀取不影響順序; thread safe */
+        void recordAccess(const std::string& asset_key);
+        [[nodiscard]] std::vector<std::string> getAccessOrder() const;
+        [[nodiscard]] size_t getRecordCount() const;
+        void clear();
+
+        /** 文字檔, 一行一個 asset key, 可以把多次執行的 trace 接起來 */
+        error exportToFile(const std::string& file_path) const;
+        /** 接在目前記錄的後面, 已經有的 key 略過 */
+        error importFromFile(const std::string& file_path);
+
+    private:
+        mutable std::mutex m_traceLocker;
+        std::vector<std::string> m_accessOrder;
+        std::unordered_set<std::string> m_recordedKeys;
+    };
+}
+
+#endif // ASSET_ACCESS_TRACE_HPP
@@ -0,0 +1,481 @@
+﻿#include "AssetCodec.hpp"
+#include "AssetPackageErrors.hpp"
+#include "zlib.h"
+#include <cstring>
+#include <algorithm>
+
+using namespace AssetPackage;
+
+// zlib 的 avail_in/avail_out 是 uInt, 超過 4G 的內容要分段餵給 zlib
+constexpr std::uint64_t ZLIB_STREAM_CHUNK_SIZE = 256 * 1024 * 1024;
+
+// 串流解壓時每次從 bundle 取的壓縮資料大小
+constexpr size_t STREAM_INPUT_CHUNK_SIZE = 64 * 1024;
+
+// LZ4 block 格式的限制 : 最短 match 4 bytes, 最後 5 bytes 一定是 literal, 最後一個 match 要在結尾 12 bytes 之前開始
+constexpr size_t FAST_LZ_MIN_MATCH = 4;
+constexpr size_t FAST_LZ_LAST_LITERALS = 5;
+constexpr size_t FAST_LZ_MATCH_FIND_LIMIT = 12;
+constexpr size_t FAST_LZ_MAX_OFFSET = 65535;
+constexpr unsigned int FAST_LZ_HASH_BITS = 16;
+// 小 asset 的 hash table 依大小縮小, 最小 2^8 個位置
+constexpr unsigned int FAST_LZ_MIN_HASH_BITS = 8;
+// 連續找不到 match 時加大步距, 不可壓縮的內容才不會太慢
+constexpr unsigned int FAST_LZ_SKIP_TRIGGER = 6;
+
+static bool isEmptyDictionary(const AssetCodec::Dictionary& dictionary)
+{
+    return (dictionary.m_data == nullptr) || (dictionary.m_size == 0);
+}
+
+static std::optional<std::vector<unsigned char>> compressZlib(const char* data, size_t size, int level, const AssetCodec::Dictionary& dictionary)
+{
+    // 跟 zlib compress 產生一樣的格式, 但是分段壓縮, 所以內容可以超過 4G
+    z_stream stream{};
+    if (deflateInit(&stream, level) != Z_OK) return std::nullopt;
+    if (!isEmptyDictionary(dictionary))
+    {
+        // zlib 只用 dictionary 最後 32K, 也就是 window 大小
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        if (deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary.m_data), static_cast<uInt>(dictionary.m_size)) != Z_OK)
+        {
+            deflateEnd(&stream);
+            return std::nullopt;
+        }
+    }
+    std::vector<unsigned char> comp_buff;
+    comp_buff.resize(size <= UINT32_MAX ? compressBound(static_cast<uLong>(size)) : size, 0);
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    int z_result = Z_OK;
+    while (z_result == Z_OK)
+    {
+        if (stream.avail_in == 0)
+        {
+            const size_t in_chunk = static_cast<size_t>(std::min<std::uint64_t>(size - in_pos, ZLIB_STREAM_CHUNK_SIZE));
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-type-const-cast)
+            stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(data + in_pos));
+            stream.avail_in = static_cast<uInt>(in_chunk);
+            in_pos += in_chunk;
+        }
+        if (out_pos == comp_buff.size())
+        {
+            comp_buff.resize(comp_buff.size() + static_cast<size_t>(std::min<std::uint64_t>(comp_buff.size() / 2 + 1, ZLIB_STREAM_CHUNK_SIZE)), 0);
+        }
+        const size_t out_chunk = static_cast<size_t>(std::min<std::uint64_t>(comp_buff.size() - out_pos, ZLIB_STREAM_CHUNK_SIZE));
+        stream.next_out = comp_buff.data() + out_pos;
+        stream.avail_out = static_cast<uInt>(out_chunk);
+        z_result = deflate(&stream, in_pos == size ? Z_FINISH : Z_NO_FLUSH);
+        out_pos += out_chunk - stream.avail_out;
+        if (z_result == Z_BUF_ERROR) z_result = Z_OK;  // 沒有進度, 補輸入或輸出空間後繼續
+    }
+    deflateEnd(&stream);
+    if (z_result != Z_STREAM_END) return std::nullopt;
+    comp_buff.resize(out_pos);
+    return comp_buff;
+}
+
+static int inflateWithDictionary(z_stream& stream, const AssetCodec::Dictionary& dictionary)
+{
+    int z_result = inflate(&stream, Z_NO_FLUSH);
+    if (z_result != Z_NEED_DICT) return z_result;
+    // stream header 帶著 dictionary 的 adler32, 不是同一份 dictionary 時 inflateSetDictionary 會失敗
+    if (isEmptyDictionary(dictionary)) return Z_DATA_ERROR;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    z_result = inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary.m_data), static_cast<uInt>(dictionary.m_size));
+    if (z_result != Z_OK) return Z_DATA_ERROR;
+    return inflate(&stream, Z_NO_FLUSH);
+}
+
+static error uncompressZlib(const char* comp_data, std::uint64_t comp_size, char* out_data, std::uint64_t orig_size, const AssetCodec::Dictionary& dictionary)
+{
+    // 跟 zlib uncompress 一樣, 但是分段解壓, 所以內容可以超過 4G
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) return ErrorCode::decompressFail;
+    std::uint64_t in_pos = 0;
+    std::uint64_t out_pos = 0;
+    int z_result = Z_OK;
+    while (z_result == Z_OK)
+    {
+        if ((stream.avail_in == 0) && (in_pos < comp_size))
+        {
+            const std::uint64_t in_chunk = std::min(comp_size - in_pos, ZLIB_STREAM_CHUNK_SIZE);
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-type-const-cast)
+            stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(comp_data + in_pos));
+            stream.avail_in = static_cast<uInt>(in_chunk);
+            in_pos += in_chunk;
+        }
+        if ((stream.avail_out == 0) && (out_pos < orig_size))
+        {
+            const std::uint64_t out_chunk = std::min(orig_size - out_pos, ZLIB_STREAM_CHUNK_SIZE);
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            stream.next_out = reinterpret_cast<Bytef*>(out_data + out_pos);
+            stream.avail_out = static_cast<uInt>(out_chunk);
+            out_pos += out_chunk;
+        }
+        z_result = inflateWithDictionary(stream, dictionary);
+    }
+    const bool is_complete = (z_result == Z_STREAM_END) && (stream.avail_out == 0) && (out_pos == orig_size);
+    inflateEnd(&stream);
+    if (!is_complete) return ErrorCode::decompressFail;
+    return ErrorCode::ok;
+}
+
+static void writeFastLzLength(std::vector<unsigned char>& out, size_t length)
+{
+    // token 內放不下的長度, 接著用 255 累加
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<unsigned char>(length));
+}
+
+static void writeFastLzSequence(std::vector<unsigned char>& out, const unsigned char* literals, size_t literal_length, size_t match_offset, size_t match_length)
+{
+    const size_t match_code = match_length - FAST_LZ_MIN_MATCH;
+    const auto token = static_cast<unsigned char>((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15));
+    out.push_back(token);
+    if (literal_length >= 15) writeFastLzLength(out, literal_length - 15);
+    out.insert(out.end(), literals, literals + literal_length);
+    out.push_back(static_cast<unsigned char>(match_offset & 0xff));
+    out.push_back(static_cast<unsigned char>(match_offset >> 8));
+    if (match_code >= 15) writeFastLzLength(out, match_code - 15);
+}
+
+static void writeFastLzLastLiterals(std::vector<unsigned char>& out, const unsigned char* literals, size_t literal_length)
+{
+    out.push_back(static_cast<unsigned char>(std::min<size_t>(literal_length, 15) << 4));
+    if (literal_length >= 15) writeFastLzLength(out, literal_length - 15);
+    out.insert(out.end(), literals, literals + literal_length);
+}
+
+static std::uint32_t readFastLzWord(const unsigned char* p)
+{
+    std::uint32_t word = 0;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static std::vector<unsigned char> compressFastLz(const char* data, size_t size)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* src = reinterpret_cast<const unsigned char*>(data);
+    std::vector<unsigned char> out;
+    out.reserve(size + size / 255 + 16);
+    size_t anchor = 0;
+    if (size > FAST_LZ_MATCH_FIND_LIMIT)
+    {
+        constexpr size_t no_position = SIZE_MAX;
+        // 位置數不會超過 size, table 不用比 size 大; 大量小 asset 時每次配置跟初始化的量才不會是固定的 512 KB
+        unsigned int hash_bits = FAST_LZ_MIN_HASH_BITS;
+        while ((hash_bits < FAST_LZ_HASH_BITS) && ((static_cast<size_t>(1) << hash_bits) < size)) hash_bits++;
+        std::vector<size_t> hash_table(static_cast<size_t>(1) << hash_bits, no_position);
+        const size_t match_find_end = size - FAST_LZ_MATCH_FIND_LIMIT;
+        const size_t match_extend_end = size - FAST_LZ_LAST_LITERALS;
+        size_t pos = 0;
+        unsigned int miss_count = 0;
+        while (pos < match_find_end)
+        {
+            const std::uint32_t word = readFastLzWord(src + pos);
+            const std::uint32_t hash = (word * 2654435761U) >> (32 - hash_bits);
+            const size_t candidate = hash_table[hash];
+            hash_table[hash] = pos;
+            if ((candidate == no_position) || (pos - candidate > FAST_LZ_MAX_OFFSET) || (readFastLzWord(src + candidate) != word))
+            {
+                pos += 1 + (miss_count++ >> FAST_LZ_SKIP_TRIGGER);
+                continue;
+            }
+            miss_count = 0;
+            size_t match_length = FAST_LZ_MIN_MATCH;
+            while ((pos + match_length < match_extend_end) && (src[candidate + match_length] == src[pos + match_length]))
+            {
+                match_length++;
+            }
+            writeFastLzSequence(out, src + anchor, pos - anchor, pos - candidate, match_length);
+            pos += match_length;
+            anchor = pos;
+        }
+    }
+    writeFastLzLastLiterals(out, src + anchor, size - anchor);
+    return out;
+}
+
+static bool readFastLzLength(const unsigned char* src, size_t src_size, size_t& ip, size_t& length)
+{
+    unsigned char next = 255;
+    while (next == 255)
+    {
+        if (ip >= src_size) return false;
+        next = src[ip++];
+        length += next;
+    }
+    return true;
+}
+
+static error uncompressFastLz(const char* comp_data, std::uint64_t comp_size, char* out_data, std::uint64_t orig_size)
+{
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* src = reinterpret_cast<const unsigned char*>(comp_data);
+    auto* dst = reinterpret_cast<unsigned char*>(out_data);
+    // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto src_size = static_cast<size_t>(comp_size);
+    const auto dst_size = static_cast<size_t>(orig_size);
+    size_t ip = 0;
+    size_t op = 0;
+    // 每個長度跟 offset 都先檢查邊界, 壞掉的資料不會讀寫到 buffer 外面
+    while (ip < src_size)
+    {
+        const unsigned char token = src[ip++];
+        size_t literal_length = token >> 4;
+        if ((literal_length == 15) && (!readFastLzLength(src, src_size, ip, literal_length))) return ErrorCode::decompressFail;
+        if ((literal_length > src_size - ip) || (literal_length > dst_size - op)) return ErrorCode::decompressFail;
+        std::memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == src_size) break;
+
+        if (src_size - ip < 2) return ErrorCode::decompressFail;
+        const size_t match_offset = static_cast<size_t>(src[ip]) | (static_cast<size_t>(src[ip + 1]) << 8);
+        ip += 2;
+        if ((match_offset == 0) || (match_offset > op)) return ErrorCode::decompressFail;
+        size_t match_length = token & 0x0f;
+        if ((match_length == 15) && (!readFastLzLength(src, src_size, ip, match_length))) return ErrorCode::decompressFail;
+        match_length += FAST_LZ_MIN_MATCH;
+        if (match_length > dst_size - op) return ErrorCode::decompressFail;
+        const unsigned char* match = dst + op - match_offset;
+        if (match_offset >= match_length)
+        {
+            std::memcpy(dst + op, match, match_length);
+        }
+        else
+        {
+            // 重疊的 match 要一個一個 byte 複製
+            for (size_t i = 0; i < match_length; i++)
+            {
+                dst[op + i] = match[i];
+            }
+        }
+        op += match_length;
+    }
+    if (op != dst_size) return ErrorCode::decompressFail;
+    return ErrorCode::ok;
+}
+
+std::optional<std::vector<unsigned char>> AssetCodec::compressContent(AssetCodecId codec, const char* data, size_t size, int zlib_level, const Dictionary& dictionary)
+{
+    switch (codec)
+    {
+    case AssetCodecId::zlib:
+        return compressZlib(data, size, zlib_level, {});
+    case AssetCodecId::zlibDictionary:
+        if (isEmptyDictionary(dictionary)) return std::nullopt;
+        return compressZlib(data, size, zlib_level, dictionary);
+    case AssetCodecId::stored:
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        return std::vector<unsigned char>{ reinterpret_cast<const unsigned char*>(data), reinterpret_cast<const unsigned char*>(data) + size };
+    case AssetCodecId::fastLz:
+        return compressFastLz(data, size);
+    }
+    return std::nullopt;
+}
+
+error AssetCodec::uncompressContentTo(AssetCodecId codec, const char* comp_data, std::uint64_t comp_size, char* out_data, std::uint64_t orig_size, const Dictionary& dictionary)
+{
+    switch (codec)
+    {
+    case AssetCodecId::zlib:
+        return uncompressZlib(comp_data, comp_size, out_data, orig_size, {});
+    case AssetCodecId::zlibDictionary:
+        return uncompressZlib(comp_data, comp_size, out_data, orig_size, dictionary);
+    case AssetCodecId::stored:
+        if (comp_size != orig_size) return ErrorCode::decompressFail;
+        std::memcpy(out_data, comp_data, static_cast<size_t>(orig_size));
+        return ErrorCode::ok;
+    case AssetCodecId::fastLz:
+        return uncompressFastLz(comp_data, comp_size, out_data, orig_size);
+    }
+    return ErrorCode::unknownCodec;
+}
+
+static std::uint64_t getSeekableBlockCount(std::uint64_t orig_size, unsigned int block_size)
+{
+    return (orig_size + block_size - 1) / block_size;
+}
+
+std::optional<std::vector<unsigned char>> AssetCodec::compressSeekableContent(AssetCodecId codec, unsigned int block_size, const char* data, size_t size, int zlib_level,
+    const Dictionary& dictionary)
+{
+    if (block_size == 0) return std::nullopt;
+    const auto block_count = static_cast<size_t>(getSeekableBlockCount(size, block_size));
+    const size_t table_bytes = block_count * sizeof(std::uint64_t);
+    std::vector<unsigned char> comp_buff(table_bytes, 0);
+    for (size_t i = 0; i < block_count; i++)
+    {
+        const size_t block_begin = i * block_size;
+        const size_t block_orig_size = std::min<size_t>(block_size, size - block_begin);
+        const auto block_buff = compressContent(codec, data + block_begin, block_orig_size, zlib_level, dictionary);
+        if (!block_buff) return std::nullopt;
+        comp_buff.insert(comp_buff.end(), block_buff->begin(), block_buff->end());
+        const std::uint64_t block_end = comp_buff.size() - table_bytes;
+        std::memcpy(comp_buff.data() + i * sizeof(std::uint64_t), &block_end, sizeof(std::uint64_t));
+    }
+    return comp_buff;
+}
+
+error AssetCodec::uncompressSeekableContentTo(AssetCodecId codec, unsigned int block_size, const char* comp_data, std::uint64_t comp_size, char* out_data, std::uint64_t orig_size,
+    const Dictionary& dictionary)
+{
+    const ContentFetcher fetch = [comp_data, comp_size](std::uint64_t offset, size_t size) -> const char*
+        {
+            if ((offset > comp_size) || (size > comp_size - offset)) return nullptr;
+            return comp_data + offset;
+        };
+    std::uint64_t out_pos = 0;
+    const ContentSink sink = [out_data, &out_pos](const char* data, size_t size)
+        {
+            std::memcpy(out_data + out_pos, data, size);
+            out_pos += size;
+            return true;
+        };
+    // 整個解壓時每個 block 一次交給 sink
+    return uncompressContentRange(codec, block_size, comp_size, orig_size, 0, orig_size, fetch, sink, block_size, dictionary);
+}
+
+static bool emitContentRange(const char* data, std::uint64_t data_begin, size_t data_size, std::uint64_t begin, std::uint64_t end, size_t chunk_size, const AssetCodec::ContentSink& sink)
+{
+    // 只交出跟 [begin, end) 重疊的部分
+    const std::uint64_t emit_begin = std::max(begin, data_begin);
+    const std::uint64_t emit_end = std::min(end, data_begin + data_size);
+    for (std::uint64_t pos = emit_begin; pos < emit_end; pos += chunk_size)
+    {
+        const auto emit_size = static_cast<size_t>(std::min<std::uint64_t>(chunk_size, emit_end - pos));
+        if (!sink(data + (pos - data_begin), emit_size)) return false;
+    }
+    return true;
+}
+
+static error uncompressSeekableRange(AssetCodecId codec, unsigned int block_size, std::uint64_t comp_size, std::uint64_t orig_size,
+    std::uint64_t begin, std::uint64_t end, const AssetCodec::ContentFetcher& fetch, const AssetCodec::ContentSink& sink, size_t chunk_size, const AssetCodec::Dictionary& dictionary)
+{
+    const std::uint64_t block_count = getSeekableBlockCount(orig_size, block_size);
+    const std::uint64_t table_bytes = block_count * sizeof(std::uint64_t);
+    if (table_bytes > comp_size) return ErrorCode::decompressFail;
+    const std::uint64_t first_block = begin / block_size;
+    const std::uint64_t last_block = (end - 1) / block_size;
+    // 只讀涵蓋範圍需要的 block 結尾位置, 第一個 block 還要前一個 block 的結尾
+    const std::uint64_t table_first = first_block > 0 ? first_block - 1 : 0;
+    const auto table_count = static_cast<size_t>(last_block - table_first + 1);
+    const char* table_data = fetch(table_first * sizeof(std::uint64_t), table_count * sizeof(std::uint64_t));
+    if (table_data == nullptr) return ErrorCode::fileReadFail;
+    std::vector<std::uint64_t> block_ends(table_count);
+    std::memcpy(block_ends.data(), table_data, table_count * sizeof(std::uint64_t));
+
+    std::vector<char> block_buff;
+    block_buff.resize(static_cast<size_t>(std::min<std::uint64_t>(block_size, orig_size)));
+    for (std::uint64_t block = first_block; block <= last_block; block++)
+    {
+        const std::uint64_t comp_begin = block > 0 ? block_ends[static_cast<size_t>(block - 1 - table_first)] : 0;
+        const std::uint64_t comp_end = block_ends[static_cast<size_t>(block - table_first)];
+        if ((comp_end < comp_begin) || (comp_end > comp_size - table_bytes)) return ErrorCode::decompressFail;
+        const std::uint64_t block_begin = block * block_size;
+        const auto block_orig_size = static_cast<size_t>(std::min<std::uint64_t>(block_size, orig_size - block_begin));
+        const auto block_comp_size = static_cast<size_t>(comp_end - comp_begin);
+        const char* block_data = fetch(table_bytes + comp_begin, block_comp_size);
+        if (block_data == nullptr) return ErrorCode::fileReadFail;
+        if (const error er = AssetCodec::uncompressContentTo(codec, block_data, block_comp_size, block_buff.data(), block_orig_size, dictionary)) return er;
+        if (!emitContentRange(block_buff.data(), block_begin, block_orig_size, begin, end, chunk_size, sink)) return ErrorCode::streamAborted;
+    }
+    return ErrorCode::ok;
+}
+
+static error uncompressZlibRange(std::uint64_t comp_size, std::uint64_t orig_size, std::uint64_t begin, std::uint64_t end,
+    const AssetCodec::ContentFetcher& fetch, const AssetCodec::ContentSink& sink, size_t chunk_size, const AssetCodec::Dictionary& dictionary)
+{
+    // zlib 沒辦法從中間開始, 從頭解壓, begin 之前的部分解出來就丟掉, 記憶體只用一個 chunk
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) return ErrorCode::decompressFail;
+    std::vector<char> out_buff(std::min<std::uint64_t>(chunk_size, orig_size));
+    std::uint64_t in_pos = 0;
+    std::uint64_t out_pos = 0;
+    error er = ErrorCode::ok;
+    int z_result = Z_OK;
+    while ((z_result == Z_OK) && (out_pos < end))
+    {
+        if ((stream.avail_in == 0) && (in_pos < comp_size))
+        {
+            const auto in_chunk = static_cast<size_t>(std::min<std::uint64_t>(comp_size - in_pos, STREAM_INPUT_CHUNK_SIZE));
+            const char* in_data = fetch(in_pos, in_chunk);
+            if (in_data == nullptr)
+            {
+                er = ErrorCode::fileReadFail;
+                break;
+            }
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-type-const-cast)
+            stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(in_data));
+            stream.avail_in = static_cast<uInt>(in_chunk);
+            in_pos += in_chunk;
+        }
+        const auto out_chunk = static_cast<size_t>(std::min<std::uint64_t>(out_buff.size(), orig_size - out_pos));
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        stream.next_out = reinterpret_cast<Bytef*>(out_buff.data());
+        stream.avail_out = static_cast<uInt>(out_chunk);
+        z_result = inflateWithDictionary(stream, dictionary);
+        const size_t produced = out_chunk - stream.avail_out;
+        if ((z_result == Z_BUF_ERROR) && (produced == 0) && (out_chunk > 0) && (in_pos < comp_size)) z_result = Z_OK;  // 輸入用完, 補輸入後繼續
+        if (!emitContentRange(out_buff.data(), out_pos, produced, begin, end, chunk_size, sink))
+        {
+            er = ErrorCode::streamAborted;
+            break;
+        }
+        out_pos += produced;
+    }
+    inflateEnd(&stream);
+    if (er) return er;
+    if (out_pos < end) return ErrorCode::decompressFail;
+    return ErrorCode::ok;
+}
+
+error AssetCodec::uncompressContentRange(AssetCodecId codec, unsigned int block_size, std::uint64_t comp_size, std::uint64_t orig_size,
+    std::uint64_t begin, std::uint64_t end, const ContentFetcher& fetch, const ContentSink& sink, size_t chunk_size, const Dictionary& dictionary)
+{
+    if ((begin > end) || (end > orig_size) || (chunk_size == 0)) return ErrorCode::invalidRange;
+    if (begin == end) return ErrorCode::ok;
+    if (!isValidCodec(static_cast<unsigned int>(codec))) return ErrorCode::unknownCodec;
+    if (block_size > 0) return uncompressSeekableRange(codec, block_size, comp_size, orig_size, begin, end, fetch, sink, chunk_size, dictionary);
+
+    switch (codec)
+    {
+    case AssetCodecId::zlib:
+        return uncompressZlibRange(comp_size, orig_size, begin, end, fetch, sink, chunk_size, {});
+    case AssetCodecId::zlibDictionary:
+        return uncompressZlibRange(comp_size, orig_size, begin, end, fetch, sink, chunk_size, dictionary);
+    case AssetCodecId::stored:
+        if (comp_size != orig_size) return ErrorCode::decompressFail;
+        for (std::uint64_t pos = begin; pos < end; pos += chunk_size)
+        {
+            const auto read_size = static_cast<size_t>(std::min<std::uint64_t>(chunk_size, end - pos));
+            const char* data = fetch(pos, read_size);
+            if (data == nullptr) return ErrorCode::fileReadFail;
+            if (!sink(data, read_size)) return ErrorCode::streamAborted;
+        }
+        return ErrorCode::ok;
+    case AssetCodecId::fastLz:
+        {
+            // LZ4 block 的 match 可以參照前面任何位置的輸出, 不是 seekable 格式就只能整個解壓
+            const char* comp_data = fetch(0, static_cast<size_t>(comp_size));
+            if (comp_data == nullptr) return ErrorCode::fileReadFail;
+            std::vector<char> out_buff(static_cast<size_t>(orig_size));
+            if (const error er = uncompressFastLz(comp_data, comp_size, out_buff.data(), orig_size)) return er;
+            if (!emitContentRange(out_buff.data(), 0, out_buff.size(), begin, end, chunk_size, sink)) return ErrorCode::streamAborted;
+            return ErrorCode::ok;
+        }
+    }
+    return ErrorCode::unknownCodec;
+}
+
+bool AssetCodec::isValidCodec(unsigned int codec_value)
+{
+    return codec_value <= static_cast<unsigned int>(AssetCodecId::zlibDictionary);
+}
@@ -0,0 +1,70 @@
+﻿/*****************************************************************
+ * \file   AssetCodec.hpp
+ * \brief  asset 內容的壓縮格式, codec id 記在每個 asset 的 header
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_CODEC_HPP
+#define ASSET_CODEC_HPP
+
+#include <functional>
+#include <optional>
+#include <system_error>
+#include <vector>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    /** 寫進檔案的值, 不可以改; 舊格式沒有 codec 欄位, 讀取時都當作 zlib */
+    enum class AssetCodecId : unsigned int
+    {
+        zlib = 0,
+        stored = 1,  ///< 不壓縮, 給已經壓縮過的內容 (png, ogg...)
+        fastLz = 2,  ///< LZ4 block 格式, 壓縮率比 zlib 差, 解壓快很多
+        zlibDictionary = 3,  ///< zlib 加上 package 共用的 preset dictionary, 給很小的 asset
+    };
+
+    /** zlibDictionary 用的 preset dictionary, 只有指標, 內容由呼叫端持有 */
+    struct AssetCodecDictionary
+    {
+        const char* m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    class AssetCodec
+    {
+    public:
+        constexpr static int DEFAULT_ZLIB_LEVEL = -1;  ///< 同 Z_DEFAULT_COMPRESSION
+        constexpr static unsigned int DEFAULT_SEEKABLE_BLOCK_SIZE = 1024 * 1024;
+        constexpr static size_t DEFAULT_STREAM_CHUNK_SIZE = 256 * 1024;
+        using Dictionary = AssetCodecDictionary;
+
+        /** 取 asset 壓縮資料中 [offset, offset + size) 的內容, 回傳的指標到下一次呼叫前有效; 讀取失敗回傳 nullptr */
+        using ContentFetcher = std::function<const char*(std::uint64_t offset, size_t size)>;
+        /** 收到一段解壓後的內容, 回傳 false 表示不要再讀 */
+        using ContentSink = std::function<bool(const char* data, size_t size)>;
+
+        /** zlib_level 只有 zlib 會用到, 範圍同 zlib (0~9, -1 為預設); zlibDictionary 要給 dictionary, 其他 codec 不用 */
+        static std::optional<std::vector<unsigned char>> compressContent(AssetCodecId codec, const char* data, size_t size, int zlib_level = DEFAULT_ZLIB_LEVEL,
+            const Dictionary& dictionary = {});
+        /** out_data 要有 orig_size 的空間, 解出來的長度不等於 orig_size 也算失敗 */
+        static error uncompressContentTo(AssetCodecId codec, const char* comp_data, std::uint64_t comp_size, char* out_data, std::uint64_t orig_size,
+            const Dictionary& dictionary = {});
+        /** seekable 格式 : 每 block_size bytes 獨立壓縮, 前面放每個 block 壓縮後結尾位置的表 (64 bits),
+         * 讀取一段範圍時只要解壓涵蓋的 block */
+        static std::optional<std::vector<unsigned char>> compressSeekableContent(AssetCodecId codec, unsigned int block_size, const char* data, size_t size, int zlib_level = DEFAULT_ZLIB_LEVEL,
+            const Dictionary& dictionary = {});
+        static error uncompressSeekableContentTo(AssetCodecId codec, unsigned int block_size, const char* comp_data, std::uint64_t comp_size, char* out_data, std::uint64_t orig_size,
+            const Dictionary& dictionary = {});
+        /** 解壓後 [begin, end) 的內容分段 (每段最多 chunk_size) 交給 sink, sink 停止時回傳 streamAborted;
+         * block_size 為 0 表示不是 seekable 格式, zlib 跟 stored 從頭分段讀, fastLz 要整個解壓, 大的 asset 應該用 seekable 格式 */
+        static error uncompressContentRange(AssetCodecId codec, unsigned int block_size, std::uint64_t comp_size, std::uint64_t orig_size,
+            std::uint64_t begin, std::uint64_t end, const ContentFetcher& fetch, const ContentSink& sink, size_t chunk_size = DEFAULT_STREAM_CHUNK_SIZE,
+            const Dictionary& dictionary = {});
+        [[nodiscard]] static bool isValidCodec(unsigned int codec_value);
+    };
+}
+
+#endif // ASSET_CODEC_HPP
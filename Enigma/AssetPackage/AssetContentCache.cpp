@@ -0,0 +1,87 @@
+﻿#include "AssetContentCache.hpp"
+#include <cassert>
+
+using namespace AssetPackage;
+
+AssetContentCache::AssetContentCache(std::uint64_t budget_bytes) : m_budgetBytes(budget_bytes), m_cachedBytes(0), m_hitCount(0), m_missCount(0), m_evictionCount(0)
+{
+}
+
+AssetContentCache::~AssetContentCache() noexcept
+{
+    m_contentMap.clear();
+    m_lruList.clear();
+}
+
+AssetContentCache::Content AssetContentCache::tryGetContent(const std::string& asset_key)
+{
+    const std::lock_guard<std::mutex> locker{ m_cacheLocker };
+    const auto it = m_contentMap.find(asset_key);
+    if (it == m_contentMap.end())
+    {
+        m_missCount++;
+        return nullptr;
+    }
+    m_hitCount++;
+    m_lruList.splice(m_lruList.begin(), m_lruList, it->second);
+    return it->second->second;
+}
+
+void AssetContentCache::insertContent(const std::string& asset_key, const Content& content)
+{
+    if (!content) return;
+    if (content->size() > m_budgetBytes) return;
+    const std::lock_guard<std::mutex> locker{ m_cacheLocker };
+    const auto it = m_contentMap.find(asset_key);
+    if (it != m_contentMap.end())
+    {
+        // 多個執行緒同時 miss 同一個 key 時, 後放入的取代前面的
+        m_cachedBytes -= it->second->second->size();
+        it->second->second = content;
+        m_lruList.splice(m_lruList.begin(), m_lruList, it->second);
+    }
+    else
+    {
+        m_lruList.emplace_front(asset_key, content);
+        m_contentMap.emplace(asset_key, m_lruList.begin());
+    }
+    m_cachedBytes += content->size();
+    evictToBudget();
+}
+
+void AssetContentCache::invalidateContent(const std::string& asset_key)
+{
+    const std::lock_guard<std::mutex> locker{ m_cacheLocker };
+    const auto it = m_contentMap.find(asset_key);
+    if (it == m_contentMap.end()) return;
+    m_cachedBytes -= it->second->second->size();
+    m_lruList.erase(it->second);
+    m_contentMap.erase(it);
+}
+
+void AssetContentCache::clear()
+{
+    const std::lock_guard<std::mutex> locker{ m_cacheLocker };
+    m_contentMap.clear();
+    m_lruList.clear();
+    m_cachedBytes = 0;
+}
+
+AssetContentCache::Statistics AssetContentCache::getStatistics() const
+{
+    const std::lock_guard<std::mutex> locker{ m_cacheLocker };
+    return { m_hitCount, m_missCount, m_evictionCount, m_cachedBytes, m_budgetBytes };
+}
+
+void AssetContentCache::evictToBudget()
+{
+    while ((m_cachedBytes > m_budgetBytes) && (!m_lruList.empty()))
+    {
+        const auto& [key, content] = m_lruList.back();
+        assert(m_cachedBytes >= content->size());
+        m_cachedBytes -= content->size();
+        m_contentMap.erase(key);
+        m_lruList.pop_back();
+        m_evictionCount++;
+    }
+}
@@ -0,0 +1,68 @@
+﻿/*****************************************************************
+ * \file   AssetContentCache.hpp
+ * \brief  解壓後 asset 內容的 LRU cache, 以 byte 數限制大小
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_CONTENT_CACHE_HPP
+#define ASSET_CONTENT_CACHE_HPP
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    class AssetContentCache
+    {
+    public:
+        using Content = std::shared_ptr<const std::vector<char>>;
+        struct Statistics
+        {
+            std::uint64_t m_hitCount;
+            std::uint64_t m_missCount;
+            std::uint64_t m_evictionCount;
+            std::uint64_t m_cachedBytes;
+            std::uint64_t m_budgetBytes;
+        };
+    public:
+        AssetContentCache(std::uint64_t budget_bytes);
+        AssetContentCache(const AssetContentCache&) = delete;
+        AssetContentCache(AssetContentCache&&) = delete;
+        ~AssetContentCache() noexcept;
+
+        AssetContentCache& operator=(const AssetContentCache&) = delete;
+        AssetContentCache& operator=(AssetContentCache&&) = delete;
+
+        /** 找到的話移到最近使用, 並計入 hit; 找不到計入 miss */
+        Content tryGetContent(const std::string& asset_key);
+        /** 超過 budget 的內容不放進 cache; 放入後從最久沒用的開始淘汰到 budget 以內 */
+        void insertContent(const std::string& asset_key, const Content& content);
+        void invalidateContent(const std::string& asset_key);
+        void clear();
+
+        [[nodiscard]] Statistics getStatistics() const;
+
+    private:
+        void evictToBudget();
+
+    private:
+        using LruList = std::list<std::pair<std::string, Content>>;
+
+        std::uint64_t m_budgetBytes;
+        std::uint64_t m_cachedBytes;
+        std::uint64_t m_hitCount;
+        std::uint64_t m_missCount;
+        std::uint64_t m_evictionCount;
+        LruList m_lruList;  ///< 前面是最近使用的
+        std::unordered_map<std::string, LruList::iterator> m_contentMap;
+        mutable std::mutex m_cacheLocker;
+    };
+}
+
+#endif // ASSET_CONTENT_CACHE_HPP
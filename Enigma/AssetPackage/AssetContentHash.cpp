@@ -0,0 +1,105 @@
+﻿#include "AssetContentHash.hpp"
+
+using namespace AssetPackage;
+
+constexpr std::uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t HASH_PRIME_3 = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t HASH_PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr std::uint64_t HASH_PRIME_5 = 0x27D4EB2F165667C5ULL;
+constexpr size_t HASH_STRIPE_SIZE = 32;
+
+static std::uint64_t rotateLeft(std::uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static std::uint64_t readWord64(const unsigned char* p)
+{
+    // 以 little endian 組出 word, 結果跟平台的 byte order 無關
+    std::uint64_t word = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        word = (word << 8) | p[i];
+    }
+    return word;
+}
+
+static std::uint64_t readWord32(const unsigned char* p)
+{
+    return static_cast<std::uint64_t>(p[0]) | (static_cast<std::uint64_t>(p[1]) << 8) | (static_cast<std::uint64_t>(p[2]) << 16) | (static_cast<std::uint64_t>(p[3]) << 24);
+}
+
+static std::uint64_t hashRound(std::uint64_t acc, std::uint64_t input)
+{
+    acc += input * HASH_PRIME_2;
+    acc = rotateLeft(acc, 31);
+    return acc * HASH_PRIME_1;
+}
+
+static std::uint64_t hashMergeRound(std::uint64_t acc, std::uint64_t value)
+{
+    acc ^= hashRound(0, value);
+    return acc * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+std::uint64_t AssetContentHash::compute(const char* data, size_t size, std::uint64_t seed)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + size;
+    std::uint64_t hash = 0;
+    if (size >= HASH_STRIPE_SIZE)
+    {
+        // 四條獨立的累加, 一次處理 32 bytes
+        std::uint64_t v1 = seed + HASH_PRIME_1 + HASH_PRIME_2;
+        std::uint64_t v2 = seed + HASH_PRIME_2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - HASH_PRIME_1;
+        const unsigned char* const stripe_limit = end - HASH_STRIPE_SIZE;
+        do
+        {
+            v1 = hashRound(v1, readWord64(p));
+            v2 = hashRound(v2, readWord64(p + 8));
+            v3 = hashRound(v3, readWord64(p + 16));
+            v4 = hashRound(v4, readWord64(p + 24));
+            p += HASH_STRIPE_SIZE;
+        } while (p <= stripe_limit);
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = hashMergeRound(hash, v1);
+        hash = hashMergeRound(hash, v2);
+        hash = hashMergeRound(hash, v3);
+        hash = hashMergeRound(hash, v4);
+    }
+    else
+    {
+        hash = seed + HASH_PRIME_5;
+    }
+    hash += static_cast<std::uint64_t>(size);
+
+    while (end - p >= 8)
+    {
+        hash ^= hashRound(0, readWord64(p));
+        hash = rotateLeft(hash, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+        p += 8;
+    }
+    if (end - p >= 4)
+    {
+        hash ^= readWord32(p) * HASH_PRIME_1;
+        hash = rotateLeft(hash, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        hash ^= (*p) * HASH_PRIME_5;
+        hash = rotateLeft(hash, 11) * HASH_PRIME_1;
+        p++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,23 @@
+﻿/*****************************************************************
+ * \file   AssetContentHash.hpp
+ * \brief  asset 原始內容的 64 bits hash (xxHash64 演算法), 找重複內容用
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_CONTENT_HASH_HPP
+#define ASSET_CONTENT_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    class AssetContentHash
+    {
+    public:
+        [[nodiscard]] static std::uint64_t compute(const char* data, size_t size, std::uint64_t seed = 0);
+    };
+}
+
+#endif // ASSET_CONTENT_HASH_HPP
@@ -0,0 +1,61 @@
+﻿#include "AssetCrc32.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+using namespace AssetPackage;
+
+constexpr std::uint32_t CRC32_POLYNOMIAL = 0xEDB88320U;
+constexpr size_t CRC32_SLICE_COUNT = 8;
+
+using Crc32Tables = std::array<std::array<std::uint32_t, 256>, CRC32_SLICE_COUNT>;
+
+static constexpr Crc32Tables makeCrc32Tables()
+{
+    // table[k][b] 是 byte b 後面再接 k 個 0 byte 的 crc, 8 個 table 查完就是 8 bytes 的結果
+    Crc32Tables tables{};
+    for (std::uint32_t b = 0; b < 256; b++)
+    {
+        std::uint32_t crc = b;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1U) ? (crc >> 1) ^ CRC32_POLYNOMIAL : (crc >> 1);
+        }
+        tables[0][b] = crc;
+    }
+    for (std::uint32_t b = 0; b < 256; b++)
+    {
+        for (size_t k = 1; k < CRC32_SLICE_COUNT; k++)
+        {
+            const std::uint32_t prev = tables[k - 1][b];
+            tables[k][b] = (prev >> 8) ^ tables[0][prev & 0xffU];
+        }
+    }
+    return tables;
+}
+
+static constexpr Crc32Tables CRC32_TABLES = makeCrc32Tables();
+
+unsigned int AssetCrc32::compute(const char* data, size_t size, unsigned int crc)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    std::uint32_t value = ~static_cast<std::uint32_t>(crc);
+    while (size >= CRC32_SLICE_COUNT)
+    {
+        // 以 little endian 組出兩個 32 bits word, 不依賴平台的 byte order 跟對齊
+        const std::uint32_t low = value ^ (static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) | (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24));
+        const std::uint32_t high = static_cast<std::uint32_t>(p[4]) | (static_cast<std::uint32_t>(p[5]) << 8) | (static_cast<std::uint32_t>(p[6]) << 16) | (static_cast<std::uint32_t>(p[7]) << 24);
+        value = CRC32_TABLES[7][low & 0xffU] ^ CRC32_TABLES[6][(low >> 8) & 0xffU] ^ CRC32_TABLES[5][(low >> 16) & 0xffU] ^ CRC32_TABLES[4][low >> 24]
+            ^ CRC32_TABLES[3][high & 0xffU] ^ CRC32_TABLES[2][(high >> 8) & 0xffU] ^ CRC32_TABLES[1][(high >> 16) & 0xffU] ^ CRC32_TABLES[0][high >> 24];
+        p += CRC32_SLICE_COUNT;
+        size -= CRC32_SLICE_COUNT;
+    }
+    while (size > 0)
+    {
+        value = (value >> 8) ^ CRC32_TABLES[0][(value ^ *p) & 0xffU];
+        p++;
+        size--;
+    }
+    return ~value;
+}
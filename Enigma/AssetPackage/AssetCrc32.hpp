@@ -0,0 +1,23 @@
+﻿/*****************************************************************
+ * \file   AssetCrc32.hpp
+ * \brief  CRC32 (IEEE 802.3, 同 zlib crc32), slice-by-8 一次處理 8 bytes
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_CRC32_HPP
+#define ASSET_CRC32_HPP
+
+#include <cstddef>
+
+namespace AssetPackage
+{
+    class AssetCrc32
+    {
+    public:
+        /** 分段計算時, 把前一段的結果當作 crc 傳入 */
+        [[nodiscard]] static unsigned int compute(const char* data, size_t size, unsigned int crc = 0);
+    };
+}
+
+#endif // ASSET_CRC32_HPP
@@ -0,0 +1,213 @@
+﻿#include "AssetDedupTable.hpp"
+#include "AssetPackageErrors.hpp"
+#include "AssetContentHash.hpp"
+#include "AssetCrc32.hpp"
+#include <cassert>
+#include <cstring>
+
+using namespace AssetPackage;
+
+using AssetHeaderData = AssetHeaderDataMap::AssetHeaderData;
+
+// offset, hash, org size, raw crc, reserved
+constexpr size_t DEDUP_ATTRIBUTE_SIZE = sizeof(std::uint64_t) * 3 + sizeof(unsigned int) * 2;
+
+static AssetHeaderData makeSharedHeader(const AssetHeaderData& header)
+{
+    AssetHeaderData shared_header = header;
+    shared_header.m_name.clear();
+    if (header.isSolidMember())
+    {
+        // 其他 asset 共用時是整個 block 的內容
+        shared_header.m_orgSize = header.m_solidBlockSize;
+        shared_header.m_solidOffset = 0;
+        shared_header.m_solidBlockSize = 0;
+    }
+    return shared_header;
+}
+
+AssetDedupTable::AssetDedupTable()
+{
+    clear();
+}
+
+AssetDedupTable::~AssetDedupTable() noexcept
+{
+    clear();
+}
+
+AssetDedupTable::ContentKey AssetDedupTable::computeContentKey(const char* data, size_t size)
+{
+    return { AssetContentHash::compute(data, size), size, AssetCrc32::compute(data, size) };
+}
+
+std::optional<AssetDedupTable::SharedContent> AssetDedupTable::tryFindContent(const ContentKey& key, const std::function<bool(const SharedContent&)>& is_usable) const
+{
+    const auto [begin, end] = m_hashIndex.equal_range(key.m_hash);
+    for (auto it = begin; it != end; ++it)
+    {
+        const auto content = m_contents.find(it->second);
+        assert(content != m_contents.end());
+        if ((content->second.m_key == key) && ((!is_usable) || (is_usable(content->second)))) return content->second;
+    }
+    return std::nullopt;
+}
+
+void AssetDedupTable::insertContent(const ContentKey& key, const AssetHeaderData& header)
+{
+    assert(m_contents.find(header.m_offset) == m_contents.end());
+    const SharedContent content{ key, makeSharedHeader(header), 1, header.isSolidMember() };
+    m_contents.emplace(header.m_offset, content);
+    m_hashIndex.emplace(key.m_hash, header.m_offset);
+}
+
+error AssetDedupTable::addReference(std::uint64_t offset)
+{
+    const auto it = m_contents.find(offset);
+    if (it == m_contents.end()) return ErrorCode::invalidHeaderData;
+    it->second.m_refCount++;
+    return ErrorCode::ok;
+}
+
+unsigned int AssetDedupTable::releaseReference(std::uint64_t offset)
+{
+    const auto it = m_contents.find(offset);
+    if (it == m_contents.end()) return 0;
+    assert(it->second.m_refCount > 0);
+    if (--it->second.m_refCount > 0) return it->second.m_refCount;
+    const auto [begin, end] = m_hashIndex.equal_range(it->second.m_key.m_hash);
+    for (auto hash_it = begin; hash_it != end; ++hash_it)
+    {
+        if (hash_it->second != offset) continue;
+        m_hashIndex.erase(hash_it);
+        break;
+    }
+    m_contents.erase(it);
+    return 0;
+}
+
+void AssetDedupTable::updateContentOffset(std::uint64_t from_offset, std::uint64_t to_offset)
+{
+    if (from_offset == to_offset) return;
+    auto node = m_contents.extract(from_offset);
+    if (node.empty()) return;
+    const auto [begin, end] = m_hashIndex.equal_range(node.mapped().m_key.m_hash);
+    for (auto it = begin; it != end; ++it)
+    {
+        if (it->second == from_offset) it->second = to_offset;
+    }
+    node.key() = to_offset;
+    node.mapped().m_header.m_offset = to_offset;
+    m_contents.insert(std::move(node));
+}
+
+void AssetDedupTable::remapContentOffsets(const std::map<std::uint64_t, std::uint64_t>& offset_map)
+{
+    std::map<std::uint64_t, SharedContent> contents;
+    for (auto& [offset, content] : m_contents)
+    {
+        const auto it = offset_map.find(offset);
+        const std::uint64_t new_offset = it != offset_map.end() ? it->second : offset;
+        content.m_header.m_offset = new_offset;
+        contents.emplace(new_offset, std::move(content));
+    }
+    m_contents = std::move(contents);
+    m_hashIndex.clear();
+    for (const auto& [offset, content] : m_contents)
+    {
+        m_hashIndex.emplace(content.m_key.m_hash, offset);
+    }
+}
+
+void AssetDedupTable::clear()
+{
+    m_contents.clear();
+    m_hashIndex.clear();
+}
+
+std::uint64_t AssetDedupTable::getSavedBytes() const
+{
+    std::uint64_t saved_bytes = 0;
+    for (const auto& [offset, content] : m_contents)
+    {
+        if (content.m_isSolidBlock) continue;
+        saved_bytes += content.m_header.m_size * (content.m_refCount - 1);
+    }
+    return saved_bytes;
+}
+
+std::vector<char> AssetDedupTable::exportToByteBuffer() const
+{
+    std::vector<char> buff;
+    buff.resize(m_contents.size() * DEDUP_ATTRIBUTE_SIZE, 0);
+    size_t index = 0;
+    for (const auto& [offset, content] : m_contents)
+    {
+        std::memcpy(&buff[index], &offset, sizeof(std::uint64_t));
+        index += sizeof(std::uint64_t);
+        std::memcpy(&buff[index], &content.m_key.m_hash, sizeof(std::uint64_t));
+        index += sizeof(std::uint64_t);
+        std::memcpy(&buff[index], &content.m_key.m_orgSize, sizeof(std::uint64_t));
+        index += sizeof(std::uint64_t);
+        std::memcpy(&buff[index], &content.m_key.m_rawCrc, sizeof(unsigned int));
+        index += sizeof(unsigned int) * 2;
+    }
+    return buff;
+}
+
+error AssetDedupTable::importFromByteBuffer(const std::vector<char>& buff)
+{
+    if (buff.size() % DEDUP_ATTRIBUTE_SIZE != 0) return ErrorCode::invalidHeaderData;
+    clear();
+    size_t index = 0;
+    while (index < buff.size())
+    {
+        std::uint64_t offset = 0;
+        ContentKey key{ 0, 0, 0 };
+        std::memcpy(&offset, &buff[index], sizeof(std::uint64_t));
+        index += sizeof(std::uint64_t);
+        std::memcpy(&key.m_hash, &buff[index], sizeof(std::uint64_t));
+        index += sizeof(std::uint64_t);
+        std::memcpy(&key.m_orgSize, &buff[index], sizeof(std::uint64_t));
+        index += sizeof(std::uint64_t);
+        std::memcpy(&key.m_rawCrc, &buff[index], sizeof(unsigned int));
+        index += sizeof(unsigned int) * 2;
+        SharedContent content{ key, AssetHeaderData{}, 0, false };
+        content.m_header.m_offset = offset;
+        m_contents.emplace(offset, content);
+        m_hashIndex.emplace(key.m_hash, offset);
+    }
+    return ErrorCode::ok;
+}
+
+void AssetDedupTable::rebuildReferences(const std::vector<AssetHeaderData>& headers)
+{
+    for (const auto& header : headers)
+    {
+        const auto it = m_contents.find(header.m_offset);
+        if (it == m_contents.end()) continue;
+        if (it->second.m_refCount == 0)
+        {
+            it->second.m_header = makeSharedHeader(header);
+        }
+        if (header.isSolidMember()) it->second.m_isSolidBlock = true;
+        it->second.m_refCount++;
+    }
+    // 沒有 header 參照的內容 (表跟 header 不一致) 不能再共用
+    for (auto it = m_contents.begin(); it != m_contents.end();)
+    {
+        if (it->second.m_refCount > 0)
+        {
+            ++it;
+            continue;
+        }
+        const auto [begin, end] = m_hashIndex.equal_range(it->second.m_key.m_hash);
+        for (auto hash_it = begin; hash_it != end; ++hash_it)
+        {
+            if (hash_it->second != it->first) continue;
+            m_hashIndex.erase(hash_it);
+            break;
+        }
+        it = m_contents.erase(it);
+    }
+}
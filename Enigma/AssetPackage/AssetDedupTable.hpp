@@ -0,0 +1,84 @@
+﻿/*****************************************************************
+ * \file   AssetDedupTable.hpp
+ * \brief  bundle 內容的去重複表, 相同原始內容的 asset 共用同一段 bundle, 以 reference count 管理
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_DEDUP_TABLE_HPP
+#define ASSET_DEDUP_TABLE_HPP
+
+#include "AssetHeaderDataMap.hpp"
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <optional>
+#include <system_error>
+#include <vector>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class AssetDedupTable
+    {
+    public:
+        /** 原始內容的識別: 64 bits hash + 原始大小 + 原始內容的 crc32, 三個都相同才當作相同內容 */
+        struct ContentKey
+        {
+            std::uint64_t m_hash;
+            std::uint64_t m_orgSize;
+            unsigned int m_rawCrc;
+            [[nodiscard]] bool operator==(const ContentKey& other) const
+            {
+                return (m_hash == other.m_hash) && (m_orgSize == other.m_orgSize) && (m_rawCrc == other.m_rawCrc);
+            }
+        };
+        /** 共用的 bundle 內容, 欄位跟 header 相同 (名稱, 版本除外);
+         * solid block 也登記成共用內容, m_header 是整個 block 當成一個 asset 的 header, reference count 是成員數 */
+        struct SharedContent
+        {
+            ContentKey m_key;
+            AssetHeaderDataMap::AssetHeaderData m_header;
+            unsigned int m_refCount;
+            bool m_isSolidBlock;
+        };
+    public:
+        AssetDedupTable();
+        AssetDedupTable(const AssetDedupTable&) = delete;
+        AssetDedupTable(AssetDedupTable&&) = delete;
+        ~AssetDedupTable() noexcept;
+
+        AssetDedupTable& operator=(const AssetDedupTable&) = delete;
+        AssetDedupTable& operator=(AssetDedupTable&&) = delete;
+
+        [[nodiscard]] static ContentKey computeContentKey(const char* data, size_t size);
+
+        /** 相同內容可能以不同的 codec 寫入好幾份, is_usable 回傳 false 的略過; is_usable 是空的時不限制 */
+        [[nodiscard]] std::optional<SharedContent> tryFindContent(const ContentKey& key, const std::function<bool(const SharedContent&)>& is_usable = nullptr) const;
+        /** 新寫入 bundle 的內容, reference count 為 1; header 是 solid block 成員時, key 是整個 block 解壓後內容的 key */
+        void insertContent(const ContentKey& key, const AssetHeaderDataMap::AssetHeaderData& header);
+        error addReference(std::uint64_t offset);
+        /** 回傳剩下的 reference 數, 0 表示 bundle 空間可以釋放; 不在表內的內容 (沒有去重複的 asset) 也回傳 0 */
+        unsigned int releaseReference(std::uint64_t offset);
+        void updateContentOffset(std::uint64_t from_offset, std::uint64_t to_offset);
+        /** 一次換掉所有內容的 offset (舊 offset -> 新 offset), 重新排列 bundle 時新舊 offset 會互相重疊, 不能一筆一筆改 */
+        void remapContentOffsets(const std::map<std::uint64_t, std::uint64_t>& offset_map);
+        void clear();
+
+        [[nodiscard]] size_t getContentCount() const { return m_contents.size(); }
+        /** 共用內容省下的 bundle bytes, solid block 的成員本來就共用 block, 不算在內 */
+        [[nodiscard]] std::uint64_t getSavedBytes() const;
+
+        /** 只存 offset 跟 content key, reference count 跟其他欄位在讀取後由 rebuildReferences 從 header 重建 */
+        [[nodiscard]] std::vector<char> exportToByteBuffer() const;
+        error importFromByteBuffer(const std::vector<char>& buff);
+        void rebuildReferences(const std::vector<AssetHeaderDataMap::AssetHeaderData>& headers);
+
+    private:
+        std::map<std::uint64_t, SharedContent> m_contents;  ///< bundle offset -> content
+        std::unordered_multimap<std::uint64_t, std::uint64_t> m_hashIndex;  ///< hash -> bundle offset
+    };
+}
+
+#endif // ASSET_DEDUP_TABLE_HPP
@@ -0,0 +1,125 @@
+﻿#include "AssetDictionaryTrainer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+using namespace AssetPackage;
+
+// 片段的分數用 8 bytes 的 gram 計算, gram 直接當 key, 不會有 hash 碰撞
+constexpr size_t GRAM_SIZE = sizeof(std::uint64_t);
+// 至少在兩個樣本出現的 gram 才對壓縮其他 asset 有幫助
+constexpr unsigned int MIN_GRAM_SAMPLE_COUNT = 2;
+
+struct GramFrequency
+{
+    unsigned int m_sampleCount = 0;  ///< 出現在幾個樣本, 同一個樣本只算一次
+    size_t m_lastSample = 0;
+};
+using GramFrequencyMap = std::unordered_map<std::uint64_t, GramFrequency>;
+
+struct Segment
+{
+    size_t m_sample = 0;
+    size_t m_begin = 0;
+    size_t m_length = 0;
+    std::uint64_t m_score = 0;
+};
+
+static std::uint64_t readGram(const char* data)
+{
+    std::uint64_t gram = 0;
+    std::memcpy(&gram, data, GRAM_SIZE);
+    return gram;
+}
+
+static unsigned int getGramScore(const GramFrequencyMap& frequencies, const char* data)
+{
+    const auto it = frequencies.find(readGram(data));
+    if ((it == frequencies.end()) || (it->second.m_sampleCount < MIN_GRAM_SAMPLE_COUNT)) return 0;
+    return it->second.m_sampleCount;
+}
+
+static Segment findBestSegment(const std::vector<std::vector<char>>& samples, size_t sample_begin, size_t sample_end,
+    const GramFrequencyMap& frequencies, size_t segment_size)
+{
+    Segment best;
+    for (size_t s = sample_begin; s < sample_end; s++)
+    {
+        const std::vector<char>& sample = samples[s];
+        if (sample.size() < GRAM_SIZE) continue;
+        const size_t window = std::min(segment_size, sample.size());
+        const size_t window_grams = window - GRAM_SIZE + 1;
+        // 片段分數 = 片段內所有 gram 的分數總和, 用滑動視窗計算
+        std::uint64_t score = 0;
+        for (size_t i = 0; i < window_grams; i++)
+        {
+            score += getGramScore(frequencies, sample.data() + i);
+        }
+        for (size_t begin = 0; ; begin++)
+        {
+            if (score > best.m_score) best = { s, begin, window, score };
+            if (begin + window >= sample.size()) break;
+            score -= getGramScore(frequencies, sample.data() + begin);
+            score += getGramScore(frequencies, sample.data() + begin + window_grams);
+        }
+    }
+    return best;
+}
+
+std::vector<char> AssetDictionaryTrainer::trainDictionary(const std::vector<std::vector<char>>& samples, size_t max_size, size_t segment_size)
+{
+    max_size = std::min(max_size, MAX_DICTIONARY_SIZE);
+    if ((max_size == 0) || (segment_size < GRAM_SIZE) || (samples.size() < MIN_GRAM_SAMPLE_COUNT)) return {};
+
+    GramFrequencyMap frequencies;
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        const std::vector<char>& sample = samples[s];
+        for (size_t i = 0; i + GRAM_SIZE <= sample.size(); i++)
+        {
+            GramFrequency& frequency = frequencies[readGram(sample.data() + i)];
+            if ((frequency.m_sampleCount > 0) && (frequency.m_lastSample == s)) continue;
+            frequency.m_sampleCount++;
+            frequency.m_lastSample = s;
+        }
+    }
+
+    // 樣本分成幾段, 每段各挑一個最好的片段, dictionary 才不會只有某一類 asset 的內容
+    const size_t epoch_count = std::max<size_t>(1, std::min(samples.size(), max_size / segment_size));
+    std::vector<Segment> picked_segments;
+    size_t dictionary_size = 0;
+    bool is_progress = true;
+    while ((dictionary_size < max_size) && (is_progress))
+    {
+        is_progress = false;
+        for (size_t epoch = 0; (epoch < epoch_count) && (dictionary_size < max_size); epoch++)
+        {
+            const size_t sample_begin = epoch * samples.size() / epoch_count;
+            const size_t sample_end = (epoch + 1) * samples.size() / epoch_count;
+            Segment segment = findBestSegment(samples, sample_begin, sample_end, frequencies, segment_size);
+            if (segment.m_score == 0) continue;
+            segment.m_length = std::min(segment.m_length, max_size - dictionary_size);
+            picked_segments.push_back(segment);
+            dictionary_size += segment.m_length;
+            is_progress = true;
+            // 已經放進 dictionary 的 gram 不再計分, 之後挑的片段才會是不同的內容
+            const char* data = samples[segment.m_sample].data() + segment.m_begin;
+            for (size_t i = 0; i + GRAM_SIZE <= segment.m_length; i++)
+            {
+                const auto it = frequencies.find(readGram(data + i));
+                if (it != frequencies.end()) it->second.m_sampleCount = 0;
+            }
+        }
+    }
+
+    // 先挑到的分數比較高, 放在最後面
+    std::vector<char> dictionary;
+    dictionary.reserve(dictionary_size);
+    for (auto it = picked_segments.rbegin(); it != picked_segments.rend(); ++it)
+    {
+        const char* data = samples[it->m_sample].data() + it->m_begin;
+        dictionary.insert(dictionary.end(), data, data + it->m_length);
+    }
+    return dictionary;
+}
@@ -0,0 +1,30 @@
+﻿/*****************************************************************
+ * \file   AssetDictionaryTrainer.hpp
+ * \brief  從小 asset 的樣本挑出常見片段, 組成 zlib 的 preset dictionary
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_DICTIONARY_TRAINER_HPP
+#define ASSET_DICTIONARY_TRAINER_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace AssetPackage
+{
+    class AssetDictionaryTrainer
+    {
+    public:
+        /** zlib 的 window 是 32K, dictionary 再長也只會用到最後 32K */
+        constexpr static size_t MAX_DICTIONARY_SIZE = 32 * 1024;
+        constexpr static size_t DEFAULT_SEGMENT_SIZE = 64;
+
+        /** 挑出在最多樣本裡出現的片段, 越常用的放越後面 (離被壓縮的內容越近, distance 越短);
+         * 樣本太少或沒有共同內容時回傳空的 dictionary */
+        [[nodiscard]] static std::vector<char> trainDictionary(const std::vector<std::vector<char>>& samples,
+            size_t max_size = MAX_DICTIONARY_SIZE, size_t segment_size = DEFAULT_SEGMENT_SIZE);
+    };
+}
+
+#endif // ASSET_DICTIONARY_TRAINER_HPP
@@ -0,0 +1,154 @@
+﻿#include "AssetFreeSpaceList.hpp"
+#include "AssetPackageErrors.hpp"
+#include "AssetPackageFormat.hpp"
+#include <cassert>
+#include <cstring>
+#include <iterator>
+
+using namespace AssetPackage;
+
+constexpr unsigned int FREE_SPACE_ATTRIBUTE_SIZE = sizeof(unsigned int) * 2;
+constexpr unsigned int WIDE_FREE_SPACE_ATTRIBUTE_SIZE = sizeof(std::uint64_t) * 2;
+
+AssetFreeSpaceList::AssetFreeSpaceList()
+{
+    m_freeSpaces.clear();
+}
+
+AssetFreeSpaceList::~AssetFreeSpaceList() noexcept
+{
+    m_freeSpaces.clear();
+}
+
+void AssetFreeSpaceList::releaseSpace(std::uint64_t offset, std::uint64_t size)
+{
+    if (size == 0) return;
+    auto next = m_freeSpaces.lower_bound(offset);
+    if (next != m_freeSpaces.begin())
+    {
+        auto prev = std::prev(next);
+        assert(prev->first + prev->second <= offset);
+        if (prev->first + prev->second == offset)
+        {
+            offset = prev->first;
+            size += prev->second;
+            m_freeSpaces.erase(prev);
+        }
+    }
+    if ((next != m_freeSpaces.end()) && (offset + size == next->first))
+    {
+        size += next->second;
+        m_freeSpaces.erase(next);
+    }
+    m_freeSpaces.emplace(offset, size);
+}
+
+std::optional<std::uint64_t> AssetFreeSpaceList::tryAllocateSpace(std::uint64_t size, std::uint64_t alignment)
+{
+    if (size == 0) return std::nullopt;
+    assert((alignment > 0) && ((alignment & (alignment - 1)) == 0));
+    auto best = m_freeSpaces.end();
+    std::uint64_t best_offset = 0;
+    for (auto iter = m_freeSpaces.begin(); iter != m_freeSpaces.end(); ++iter)
+    {
+        const std::uint64_t aligned_offset = (iter->first + alignment - 1) & ~(alignment - 1);
+        if (aligned_offset + size > iter->first + iter->second) continue;
+        if ((best == m_freeSpaces.end()) || (iter->second < best->second))
+        {
+            best = iter;
+            best_offset = aligned_offset;
+        }
+        if (best->second == size) break;
+    }
+    if (best == m_freeSpaces.end()) return std::nullopt;
+    reserveSpace(best_offset, size);
+    return best_offset;
+}
+
+void AssetFreeSpaceList::reserveSpace(std::uint64_t offset, std::uint64_t size)
+{
+    if (size == 0) return;
+    const auto next = m_freeSpaces.upper_bound(offset);
+    if (next == m_freeSpaces.begin()) return;
+    const auto space = std::prev(next);
+    const std::uint64_t space_offset = space->first;
+    const std::uint64_t space_end = space->first + space->second;
+    if (space_end < offset + size) return;
+    m_freeSpaces.erase(space);
+    if (offset > space_offset) m_freeSpaces.emplace(space_offset, offset - space_offset);
+    if (space_end > offset + size) m_freeSpaces.emplace(offset + size, space_end - offset - size);
+}
+
+std::uint64_t AssetFreeSpaceList::getTotalFreeBytes() const
+{
+    std::uint64_t sum = 0;
+    for (const auto& [offset, size] : m_freeSpaces)
+    {
+        sum += size;
+    }
+    return sum;
+}
+
+std::vector<char> AssetFreeSpaceList::exportToByteBuffer(unsigned int format_tag) const
+{
+    if (m_freeSpaces.empty()) return {};
+    const bool is_wide = format_tag >= PACKAGE_FORMAT_TAG_WIDE_OFFSET;
+
+    std::vector<char> buff;
+    buff.resize(m_freeSpaces.size() * (is_wide ? WIDE_FREE_SPACE_ATTRIBUTE_SIZE : FREE_SPACE_ATTRIBUTE_SIZE), 0);
+
+    size_t index = 0;
+    for (const auto& [offset, size] : m_freeSpaces)
+    {
+        if (is_wide)
+        {
+            std::memcpy(&buff[index], &offset, sizeof(std::uint64_t));
+            index += sizeof(std::uint64_t);
+            std::memcpy(&buff[index], &size, sizeof(std::uint64_t));
+            index += sizeof(std::uint64_t);
+            continue;
+        }
+        assert((offset <= UINT32_MAX) && (size <= UINT32_MAX));
+        const auto narrow_offset = static_cast<unsigned int>(offset);
+        const auto narrow_size = static_cast<unsigned int>(size);
+        std::memcpy(&buff[index], &narrow_offset, sizeof(unsigned int));
+        index += sizeof(unsigned int);
+        std::memcpy(&buff[index], &narrow_size, sizeof(unsigned int));
+        index += sizeof(unsigned int);
+    }
+    return buff;
+}
+
+error AssetFreeSpaceList::importFromByteBuffer(const std::vector<char>& buff, unsigned int format_tag)
+{
+    if (buff.empty()) return ErrorCode::emptyBuffer;
+    const bool is_wide = format_tag >= PACKAGE_FORMAT_TAG_WIDE_OFFSET;
+    if (buff.size() % (is_wide ? WIDE_FREE_SPACE_ATTRIBUTE_SIZE : FREE_SPACE_ATTRIBUTE_SIZE) != 0) return ErrorCode::invalidFreeSpaceList;
+    m_freeSpaces.clear();
+    size_t index = 0;
+    while (index < buff.size())
+    {
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+        if (is_wide)
+        {
+            std::memcpy(&offset, &buff[index], sizeof(std::uint64_t));
+            index += sizeof(std::uint64_t);
+            std::memcpy(&size, &buff[index], sizeof(std::uint64_t));
+            index += sizeof(std::uint64_t);
+        }
+        else
+        {
+            unsigned int narrow_offset = 0;
+            unsigned int narrow_size = 0;
+            std::memcpy(&narrow_offset, &buff[index], sizeof(unsigned int));
+            index += sizeof(unsigned int);
+            std::memcpy(&narrow_size, &buff[index], sizeof(unsigned int));
+            index += sizeof(unsigned int);
+            offset = narrow_offset;
+            size = narrow_size;
+        }
+        releaseSpace(offset, size);
+    }
+    return ErrorCode::ok;
+}
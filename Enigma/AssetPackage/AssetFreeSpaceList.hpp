@@ -0,0 +1,50 @@
+﻿/*****************************************************************
+ * \file   AssetFreeSpaceList.hpp
+ * \brief  bundle 內已移除 asset 留下的空間, 新加入的 asset 可以重複使用
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_FREE_SPACE_LIST_HPP
+#define ASSET_FREE_SPACE_LIST_HPP
+
+#include <map>
+#include <optional>
+#include <system_error>
+#include <vector>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class AssetFreeSpaceList
+    {
+    public:
+        AssetFreeSpaceList();
+        AssetFreeSpaceList(const AssetFreeSpaceList&) = delete;
+        AssetFreeSpaceList(AssetFreeSpaceList&&) = delete;
+        ~AssetFreeSpaceList() noexcept;
+
+        AssetFreeSpaceList& operator=(const AssetFreeSpaceList&) = delete;
+        AssetFreeSpaceList& operator=(AssetFreeSpaceList&&) = delete;
+
+        /** 釋放的空間會跟前後相鄰的空間合併 */
+        void releaseSpace(std::uint64_t offset, std::uint64_t size);
+        /** best fit, 剩下的部分留在 list 裡; alignment 是 2 的次方, 回傳的 offset 會對齊, 對齊前的部分也留在 list 裡 */
+        std::optional<std::uint64_t> tryAllocateSpace(std::uint64_t size, std::uint64_t alignment = 1);
+        /** 把指定範圍從 list 拿掉, replay journal 時重現當時配置的位置; 範圍不在 free space 內就不動 */
+        void reserveSpace(std::uint64_t offset, std::uint64_t size);
+        void clear() { m_freeSpaces.clear(); }
+
+        [[nodiscard]] size_t getSpaceCount() const { return m_freeSpaces.size(); }
+        [[nodiscard]] std::uint64_t getTotalFreeBytes() const;
+
+        [[nodiscard]] std::vector<char> exportToByteBuffer(unsigned int format_tag) const;
+        error importFromByteBuffer(const std::vector<char>& buff, unsigned int format_tag);
+
+    private:
+        std::map<std::uint64_t, std::uint64_t> m_freeSpaces;  ///< offset -> size
+    };
+}
+
+#endif // ASSET_FREE_SPACE_LIST_HPP
@@ -1,104 +1,245 @@
 ﻿#include "AssetHeaderDataMap.hpp"
 #include "AssetPackageErrors.hpp"
+#include "AssetPackageFormat.hpp"
 #include <cassert>
 #include <cstring>
+#include <algorithm>
+#include <functional>
+#include <utility>
 
 using namespace AssetPackage;
 
 constexpr unsigned int HEADER_ATTRIBUTE_SIZE = sizeof(unsigned int) * 5;
+constexpr unsigned int WIDE_HEADER_ATTRIBUTE_SIZE = sizeof(unsigned int) * 2 + sizeof(std::uint64_t) * 3;
+constexpr size_t MIN_SLOT_COUNT = 16;
+constexpr size_t MIN_ARENA_COMPACT_BYTES = 4096;
 
-AssetHeaderDataMap::AssetHeaderDataMap()
+static bool isWideOffsetFormat(unsigned int format_tag)
+{
+    return format_tag >= PACKAGE_FORMAT_TAG_WIDE_OFFSET;
+}
+
+// 舊格式的 offset, size 是 32 bits
+static void writeOffsetField(std::vector<char>& buff, size_t& index, std::uint64_t value, bool is_wide)
+{
+    if (is_wide)
+    {
+        std::memcpy(&buff[index], &value, sizeof(std::uint64_t));
+        index += sizeof(std::uint64_t);
+        return;
+    }
+    assert(value <= UINT32_MAX);
+    const auto narrow_value = static_cast<unsigned int>(value);
+    std::memcpy(&buff[index], &narrow_value, sizeof(unsigned int));
+    index += sizeof(unsigned int);
+}
+
+static std::uint64_t readOffsetField(const std::vector<char>& buff, size_t& index, bool is_wide)
+{
+    if (is_wide)
+    {
+        std::uint64_t value = 0;
+        std::memcpy(&value, &buff[index], sizeof(std::uint64_t));
+        index += sizeof(std::uint64_t);
+        return value;
+    }
+    unsigned int narrow_value = 0;
+    std::memcpy(&narrow_value, &buff[index], sizeof(unsigned int));
+    index += sizeof(unsigned int);
+    return narrow_value;
+}
+
+AssetHeaderDataMap::AssetHeaderDataMap() : m_removedNameBytes(0)
 {
-    m_headerDataMap.clear();
 }
 
 AssetHeaderDataMap::~AssetHeaderDataMap() noexcept
 {
-    m_headerDataMap.clear();
+    m_records.clear();
+    m_slots.clear();
 }
 
 error AssetHeaderDataMap::insertHeaderData(const AssetHeaderData& header)
 {
-    if (hasAssetKey(header.m_name)) return ErrorCode::duplicatedKey;
-    bool is_ok = false;
-    std::tie(std::ignore, is_ok) = m_headerDataMap.emplace(header.m_name, header);
-    assert(is_ok);
+    const std::uint64_t hash = std::hash<std::string_view>{}(header.m_name);
+    if ((!m_slots.empty()) && (m_slots[findSlot(header.m_name, hash)] != 0)) return ErrorCode::duplicatedKey;
+    // load factor 超過 0.7 就加倍
+    if ((m_records.size() + 1) * 10 > m_slots.size() * 7) rehashSlots(std::max(MIN_SLOT_COUNT, m_slots.size() * 2));
+    assert(m_nameArena.size() + header.m_name.length() <= UINT32_MAX);
+
+    HeaderRecord record{};
+    record.m_nameHash = hash;
+    record.m_nameOffset = static_cast<std::uint32_t>(m_nameArena.size());
+    record.m_nameLength = static_cast<std::uint32_t>(header.m_name.length());
+    record.m_version = header.m_version;
+    record.m_size = header.m_size;
+    record.m_orgSize = header.m_orgSize;
+    record.m_offset = header.m_offset;
+    record.m_crc = header.m_crc;
+    record.m_codec = header.m_codec;
+    record.m_blockSize = header.m_blockSize;
+    record.m_hasCrc = header.m_hasCrc;
+    record.m_solidOffset = header.m_solidOffset;
+    record.m_solidBlockSize = header.m_solidBlockSize;
+    m_nameArena.insert(m_nameArena.end(), header.m_name.begin(), header.m_name.end());
+    m_records.push_back(record);
+    m_slots[findSlot(header.m_name, hash)] = static_cast<std::uint32_t>(m_records.size());
     return ErrorCode::ok;
 }
 
-error AssetHeaderDataMap::removeHeaderData(const std::string& name)
+error AssetHeaderDataMap::removeHeaderData(std::string_view name)
 {
-    if (!hasAssetKey(name)) return ErrorCode::notExistedKey;
-    m_headerDataMap.erase(name);
+    if (m_slots.empty()) return ErrorCode::notExistedKey;
+    const size_t slot_mask = m_slots.size() - 1;
+    size_t hole = findSlot(name, std::hash<std::string_view>{}(name));
+    if (m_slots[hole] == 0) return ErrorCode::notExistedKey;
+    const std::uint32_t record_index = m_slots[hole] - 1;
+    m_removedNameBytes += m_records[record_index].m_nameLength;
+
+    // backward shift deletion : 後面同一串探測的 slot 往前補, 不用留 tombstone
+    for (size_t next = (hole + 1) & slot_mask; m_slots[next] != 0; next = (next + 1) & slot_mask)
+    {
+        const size_t home = static_cast<size_t>(m_records[m_slots[next] - 1].m_nameHash) & slot_mask;
+        if (((next - home) & slot_mask) < ((next - hole) & slot_mask)) continue;
+        m_slots[hole] = m_slots[next];
+        hole = next;
+    }
+    m_slots[hole] = 0;
+
+    // 最後一筆 record 搬到空出來的位置, record 保持連續
+    const auto last_index = static_cast<std::uint32_t>(m_records.size() - 1);
+    if (record_index != last_index)
+    {
+        m_slots[findRecordSlot(last_index)] = record_index + 1;
+        m_records[record_index] = m_records[last_index];
+    }
+    m_records.pop_back();
+    if ((m_removedNameBytes > MIN_ARENA_COMPACT_BYTES) && (m_removedNameBytes * 2 > m_nameArena.size())) compactNameArena();
     return ErrorCode::ok;
 }
 
-bool AssetHeaderDataMap::hasAssetKey(const std::string& name) const
+void AssetHeaderDataMap::reserve(size_t count)
+{
+    m_records.reserve(count);
+    size_t slot_count = MIN_SLOT_COUNT;
+    while (count * 10 > slot_count * 7) slot_count *= 2;
+    if (slot_count > m_slots.size()) rehashSlots(slot_count);
+}
+
+bool AssetHeaderDataMap::hasAssetKey(std::string_view name) const
+{
+    if (m_slots.empty()) return false;
+    return m_slots[findSlot(name, std::hash<std::string_view>{}(name))] != 0;
+}
+
+error AssetHeaderDataMap::updateContentOffset(std::string_view name, std::uint64_t offset)
+{
+    if (m_slots.empty()) return ErrorCode::notExistedKey;
+    const std::uint32_t slot_value = m_slots[findSlot(name, std::hash<std::string_view>{}(name))];
+    if (slot_value == 0) return ErrorCode::notExistedKey;
+    m_records[slot_value - 1].m_offset = offset;
+    return ErrorCode::ok;
+}
+
+std::vector<AssetHeaderDataMap::AssetHeaderData> AssetHeaderDataMap::getHeaderDataOrderByOffset() const
+{
+    std::vector<AssetHeaderData> headers;
+    headers.reserve(m_records.size());
+    for (const auto& record : m_records)
+    {
+        headers.push_back(makeHeaderData(record));
+    }
+    std::sort(headers.begin(), headers.end(), [](const AssetHeaderData& lhs, const AssetHeaderData& rhs) { return lhs.m_offset < rhs.m_offset; });
+    return headers;
+}
+
+std::vector<AssetHeaderDataMap::AssetHeaderData> AssetHeaderDataMap::getHeaderDataOrderByName() const
 {
-    const auto find_iter = m_headerDataMap.find(name);
-    return (find_iter != m_headerDataMap.end());
+    // 先排 record 的順序, 名稱直接在 arena 上比較, 最後才複製成 header
+    std::vector<const HeaderRecord*> sorted_records;
+    sorted_records.reserve(m_records.size());
+    for (const auto& record : m_records)
+    {
+        sorted_records.push_back(&record);
+    }
+    std::sort(sorted_records.begin(), sorted_records.end(), [this](const HeaderRecord* lhs, const HeaderRecord* rhs) { return getRecordName(*lhs) < getRecordName(*rhs); });
+    std::vector<AssetHeaderData> headers;
+    headers.reserve(sorted_records.size());
+    for (const HeaderRecord* record : sorted_records)
+    {
+        headers.push_back(makeHeaderData(*record));
+    }
+    return headers;
 }
 
-void AssetHeaderDataMap::repackContentOffsets(const unsigned content_size, const unsigned base_offset)
+std::vector<std::string> AssetHeaderDataMap::getAssetNames() const
 {
-    for (auto& [name, header] : m_headerDataMap)
+    std::vector<std::string> names;
+    names.reserve(m_records.size());
+    for (const auto& record : m_records)
     {
-        if (header.m_offset >= base_offset)
-        {
-            header.m_offset -= content_size;
-        }
+        names.emplace_back(getRecordName(record));
     }
+    return names;
 }
 
-std::optional<AssetHeaderDataMap::AssetHeaderData> AssetHeaderDataMap::tryGetHeaderData(const std::string& name)
+std::optional<AssetHeaderDataMap::AssetHeaderData> AssetHeaderDataMap::tryGetHeaderData(std::string_view name) const
 {
-    if (const auto find_iter = m_headerDataMap.find(name); find_iter != m_headerDataMap.end()) return find_iter->second;
-    return std::nullopt;
+    if (m_slots.empty()) return std::nullopt;
+    const std::uint32_t slot_value = m_slots[findSlot(name, std::hash<std::string_view>{}(name))];
+    if (slot_value == 0) return std::nullopt;
+    return makeHeaderData(m_records[slot_value - 1]);
 }
 
-size_t AssetHeaderDataMap::calcHeaderDataMapBytes() const
+size_t AssetHeaderDataMap::calcHeaderDataMapBytes(unsigned int format_tag) const
 {
     size_t sum = 0;
-    for (const auto& [name, header] : m_headerDataMap)
+    for (const auto& record : m_records)
     {
-        sum += (name.length() + 1); // name 的長度加起來
+        sum += (record.m_nameLength + 1); // name 的長度加起來
     }
-    sum += (getTotalDataCount() * HEADER_ATTRIBUTE_SIZE);  // 5個uint * 總數量
+    // 每筆的屬性欄位 * 總數量
+    sum += (getTotalDataCount() * (isWideOffsetFormat(format_tag) ? WIDE_HEADER_ATTRIBUTE_SIZE : HEADER_ATTRIBUTE_SIZE));
     return sum;
 }
 
-std::vector<char> AssetHeaderDataMap::exportToByteBuffer() const
+std::vector<char> AssetHeaderDataMap::exportToByteBuffer(unsigned int format_tag) const
 {
-    const size_t size = calcHeaderDataMapBytes();
+    const size_t size = calcHeaderDataMapBytes(format_tag);
     if (size == 0) return {};
+    const bool is_wide = isWideOffsetFormat(format_tag);
+    const size_t attribute_size = is_wide ? WIDE_HEADER_ATTRIBUTE_SIZE : HEADER_ATTRIBUTE_SIZE;
 
     std::vector<char> buff;
     buff.resize(size, 0);
 
     size_t index = 0;
-    for (const auto& [name, header] : m_headerDataMap)
+    for (const auto& record : m_records)
     {
-        assert(index + header.m_name.length() + 1 + HEADER_ATTRIBUTE_SIZE <= size);
+        const AssetHeaderData header = makeHeaderData(record);
+        assert(index + header.m_name.length() + 1 + attribute_size <= size);
         std::memcpy(&buff[index], header.m_name.c_str(), header.m_name.length());
         index += (header.m_name.length() + 1);
         std::memcpy(&buff[index], &(header.m_version), sizeof(unsigned int));
         index += sizeof(unsigned int);
-        std::memcpy(&buff[index], &(header.m_size), sizeof(unsigned int));
-        index += sizeof(unsigned int);
-        std::memcpy(&buff[index], &(header.m_orgSize), sizeof(unsigned int));
-        index += sizeof(unsigned int);
-        std::memcpy(&buff[index], &(header.m_offset), sizeof(unsigned int));
-        index += sizeof(unsigned int);
+        writeOffsetField(buff, index, header.m_size, is_wide);
+        writeOffsetField(buff, index, header.m_orgSize, is_wide);
+        writeOffsetField(buff, index, header.m_offset, is_wide);
         std::memcpy(&buff[index], &(header.m_crc), sizeof(unsigned int));
         index += sizeof(unsigned int);
     }
     return buff;
 }
 
-std::error_code AssetHeaderDataMap::importFromByteBuffer(const std::vector<char>& buff)
+std::error_code AssetHeaderDataMap::importFromByteBuffer(const std::vector<char>& buff, unsigned int format_tag)
 {
     if (buff.empty()) return ErrorCode::emptyBuffer;
-    m_headerDataMap.clear();
+    m_nameArena.clear();
+    m_removedNameBytes = 0;
+    m_records.clear();
+    m_slots.clear();
+    const bool is_wide = isWideOffsetFormat(format_tag);
+    const size_t attribute_size = is_wide ? WIDE_HEADER_ATTRIBUTE_SIZE : HEADER_ATTRIBUTE_SIZE;
     const size_t size = buff.size();
     size_t index = 0;
     while (index < size)
@@ -106,14 +247,12 @@ std::error_code AssetHeaderDataMap::importFromByteBuffer(const std::vector<char>
         AssetHeaderData header{};
         header.m_name = std::string{ &buff[index] };
         index += (header.m_name.length() + 1);
+        if (index + attribute_size > size) return ErrorCode::invalidHeaderData;
         std::memcpy(&header.m_version, &buff[index], sizeof(unsigned int));
         index += sizeof(unsigned int);
-        std::memcpy(&header.m_size, &buff[index], sizeof(unsigned int));
-        index += sizeof(unsigned int);
-        std::memcpy(&header.m_orgSize, &buff[index], sizeof(unsigned int));
-        index += sizeof(unsigned int);
-        std::memcpy(&header.m_offset, &buff[index], sizeof(unsigned int));
-        index += sizeof(unsigned int);
+        header.m_size = readOffsetField(buff, index, is_wide);
+        header.m_orgSize = readOffsetField(buff, index, is_wide);
+        header.m_offset = readOffsetField(buff, index, is_wide);
         std::memcpy(&header.m_crc, &buff[index], sizeof(unsigned int));
         index += sizeof(unsigned int);
 
@@ -122,3 +261,78 @@ std::error_code AssetHeaderDataMap::importFromByteBuffer(const std::vector<char>
     return ErrorCode::ok;
 }
 
+std::string_view AssetHeaderDataMap::getRecordName(const HeaderRecord& record) const
+{
+    return { m_nameArena.data() + record.m_nameOffset, record.m_nameLength };
+}
+
+AssetHeaderDataMap::AssetHeaderData AssetHeaderDataMap::makeHeaderData(const HeaderRecord& record) const
+{
+    AssetHeaderData header;
+    header.m_name = std::string{ getRecordName(record) };
+    header.m_version = record.m_version;
+    header.m_size = record.m_size;
+    header.m_orgSize = record.m_orgSize;
+    header.m_offset = record.m_offset;
+    header.m_crc = record.m_crc;
+    header.m_codec = record.m_codec;
+    header.m_blockSize = record.m_blockSize;
+    header.m_hasCrc = record.m_hasCrc;
+    header.m_solidOffset = record.m_solidOffset;
+    header.m_solidBlockSize = record.m_solidBlockSize;
+    return header;
+}
+
+size_t AssetHeaderDataMap::findSlot(std::string_view name, std::uint64_t hash) const
+{
+    assert(!m_slots.empty());
+    const size_t slot_mask = m_slots.size() - 1;
+    size_t slot = static_cast<size_t>(hash) & slot_mask;
+    while (m_slots[slot] != 0)
+    {
+        // 先比 hash, 相同才比較名稱
+        const HeaderRecord& record = m_records[m_slots[slot] - 1];
+        if ((record.m_nameHash == hash) && (getRecordName(record) == name)) return slot;
+        slot = (slot + 1) & slot_mask;
+    }
+    return slot;
+}
+
+size_t AssetHeaderDataMap::findRecordSlot(std::uint32_t record_index) const
+{
+    const size_t slot_mask = m_slots.size() - 1;
+    size_t slot = static_cast<size_t>(m_records[record_index].m_nameHash) & slot_mask;
+    while (m_slots[slot] != record_index + 1)
+    {
+        assert(m_slots[slot] != 0);
+        slot = (slot + 1) & slot_mask;
+    }
+    return slot;
+}
+
+void AssetHeaderDataMap::rehashSlots(size_t slot_count)
+{
+    assert((slot_count & (slot_count - 1)) == 0);
+    m_slots.assign(slot_count, 0);
+    const size_t slot_mask = slot_count - 1;
+    for (size_t i = 0; i < m_records.size(); i++)
+    {
+        size_t slot = static_cast<size_t>(m_records[i].m_nameHash) & slot_mask;
+        while (m_slots[slot] != 0) slot = (slot + 1) & slot_mask;
+        m_slots[slot] = static_cast<std::uint32_t>(i + 1);
+    }
+}
+
+void AssetHeaderDataMap::compactNameArena()
+{
+    std::vector<char> name_arena;
+    name_arena.reserve(m_nameArena.size() - m_removedNameBytes);
+    for (auto& record : m_records)
+    {
+        const auto name_offset = static_cast<std::uint32_t>(name_arena.size());
+        name_arena.insert(name_arena.end(), m_nameArena.begin() + record.m_nameOffset, m_nameArena.begin() + record.m_nameOffset + record.m_nameLength);
+        record.m_nameOffset = name_offset;
+    }
+    m_nameArena = std::move(name_arena);
+    m_removedNameBytes = 0;
+}
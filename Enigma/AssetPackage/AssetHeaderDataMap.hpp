@@ -8,11 +8,13 @@
 #ifndef ASSET_HEADER_DATA_MAP_HPP
 #define ASSET_HEADER_DATA_MAP_HPP
 
+#include "AssetCodec.hpp"
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <optional>
 #include <system_error>
 #include <vector>
+#include <cstdint>
 
 namespace AssetPackage
 {
@@ -24,11 +26,19 @@ namespace AssetPackage
         {
             std::string m_name;
             unsigned int m_version;
-            unsigned int m_size;
-            unsigned int m_orgSize;
-            unsigned int m_offset;
+            std::uint64_t m_size;
+            std::uint64_t m_orgSize;
+            std::uint64_t m_offset;
             unsigned int m_crc;
-            AssetHeaderData() : m_version(0), m_size(0), m_orgSize(0), m_offset(0), m_crc(0) {};
+            AssetCodecId m_codec;
+            unsigned int m_blockSize;  ///< seekable 格式的 block 大小, 0 表示整個 asset 一起壓縮
+            bool m_hasCrc;  ///< 0x06 之前寫入的 asset 沒有算 crc, m_crc 不能用
+            /** solid block 的成員: m_offset, m_size, m_codec, m_crc 是整個 block 的 (block 以 bundle offset 識別),
+             * asset 內容在 block 解壓後的 m_solidOffset 位置, 長度 m_orgSize */
+            std::uint64_t m_solidOffset;
+            std::uint64_t m_solidBlockSize;  ///< block 解壓後的大小, 0 表示不是 solid block 的成員
+            AssetHeaderData() : m_version(0), m_size(0), m_orgSize(0), m_offset(0), m_crc(0), m_codec(AssetCodecId::zlib), m_blockSize(0), m_hasCrc(false), m_solidOffset(0), m_solidBlockSize(0) {};
+            [[nodiscard]] bool isSolidMember() const { return m_solidBlockSize > 0; }
         };
     public:
         AssetHeaderDataMap();
@@ -40,23 +50,61 @@ namespace AssetPackage
         AssetHeaderDataMap& operator=(AssetHeaderDataMap&&) = delete;
 
         error insertHeaderData(const AssetHeaderData& header);
-        error removeHeaderData(const std::string& name);
+        error removeHeaderData(std::string_view name);
+        /** 預先配置 record 跟 slot, 開檔時一次匯入大量 header 不用一直 rehash */
+        void reserve(size_t count);
 
-        [[nodiscard]] bool hasAssetKey(const std::string& name) const;
+        [[nodiscard]] bool hasAssetKey(std::string_view name) const;
 
-        void repackContentOffsets(unsigned content_size, unsigned base_offset);
+        error updateContentOffset(std::string_view name, std::uint64_t offset);
+        /** 依 bundle offset 排序的 header, compact 時依序搬移內容用 */
+        [[nodiscard]] std::vector<AssetHeaderData> getHeaderDataOrderByOffset() const;
+        /** 依名稱排序的 header, 輸出 index 區段用 */
+        [[nodiscard]] std::vector<AssetHeaderData> getHeaderDataOrderByName() const;
+        [[nodiscard]] std::vector<std::string> getAssetNames() const;
 
-        std::optional<AssetHeaderData> tryGetHeaderData(const std::string& name);
+        [[nodiscard]] std::optional<AssetHeaderData> tryGetHeaderData(std::string_view name) const;
 
-        [[nodiscard]] size_t calcHeaderDataMapBytes() const;
+        [[nodiscard]] size_t calcHeaderDataMapBytes(unsigned int format_tag) const;
 
-        [[nodiscard]] size_t getTotalDataCount() const { return m_headerDataMap.size(); };
+        [[nodiscard]] size_t getTotalDataCount() const { return m_records.size(); };
 
-        [[nodiscard]] std::vector<char> exportToByteBuffer() const;
-        [[nodiscard]] std::error_code importFromByteBuffer(const std::vector<char>& buff);
+        /** format_tag 決定 offset, size 欄位寫成 32 或 64 bits */
+        [[nodiscard]] std::vector<char> exportToByteBuffer(unsigned int format_tag) const;
+        [[nodiscard]] std::error_code importFromByteBuffer(const std::vector<char>& buff, unsigned int format_tag);
 
     private:
-        std::unordered_map<std::string, AssetHeaderData> m_headerDataMap;
+        /** 固定大小的 record, 名稱存在 m_nameArena, 不另外配置字串 */
+        struct HeaderRecord
+        {
+            std::uint64_t m_nameHash;
+            std::uint64_t m_size;
+            std::uint64_t m_orgSize;
+            std::uint64_t m_offset;
+            std::uint64_t m_solidOffset;
+            std::uint64_t m_solidBlockSize;
+            std::uint32_t m_nameOffset;
+            std::uint32_t m_nameLength;
+            unsigned int m_version;
+            unsigned int m_crc;
+            unsigned int m_blockSize;
+            AssetCodecId m_codec;
+            bool m_hasCrc;
+        };
+
+        [[nodiscard]] std::string_view getRecordName(const HeaderRecord& record) const;
+        [[nodiscard]] AssetHeaderData makeHeaderData(const HeaderRecord& record) const;
+        /** 回傳 name 所在的 slot, 沒有的話回傳探測結束的空 slot */
+        [[nodiscard]] size_t findSlot(std::string_view name, std::uint64_t hash) const;
+        [[nodiscard]] size_t findRecordSlot(std::uint32_t record_index) const;
+        void rehashSlots(size_t slot_count);
+        void compactNameArena();
+
+    private:
+        std::vector<char> m_nameArena;
+        size_t m_removedNameBytes;  ///< arena 內已移除的名稱, 超過一半時重新整理
+        std::vector<HeaderRecord> m_records;
+        std::vector<std::uint32_t> m_slots;  ///< open addressing (linear probing), 存 record index + 1, 0 表示空的
     };
 };
 
@@ -0,0 +1,204 @@
+﻿#include "AssetHeaderIndex.hpp"
+#include "AssetPackageErrors.hpp"
+#include "AssetPackageFormat.hpp"
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+using namespace AssetPackage;
+
+using AssetHeaderData = AssetHeaderDataMap::AssetHeaderData;
+
+// record 的欄位順序 : name offset, name length, version, crc, codec, block size, size, org size, offset, solid offset, solid block size
+// 前六個是 32 bits, 後五個是 64 bits, 所以 record table 從 8 bytes 對齊的位置開始時, 64 bits 欄位也是對齊的
+// 0x04 格式的 record 沒有 codec, block size 兩個欄位, 0x0A 之前的 record 沒有最後兩個 solid block 欄位
+// codec 欄位的低 16 bits 是 codec id, 高 16 bits 是 flag (0x06 之後)
+constexpr unsigned int RECORD_CODEC_MASK = 0xffffU;
+constexpr unsigned int RECORD_FLAG_SHIFT = 16;
+constexpr unsigned int RECORD_FLAG_HAS_CRC = 0x01U;
+
+struct IndexRecord
+{
+    unsigned int m_nameOffset;
+    unsigned int m_nameLength;
+    unsigned int m_version;
+    unsigned int m_crc;
+    unsigned int m_codec;
+    unsigned int m_blockSize;
+    std::uint64_t m_size;
+    std::uint64_t m_orgSize;
+    std::uint64_t m_offset;
+    std::uint64_t m_solidOffset;
+    std::uint64_t m_solidBlockSize;
+};
+static_assert(sizeof(IndexRecord) == AssetHeaderIndex::RECORD_SIZE);
+
+static IndexRecord readRecord(const char* records, size_t record_size, size_t record_index)
+{
+    // 用 memcpy 讀, 不依賴 mapping 內容的對齊
+    IndexRecord record{};
+    const char* src = records + record_index * record_size;
+    if (record_size == AssetHeaderIndex::SORTED_INDEX_RECORD_SIZE)
+    {
+        constexpr size_t name_fields_size = sizeof(unsigned int) * 4;
+        std::memcpy(&record, src, name_fields_size);
+        std::memcpy(&record.m_size, src + name_fields_size, sizeof(std::uint64_t) * 3);
+        record.m_codec = static_cast<unsigned int>(AssetCodecId::zlib);
+        return record;
+    }
+    std::memcpy(&record, src, record_size);
+    return record;
+}
+
+AssetHeaderIndex::AssetHeaderIndex() : m_data(nullptr), m_descriptor{ 0, 0 }, m_recordSize(RECORD_SIZE), m_records(nullptr), m_stringPool(nullptr)
+{
+}
+
+size_t AssetHeaderIndex::getRecordSize(unsigned int format_tag)
+{
+    if (format_tag < PACKAGE_FORMAT_TAG_CODEC) return SORTED_INDEX_RECORD_SIZE;
+    if (format_tag < PACKAGE_FORMAT_TAG_SOLID_BLOCK) return CODEC_RECORD_SIZE;
+    return RECORD_SIZE;
+}
+
+AssetHeaderIndex::~AssetHeaderIndex() noexcept
+{
+    detachIndexData();
+}
+
+std::vector<char> AssetHeaderIndex::exportFromHeaderDataMap(const AssetHeaderDataMap& header_map)
+{
+    std::vector<AssetHeaderData> headers = header_map.getHeaderDataOrderByName();
+    size_t string_pool_bytes = 0;
+    for (const auto& header : headers)
+    {
+        string_pool_bytes += header.m_name.length();
+    }
+    const IndexDescriptor descriptor{ headers.size(), string_pool_bytes };
+    std::vector<char> buff;
+    buff.resize(DESCRIPTOR_SIZE + headers.size() * RECORD_SIZE + string_pool_bytes, 0);
+    std::memcpy(buff.data(), &descriptor.m_recordCount, sizeof(std::uint64_t));
+    std::memcpy(buff.data() + sizeof(std::uint64_t), &descriptor.m_stringPoolBytes, sizeof(std::uint64_t));
+
+    char* records = buff.data() + DESCRIPTOR_SIZE;
+    char* string_pool = records + headers.size() * RECORD_SIZE;
+    unsigned int name_offset = 0;
+    for (size_t i = 0; i < headers.size(); i++)
+    {
+        const AssetHeaderData& header = headers[i];
+        IndexRecord record{};
+        record.m_nameOffset = name_offset;
+        record.m_nameLength = static_cast<unsigned int>(header.m_name.length());
+        record.m_version = header.m_version;
+        record.m_crc = header.m_crc;
+        record.m_codec = static_cast<unsigned int>(header.m_codec) | ((header.m_hasCrc ? RECORD_FLAG_HAS_CRC : 0U) << RECORD_FLAG_SHIFT);
+        record.m_blockSize = header.m_blockSize;
+        record.m_size = header.m_size;
+        record.m_orgSize = header.m_orgSize;
+        record.m_offset = header.m_offset;
+        record.m_solidOffset = header.m_solidOffset;
+        record.m_solidBlockSize = header.m_solidBlockSize;
+        std::memcpy(records + i * RECORD_SIZE, &record, RECORD_SIZE);
+        std::memcpy(string_pool + name_offset, header.m_name.data(), header.m_name.length());
+        name_offset += record.m_nameLength;
+    }
+    return buff;
+}
+
+error AssetHeaderIndex::attachIndexData(const char* data, size_t size, unsigned int format_tag)
+{
+    detachIndexData();
+    if ((data == nullptr) || (size < DESCRIPTOR_SIZE)) return ErrorCode::invalidHeaderData;
+    const size_t record_size = getRecordSize(format_tag);
+    IndexDescriptor descriptor{};
+    std::memcpy(&descriptor.m_recordCount, data, sizeof(std::uint64_t));
+    std::memcpy(&descriptor.m_stringPoolBytes, data + sizeof(std::uint64_t), sizeof(std::uint64_t));
+    if ((descriptor.m_recordCount > (size - DESCRIPTOR_SIZE) / record_size)
+        || (descriptor.m_stringPoolBytes > size - DESCRIPTOR_SIZE - descriptor.m_recordCount * record_size))
+    {
+        return ErrorCode::invalidHeaderData;
+    }
+    m_data = data;
+    m_descriptor = descriptor;
+    m_recordSize = record_size;
+    m_records = data + DESCRIPTOR_SIZE;
+    m_stringPool = m_records + m_descriptor.m_recordCount * m_recordSize;
+    return ErrorCode::ok;
+}
+
+void AssetHeaderIndex::detachIndexData()
+{
+    m_data = nullptr;
+    m_descriptor = { 0, 0 };
+    m_records = nullptr;
+    m_stringPool = nullptr;
+}
+
+size_t AssetHeaderIndex::getIndexDataBytes() const
+{
+    return static_cast<size_t>(DESCRIPTOR_SIZE + m_descriptor.m_recordCount * m_recordSize + m_descriptor.m_stringPoolBytes);
+}
+
+std::string_view AssetHeaderIndex::getRecordName(size_t record_index) const
+{
+    if (record_index >= getRecordCount()) return {};
+    const IndexRecord record = readRecord(m_records, m_recordSize, record_index);
+    if (static_cast<std::uint64_t>(record.m_nameOffset) + record.m_nameLength > m_descriptor.m_stringPoolBytes) return {};
+    return { m_stringPool + record.m_nameOffset, record.m_nameLength };
+}
+
+std::optional<AssetHeaderData> AssetHeaderIndex::tryFindHeaderData(std::string_view name) const
+{
+    if ((!isAttached()) || (name.empty())) return std::nullopt;
+    // record 依名稱排序, 直接在 index 內容上做 binary search
+    size_t low = 0;
+    size_t high = getRecordCount();
+    while (low < high)
+    {
+        const size_t mid = low + (high - low) / 2;
+        const int compare = getRecordName(mid).compare(name);
+        if (compare == 0) return getHeaderData(mid);
+        if (compare < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<AssetHeaderData> AssetHeaderIndex::getHeaderData(size_t record_index) const
+{
+    if (record_index >= getRecordCount()) return std::nullopt;
+    const IndexRecord record = readRecord(m_records, m_recordSize, record_index);
+    if (!AssetCodec::isValidCodec(record.m_codec & RECORD_CODEC_MASK)) return std::nullopt;
+    AssetHeaderData header;
+    header.m_name = std::string{ getRecordName(record_index) };
+    header.m_version = record.m_version;
+    header.m_crc = record.m_crc;
+    header.m_size = record.m_size;
+    header.m_orgSize = record.m_orgSize;
+    header.m_offset = record.m_offset;
+    header.m_codec = static_cast<AssetCodecId>(record.m_codec & RECORD_CODEC_MASK);
+    header.m_hasCrc = (((record.m_codec >> RECORD_FLAG_SHIFT) & RECORD_FLAG_HAS_CRC) != 0);
+    header.m_blockSize = record.m_blockSize;
+    header.m_solidOffset = record.m_solidOffset;
+    header.m_solidBlockSize = record.m_solidBlockSize;
+    return header;
+}
+
+error AssetHeaderIndex::importToHeaderDataMap(AssetHeaderDataMap& header_map) const
+{
+    if (!isAttached()) return ErrorCode::invalidHeaderData;
+    header_map.reserve(header_map.getTotalDataCount() + getRecordCount());
+    for (size_t i = 0; i < getRecordCount(); i++)
+    {
+        const auto header = getHeaderData(i);
+        if ((!header) || (header->m_name.empty())) return ErrorCode::invalidHeaderData;
+        if (const error er = header_map.insertHeaderData(header.value())) return er;
+    }
+    return ErrorCode::ok;
+}
@@ -0,0 +1,73 @@
+﻿/*****************************************************************
+ * \file   AssetHeaderIndex.hpp
+ * \brief  header 檔的 index 區段: 依名稱排序的固定大小 record + 名稱字串池,
+ *         可以直接在 mapping 的內容上查詢, 不用先建 map
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_HEADER_INDEX_HPP
+#define ASSET_HEADER_INDEX_HPP
+
+#include "AssetHeaderDataMap.hpp"
+#include <string>
+#include <string_view>
+#include <optional>
+#include <system_error>
+#include <vector>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class AssetHeaderIndex
+    {
+    public:
+        /** index 區段開頭的描述, 後面接 record table 跟字串池 */
+        struct IndexDescriptor
+        {
+            std::uint64_t m_recordCount;
+            std::uint64_t m_stringPoolBytes;
+        };
+        constexpr static size_t DESCRIPTOR_SIZE = sizeof(std::uint64_t) * 2;
+        constexpr static size_t SORTED_INDEX_RECORD_SIZE = sizeof(unsigned int) * 4 + sizeof(std::uint64_t) * 3;  ///< 0x04 格式, 沒有 codec 欄位
+        constexpr static size_t CODEC_RECORD_SIZE = sizeof(unsigned int) * 6 + sizeof(std::uint64_t) * 3;  ///< 0x05 ~ 0x09 格式, 沒有 solid block 欄位
+        constexpr static size_t RECORD_SIZE = sizeof(unsigned int) * 6 + sizeof(std::uint64_t) * 5;
+        /** 依 package format tag 決定 record 的大小 */
+        [[nodiscard]] static size_t getRecordSize(unsigned int format_tag);
+    public:
+        AssetHeaderIndex();
+        AssetHeaderIndex(const AssetHeaderIndex&) = delete;
+        AssetHeaderIndex(AssetHeaderIndex&&) = delete;
+        ~AssetHeaderIndex() noexcept;
+
+        AssetHeaderIndex& operator=(const AssetHeaderIndex&) = delete;
+        AssetHeaderIndex& operator=(AssetHeaderIndex&&) = delete;
+
+        /** 把 header map 輸出成 index 區段 (descriptor + records + 字串池) */
+        [[nodiscard]] static std::vector<char> exportFromHeaderDataMap(const AssetHeaderDataMap& header_map);
+
+        /** 掛上 index 區段的內容, 不複製資料, data 要在 index 使用期間一直有效 */
+        error attachIndexData(const char* data, size_t size, unsigned int format_tag);
+        void detachIndexData();
+        /** index 區段的總長度 */
+        [[nodiscard]] size_t getIndexDataBytes() const;
+
+        [[nodiscard]] bool isAttached() const { return m_data != nullptr; }
+        [[nodiscard]] size_t getRecordCount() const { return static_cast<size_t>(m_descriptor.m_recordCount); }
+        [[nodiscard]] std::optional<AssetHeaderDataMap::AssetHeaderData> tryFindHeaderData(std::string_view name) const;
+        [[nodiscard]] std::optional<AssetHeaderDataMap::AssetHeaderData> getHeaderData(size_t record_index) const;
+        [[nodiscard]] std::string_view getRecordName(size_t record_index) const;
+
+        error importToHeaderDataMap(AssetHeaderDataMap& header_map) const;
+
+    private:
+        const char* m_data;
+        IndexDescriptor m_descriptor;
+        size_t m_recordSize;
+        const char* m_records;
+        const char* m_stringPool;
+    };
+}
+
+#endif // ASSET_HEADER_INDEX_HPP
@@ -0,0 +1,153 @@
+﻿#include "AssetHeaderJournal.hpp"
+#include "AssetCrc32.hpp"
+#include <cstring>
+
+using namespace AssetPackage;
+
+using AssetHeaderData = AssetHeaderDataMap::AssetHeaderData;
+
+constexpr size_t RECORD_PREFIX_SIZE = sizeof(unsigned int) * 2;  // type + payload bytes
+constexpr size_t RECORD_CRC_SIZE = sizeof(unsigned int);
+constexpr unsigned int RECORD_FLAG_HAS_CRC = 0x01;
+constexpr unsigned int RECORD_FLAG_HAS_CONTENT_KEY = 0x02;
+constexpr unsigned int RECORD_FLAG_SOLID_MEMBER = 0x04;
+
+static void appendBytes(std::vector<char>& buff, const void* data, size_t size)
+{
+    const size_t index = buff.size();
+    buff.resize(index + size, 0);
+    std::memcpy(&buff[index], data, size);
+}
+
+static bool readBytes(const char* data, size_t size, size_t& index, void* out, size_t out_size)
+{
+    if (size - index < out_size) return false;
+    std::memcpy(out, data + index, out_size);
+    index += out_size;
+    return true;
+}
+
+static std::vector<char> beginRecord(AssetHeaderJournal::RecordType type, const std::string& asset_key)
+{
+    std::vector<char> buff;
+    const auto type_value = static_cast<unsigned int>(type);
+    appendBytes(buff, &type_value, sizeof(unsigned int));
+    constexpr unsigned int payload_bytes = 0;  // 最後才回填
+    appendBytes(buff, &payload_bytes, sizeof(unsigned int));
+    const auto name_length = static_cast<unsigned int>(asset_key.size());
+    appendBytes(buff, &name_length, sizeof(unsigned int));
+    appendBytes(buff, asset_key.data(), asset_key.size());
+    return buff;
+}
+
+static void endRecord(std::vector<char>& buff)
+{
+    const auto payload_bytes = static_cast<unsigned int>(buff.size() - RECORD_PREFIX_SIZE);
+    std::memcpy(&buff[sizeof(unsigned int)], &payload_bytes, sizeof(unsigned int));
+    const unsigned int crc = AssetCrc32::compute(buff.data(), buff.size());
+    appendBytes(buff, &crc, sizeof(unsigned int));
+}
+
+std::vector<char> AssetHeaderJournal::exportPutRecord(const AssetHeaderData& header, const std::optional<AssetDedupTable::ContentKey>& content_key)
+{
+    std::vector<char> buff = beginRecord(RecordType::putAsset, header.m_name);
+    appendBytes(buff, &header.m_version, sizeof(unsigned int));
+    appendBytes(buff, &header.m_size, sizeof(std::uint64_t));
+    appendBytes(buff, &header.m_orgSize, sizeof(std::uint64_t));
+    appendBytes(buff, &header.m_offset, sizeof(std::uint64_t));
+    appendBytes(buff, &header.m_crc, sizeof(unsigned int));
+    const auto codec = static_cast<unsigned int>(header.m_codec);
+    appendBytes(buff, &codec, sizeof(unsigned int));
+    appendBytes(buff, &header.m_blockSize, sizeof(unsigned int));
+    unsigned int flags = 0;
+    if (header.m_hasCrc) flags |= RECORD_FLAG_HAS_CRC;
+    if (content_key) flags |= RECORD_FLAG_HAS_CONTENT_KEY;
+    if (header.isSolidMember()) flags |= RECORD_FLAG_SOLID_MEMBER;
+    appendBytes(buff, &flags, sizeof(unsigned int));
+    if (header.isSolidMember())
+    {
+        appendBytes(buff, &header.m_solidOffset, sizeof(std::uint64_t));
+        appendBytes(buff, &header.m_solidBlockSize, sizeof(std::uint64_t));
+    }
+    if (content_key)
+    {
+        appendBytes(buff, &content_key->m_hash, sizeof(std::uint64_t));
+        appendBytes(buff, &content_key->m_orgSize, sizeof(std::uint64_t));
+        appendBytes(buff, &content_key->m_rawCrc, sizeof(unsigned int));
+    }
+    endRecord(buff);
+    return buff;
+}
+
+std::vector<char> AssetHeaderJournal::exportRemoveRecord(const std::string& asset_key)
+{
+    std::vector<char> buff = beginRecord(RecordType::removeAsset, asset_key);
+    endRecord(buff);
+    return buff;
+}
+
+std::vector<AssetHeaderJournal::Record> AssetHeaderJournal::importRecords(const char* data, size_t size, size_t& valid_bytes)
+{
+    std::vector<Record> records;
+    valid_bytes = 0;
+    while (size - valid_bytes >= RECORD_PREFIX_SIZE + RECORD_CRC_SIZE)
+    {
+        const char* record_data = data + valid_bytes;
+        const size_t remain_size = size - valid_bytes;
+        unsigned int type_value = 0;
+        unsigned int payload_bytes = 0;
+        std::memcpy(&type_value, record_data, sizeof(unsigned int));
+        std::memcpy(&payload_bytes, record_data + sizeof(unsigned int), sizeof(unsigned int));
+        if (remain_size - RECORD_PREFIX_SIZE - RECORD_CRC_SIZE < payload_bytes) break;
+        const size_t crc_index = RECORD_PREFIX_SIZE + payload_bytes;
+        unsigned int crc = 0;
+        std::memcpy(&crc, record_data + crc_index, sizeof(unsigned int));
+        if (AssetCrc32::compute(record_data, crc_index) != crc) break;
+
+        // crc 對了, 內容一定是完整寫入的 record, 欄位長度不合就是格式錯誤, 一樣停在這裡
+        Record record{ static_cast<RecordType>(type_value), AssetHeaderData{}, std::nullopt };
+        size_t index = RECORD_PREFIX_SIZE;
+        unsigned int name_length = 0;
+        if ((!readBytes(record_data, crc_index, index, &name_length, sizeof(unsigned int))) || (crc_index - index < name_length)) break;
+        record.m_header.m_name.assign(record_data + index, name_length);
+        index += name_length;
+        if (record.m_type == RecordType::putAsset)
+        {
+            unsigned int codec = 0;
+            unsigned int flags = 0;
+            const bool is_read = (readBytes(record_data, crc_index, index, &record.m_header.m_version, sizeof(unsigned int)))
+                && (readBytes(record_data, crc_index, index, &record.m_header.m_size, sizeof(std::uint64_t)))
+                && (readBytes(record_data, crc_index, index, &record.m_header.m_orgSize, sizeof(std::uint64_t)))
+                && (readBytes(record_data, crc_index, index, &record.m_header.m_offset, sizeof(std::uint64_t)))
+                && (readBytes(record_data, crc_index, index, &record.m_header.m_crc, sizeof(unsigned int)))
+                && (readBytes(record_data, crc_index, index, &codec, sizeof(unsigned int)))
+                && (readBytes(record_data, crc_index, index, &record.m_header.m_blockSize, sizeof(unsigned int)))
+                && (readBytes(record_data, crc_index, index, &flags, sizeof(unsigned int)));
+            if (!is_read) break;
+            record.m_header.m_codec = static_cast<AssetCodecId>(codec);
+            record.m_header.m_hasCrc = (flags & RECORD_FLAG_HAS_CRC) != 0;
+            if ((flags & RECORD_FLAG_SOLID_MEMBER) != 0)
+            {
+                const bool is_solid_read = (readBytes(record_data, crc_index, index, &record.m_header.m_solidOffset, sizeof(std::uint64_t)))
+                    && (readBytes(record_data, crc_index, index, &record.m_header.m_solidBlockSize, sizeof(std::uint64_t)));
+                if (!is_solid_read) break;
+            }
+            if ((flags & RECORD_FLAG_HAS_CONTENT_KEY) != 0)
+            {
+                AssetDedupTable::ContentKey key{ 0, 0, 0 };
+                const bool is_key_read = (readBytes(record_data, crc_index, index, &key.m_hash, sizeof(std::uint64_t)))
+                    && (readBytes(record_data, crc_index, index, &key.m_orgSize, sizeof(std::uint64_t)))
+                    && (readBytes(record_data, crc_index, index, &key.m_rawCrc, sizeof(unsigned int)));
+                if (!is_key_read) break;
+                record.m_contentKey = key;
+            }
+        }
+        else if (record.m_type != RecordType::removeAsset)
+        {
+            break;
+        }
+        records.push_back(std::move(record));
+        valid_bytes += crc_index + RECORD_CRC_SIZE;
+    }
+    return records;
+}
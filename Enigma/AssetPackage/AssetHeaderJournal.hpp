@@ -0,0 +1,44 @@
+﻿/*****************************************************************
+ * \file   AssetHeaderJournal.hpp
+ * \brief  header 檔尾端的 journal record, 單筆 add/remove 只 append 一筆 record,
+ *         不改寫前面的 index; 寫到一半中斷的 record 讀取時用長度跟 crc 判斷丟掉
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_HEADER_JOURNAL_HPP
+#define ASSET_HEADER_JOURNAL_HPP
+
+#include "AssetHeaderDataMap.hpp"
+#include "AssetDedupTable.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace AssetPackage
+{
+    class AssetHeaderJournal
+    {
+    public:
+        enum class RecordType : unsigned int
+        {
+            putAsset = 1,
+            removeAsset = 2,
+        };
+        struct Record
+        {
+            RecordType m_type;
+            AssetHeaderDataMap::AssetHeaderData m_header;  ///< removeAsset 只有 m_name
+            std::optional<AssetDedupTable::ContentKey> m_contentKey;
+        };
+
+    public:
+        [[nodiscard]] static std::vector<char> exportPutRecord(const AssetHeaderDataMap::AssetHeaderData& header, const std::optional<AssetDedupTable::ContentKey>& content_key);
+        [[nodiscard]] static std::vector<char> exportRemoveRecord(const std::string& asset_key);
+        /** 依序解出 record, 遇到不完整或 crc 不符的 record 就停止; valid_bytes 回傳完整 record 的總長度 */
+        [[nodiscard]] static std::vector<Record> importRecords(const char* data, size_t size, size_t& valid_bytes);
+    };
+}
+
+#endif // ASSET_HEADER_JOURNAL_HPP
@@ -9,5 +9,8 @@
 #define MODULE_ASSET_PACKAGE_HPP
 
 #include "AssetPackageFile.hpp"
+#include "AssetPackageBuilder.hpp"
+#include "AssetPackageOverlay.hpp"
+#include "AssetPackagePatch.hpp"
 
 #endif // MODULE_ASSET_PACKAGE_HPP
@@ -0,0 +1,430 @@
+﻿#include "AssetPackageBuilder.hpp"
+#include "AssetPackageFile.hpp"
+#include "AssetPackageErrors.hpp"
+#include "AssetCrc32.hpp"
+#include "AssetDictionaryTrainer.hpp"
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <iterator>
+
+using namespace AssetPackage;
+
+// 每個 worker 最多可以領先 writer 幾個 asset, 限制壓縮完等待寫入的記憶體量
+constexpr unsigned int PENDING_ASSETS_PER_WORKER = 4;
+
+struct AssetPackageBuilder::CompressedAsset
+{
+    error m_error;
+    std::uint64_t m_origSize = 0;
+    AssetCodecId m_codec = AssetCodecId::zlib;
+    unsigned int m_blockSize = 0;
+    unsigned int m_crc = 0;
+    std::optional<AssetDedupTable::ContentKey> m_contentKey;
+    bool m_isDuplicate = false;  ///< 跟前面的 entry 內容相同, 沒有壓縮
+    bool m_isSolid = false;  ///< 要放進 solid block, m_compBuff 是原始內容
+    std::vector<unsigned char> m_compBuff;
+};
+
+struct AssetPackageBuilder::SolidBlock
+{
+    std::vector<char> m_content;
+    std::vector<AssetHeaderDataMap::AssetHeaderData> m_members;
+    std::map<std::tuple<std::uint64_t, std::uint64_t, unsigned int>, size_t> m_memberContents;  ///< content key -> 相同內容的第一個成員
+};
+
+AssetPackageBuilder::CompressedAsset AssetPackageBuilder::compressAssetFile(const std::string& file_path, const CodecPolicy& policy, const AssetCodec::Dictionary& dictionary,
+    const std::function<bool(const AssetDedupTable::ContentKey&)>& is_duplicated)
+{
+    CompressedAsset asset;
+    std::ifstream asset_file{ file_path, std::fstream::in | std::fstream::binary };
+    if (asset_file.fail())
+    {
+        asset.m_error = ErrorCode::fileOpenFail;
+        return asset;
+    }
+    asset_file.seekg(0, std::fstream::end);
+    const auto file_length = static_cast<size_t>(asset_file.tellg());
+    asset_file.seekg(0);
+    if (file_length == 0)
+    {
+        asset.m_error = ErrorCode::emptyBuffer;
+        return asset;
+    }
+    std::vector<char> buff;
+    buff.resize(file_length, 0);
+    asset_file.read(buff.data(), static_cast<std::streamsize>(file_length));
+    if (!asset_file)
+    {
+        asset.m_error = ErrorCode::fileReadFail;
+        return asset;
+    }
+    asset.m_origSize = file_length;
+    if ((policy.m_solidMaxAssetSize > 0) && (file_length <= policy.m_solidMaxAssetSize))
+    {
+        // 相同內容的 entry 在 writer 找, 不用跟其他 worker 搶; 壓縮等 block 滿了再做
+        if (is_duplicated) asset.m_contentKey = AssetDedupTable::computeContentKey(buff.data(), buff.size());
+        asset.m_isSolid = true;
+        asset.m_compBuff.assign(buff.begin(), buff.end());
+        return asset;
+    }
+    if (is_duplicated)
+    {
+        asset.m_contentKey = AssetDedupTable::computeContentKey(buff.data(), buff.size());
+        asset.m_isDuplicate = is_duplicated(asset.m_contentKey.value());
+        if (asset.m_isDuplicate) return asset;
+    }
+    asset.m_error = compressByPolicy(asset, buff, policy, dictionary);
+    if (asset.m_error) return asset;
+    // crc 也在 worker 裡算, writer 只負責寫入
+    asset.m_crc = AssetCrc32::compute(reinterpret_cast<const char*>(asset.m_compBuff.data()), asset.m_compBuff.size());  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    return asset;
+}
+
+error AssetPackageBuilder::compressByPolicy(CompressedAsset& asset, const std::vector<char>& buff, const CodecPolicy& policy, const AssetCodec::Dictionary& dictionary)
+{
+    const bool is_dictionary_codec = (policy.m_isPickByRatio) || (policy.m_codec == AssetCodecId::zlib) || (policy.m_codec == AssetCodecId::zlibDictionary);
+    if ((is_dictionary_codec) && (dictionary.m_size > 0) && (buff.size() <= policy.m_dictionaryMaxAssetSize))
+    {
+        // 小 asset 單獨壓縮時 zlib 的 header 跟重新建立的 window 佔大部分, 用共用 dictionary 壓縮
+        auto comp_buff = AssetCodec::compressContent(AssetCodecId::zlibDictionary, buff.data(), buff.size(), policy.m_zlibLevel, dictionary);
+        if (!comp_buff) return ErrorCode::compressFail;
+        if ((policy.m_isPickByRatio) && (static_cast<double>(comp_buff->size()) >= static_cast<double>(buff.size()) * policy.m_storedRatio))
+        {
+            asset.m_codec = AssetCodecId::stored;
+            asset.m_compBuff.assign(buff.begin(), buff.end());
+            return ErrorCode::ok;
+        }
+        asset.m_codec = AssetCodecId::zlibDictionary;
+        asset.m_compBuff = std::move(comp_buff.value());
+        return ErrorCode::ok;
+    }
+    const bool is_seekable = (policy.m_seekableMinSize > 0) && (buff.size() >= policy.m_seekableMinSize) && (policy.m_seekableBlockSize > 0);
+    if (!policy.m_isPickByRatio)
+    {
+        // 沒有 dictionary, 或是 asset 太大 (包括 solid block) 時, zlibDictionary 改用一般 zlib
+        const AssetCodecId codec = (policy.m_codec == AssetCodecId::zlibDictionary) ? AssetCodecId::zlib : policy.m_codec;
+        auto comp_buff = is_seekable
+            ? AssetCodec::compressSeekableContent(codec, policy.m_seekableBlockSize, buff.data(), buff.size(), policy.m_zlibLevel)
+            : AssetCodec::compressContent(codec, buff.data(), buff.size(), policy.m_zlibLevel);
+        if (!comp_buff) return ErrorCode::compressFail;
+        asset.m_codec = codec;
+        asset.m_blockSize = is_seekable ? policy.m_seekableBlockSize : 0;
+        asset.m_compBuff = std::move(comp_buff.value());
+        return ErrorCode::ok;
+    }
+    // 先用快的 fastLz 量壓縮率, 壓不下去的 (已壓縮過的 png, ogg...) 直接 stored, 也不用再跑 zlib
+    auto fast_buff = AssetCodec::compressContent(AssetCodecId::fastLz, buff.data(), buff.size());
+    if (!fast_buff) return ErrorCode::compressFail;
+    const auto orig_size = static_cast<double>(buff.size());
+    if (static_cast<double>(fast_buff->size()) >= orig_size * policy.m_storedRatio)
+    {
+        asset.m_codec = AssetCodecId::stored;
+        asset.m_compBuff.assign(buff.begin(), buff.end());
+        return ErrorCode::ok;
+    }
+    // zlib 要明顯比較小才值得多花的解壓時間
+    auto zlib_buff = AssetCodec::compressContent(AssetCodecId::zlib, buff.data(), buff.size(), policy.m_zlibLevel);
+    if (!zlib_buff) return ErrorCode::compressFail;
+    if (static_cast<double>(zlib_buff->size()) <= static_cast<double>(fast_buff->size()) * policy.m_zlibGainRatio)
+    {
+        asset.m_codec = AssetCodecId::zlib;
+        asset.m_compBuff = std::move(zlib_buff.value());
+    }
+    else
+    {
+        asset.m_codec = AssetCodecId::fastLz;
+        asset.m_compBuff = std::move(fast_buff.value());
+    }
+    if (is_seekable)
+    {
+        // 壓縮率是用整個內容量的, 選好 codec 後再分 block 重新壓縮; stored 本來就可以直接讀範圍, 不用分 block
+        auto comp_buff = AssetCodec::compressSeekableContent(asset.m_codec, policy.m_seekableBlockSize, buff.data(), buff.size(), policy.m_zlibLevel);
+        if (!comp_buff) return ErrorCode::compressFail;
+        asset.m_blockSize = policy.m_seekableBlockSize;
+        asset.m_compBuff = std::move(comp_buff.value());
+    }
+    return ErrorCode::ok;
+}
+
+error AssetPackageBuilder::appendCompressedAsset(const CompressedAsset& asset, const AssetFileEntry& entry)
+{
+    if (asset.m_contentKey)
+    {
+        // package 裡已經有相同內容 (之前加入的, 或是這次 build 前面的 entry), codec 不同的不共用
+        const error er = m_package->tryAppendSharedContent(asset.m_contentKey.value(), entry.m_assetKey, entry.m_version, asset.m_codec, asset.m_blockSize);
+        if (er != ErrorCode::notExistedKey) return er;
+        if (asset.m_isDuplicate) return ErrorCode::invalidHeaderData;
+    }
+    AssetHeaderDataMap::AssetHeaderData header_data;
+    header_data.m_name = entry.m_assetKey;
+    header_data.m_version = entry.m_version;
+    header_data.m_orgSize = asset.m_origSize;
+    header_data.m_codec = asset.m_codec;
+    header_data.m_blockSize = asset.m_blockSize;
+    header_data.m_crc = asset.m_crc;
+    header_data.m_hasCrc = true;
+    return m_package->appendCompressedContent(asset.m_compBuff, header_data, asset.m_contentKey);
+}
+
+error AssetPackageBuilder::appendSolidAsset(SolidBlock& block, const CompressedAsset& asset, const AssetFileEntry& entry)
+{
+    AssetHeaderDataMap::AssetHeaderData member;
+    member.m_name = entry.m_assetKey;
+    member.m_version = entry.m_version;
+    member.m_orgSize = asset.m_origSize;
+    member.m_solidOffset = block.m_content.size();
+    if (asset.m_contentKey)
+    {
+        const AssetDedupTable::ContentKey& key = asset.m_contentKey.value();
+        // solid block 的 codec 等 block 滿了才決定, 已經寫入的相同內容不論 codec 都共用
+        const error er = m_package->tryAppendSharedContent(key, entry.m_assetKey, entry.m_version, std::nullopt, 0);
+        if (er != ErrorCode::notExistedKey) return er;
+        // 同一個 block 裡相同內容的成員指到同一段
+        const auto [it, is_inserted] = block.m_memberContents.try_emplace({ key.m_hash, key.m_orgSize, key.m_rawCrc }, block.m_members.size());
+        if (!is_inserted)
+        {
+            member.m_solidOffset = block.m_members[it->second].m_solidOffset;
+            block.m_members.push_back(std::move(member));
+            return ErrorCode::ok;
+        }
+    }
+    block.m_content.insert(block.m_content.end(), asset.m_compBuff.begin(), asset.m_compBuff.end());
+    block.m_members.push_back(std::move(member));
+    if (block.m_content.size() < m_codecPolicy.m_solidBlockSize) return ErrorCode::ok;
+    return flushSolidBlock(block);
+}
+
+error AssetPackageBuilder::flushSolidBlock(SolidBlock& block)
+{
+    if (block.m_members.empty()) return ErrorCode::ok;
+    // block 本身已經夠大, 不用 dictionary, 也不用 seekable
+    CodecPolicy block_policy = m_codecPolicy;
+    block_policy.m_seekableMinSize = 0;
+    block_policy.m_dictionaryMaxAssetSize = 0;
+    CompressedAsset block_asset;
+    if (const error er = compressByPolicy(block_asset, block.m_content, block_policy, AssetCodec::Dictionary{})) return er;
+    AssetHeaderDataMap::AssetHeaderData block_header;
+    block_header.m_orgSize = block.m_content.size();
+    block_header.m_codec = block_asset.m_codec;
+    block_header.m_crc = AssetCrc32::compute(reinterpret_cast<const char*>(block_asset.m_compBuff.data()), block_asset.m_compBuff.size());  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    block_header.m_hasCrc = true;
+    const AssetDedupTable::ContentKey block_key = AssetDedupTable::computeContentKey(block.m_content.data(), block.m_content.size());
+    const error er = m_package->appendSolidBlock(block_asset.m_compBuff, block_header, block_key, block.m_members);
+    block.m_content.clear();
+    block.m_members.clear();
+    block.m_memberContents.clear();
+    return er;
+}
+
+AssetPackageBuilder::AssetPackageBuilder(const std::shared_ptr<AssetPackageFile>& package) : m_package(package), m_codecPolicy()
+{
+    assert(m_package);
+}
+
+AssetPackageBuilder::~AssetPackageBuilder() noexcept
+{
+    m_entries.clear();
+}
+
+error AssetPackageBuilder::appendAssetFile(const std::string& file_path, const std::string& asset_key, unsigned version)
+{
+    if ((file_path.empty()) || (asset_key.empty())) return ErrorCode::emptyFileName;
+    m_entries.push_back({ file_path, asset_key, AssetPackageFile::resolveAssetVersion(file_path, version) });
+    return ErrorCode::ok;
+}
+
+error AssetPackageBuilder::appendAssetDirectory(const std::string& dir_path, const std::string& key_prefix, unsigned version)
+{
+    if (dir_path.empty()) return ErrorCode::emptyFileName;
+    std::error_code ec;
+    const std::filesystem::path root_path{ dir_path };
+    std::vector<std::filesystem::path> file_paths;
+    for (auto iter = std::filesystem::recursive_directory_iterator(root_path, ec); (!ec) && (iter != std::filesystem::recursive_directory_iterator()); iter.increment(ec))
+    {
+        if (iter->is_regular_file()) file_paths.push_back(iter->path());
+    }
+    if (ec) return ErrorCode::fileOpenFail;
+    // 走訪順序跟檔案系統有關, 排序後 bundle 內容才是固定的
+    std::sort(file_paths.begin(), file_paths.end());
+    for (const auto& file_path : file_paths)
+    {
+        const std::string asset_key = key_prefix + std::filesystem::relative(file_path, root_path).generic_string();
+        if (const error er = appendAssetFile(file_path.string(), asset_key, version)) return er;
+    }
+    return ErrorCode::ok;
+}
+
+void AssetPackageBuilder::applyAccessOrder(const std::vector<std::string>& access_order)
+{
+    std::unordered_map<std::string, size_t> access_ranks;
+    for (size_t i = 0; i < access_order.size(); i++)
+    {
+        access_ranks.try_emplace(access_order[i], i);
+    }
+    const auto get_rank = [&access_ranks](const AssetFileEntry& entry)
+        {
+            const auto it = access_ranks.find(entry.m_assetKey);
+            return it != access_ranks.end() ? it->second : SIZE_MAX;
+        };
+    std::stable_sort(m_entries.begin(), m_entries.end(), [&get_rank](const AssetFileEntry& a, const AssetFileEntry& b) { return get_rank(a) < get_rank(b); });
+}
+
+error AssetPackageBuilder::trainPackageDictionary()
+{
+    std::vector<size_t> small_entries;
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        std::error_code ec;
+        const std::uintmax_t file_size = std::filesystem::file_size(m_entries[i].m_filePath, ec);
+        if ((!ec) && (file_size > 0) && (file_size <= m_codecPolicy.m_dictionaryMaxAssetSize)) small_entries.push_back(i);
+    }
+    // 平均取樣, 不要只取到某個目錄的 asset
+    const size_t sample_count = std::min(small_entries.size(), m_codecPolicy.m_dictionarySampleCount);
+    std::vector<std::vector<char>> samples;
+    samples.reserve(sample_count);
+    for (size_t i = 0; i < sample_count; i++)
+    {
+        const std::string& file_path = m_entries[small_entries[i * small_entries.size() / sample_count]].m_filePath;
+        std::ifstream sample_file{ file_path, std::fstream::in | std::fstream::binary };
+        if (sample_file.fail()) continue;
+        samples.emplace_back(std::istreambuf_iterator<char>(sample_file), std::istreambuf_iterator<char>());
+    }
+    std::vector<char> dictionary = AssetDictionaryTrainer::trainDictionary(samples);
+    if (dictionary.empty()) return ErrorCode::ok;
+    return m_package->setCompressionDictionary(dictionary);
+}
+
+error AssetPackageBuilder::build(unsigned worker_count)
+{
+    if (m_package->isReadOnly()) return ErrorCode::readOnlyPackage;
+    if (m_entries.empty()) return ErrorCode::ok;
+    if ((m_codecPolicy.m_dictionaryMaxAssetSize > 0) && (m_package->getCompressionDictionary().empty()))
+    {
+        if (const error er = trainPackageDictionary()) return er;
+    }
+    const AssetCodec::Dictionary dictionary{ m_package->getCompressionDictionary().data(), m_package->getCompressionDictionary().size() };
+    if (worker_count == 0) worker_count = std::max(1u, std::thread::hardware_concurrency());
+    worker_count = std::min(worker_count, static_cast<unsigned>(m_entries.size()));
+    const size_t max_pending = static_cast<size_t>(worker_count) * PENDING_ASSETS_PER_WORKER;
+
+    // worker 依序領取 entry 壓縮, 結果放到對應的 slot; 呼叫端的 thread 是唯一的 writer, 依 entry 順序 append 到 bundle
+    std::vector<std::optional<CompressedAsset>> slots(m_entries.size());
+    std::mutex slot_locker;
+    std::condition_variable slot_ready;
+    std::condition_variable slot_consumed;
+    size_t next_entry = 0;
+    size_t next_write = 0;
+    bool is_aborted = false;
+    // 內容相同的 entry 只有 index 最小的要壓縮, 其他的由 writer 指到同一段內容
+    const bool is_deduplicating = m_package->isDeduplicating();
+    std::mutex claim_locker;
+    std::map<std::tuple<std::uint64_t, std::uint64_t, unsigned int>, size_t> claimed_contents;
+
+    auto worker_proc = [&]()
+        {
+            while (true)
+            {
+                size_t index = 0;
+                {
+                    std::unique_lock<std::mutex> lock{ slot_locker };
+                    slot_consumed.wait(lock, [&]() { return is_aborted || (next_entry < next_write + max_pending); });
+                    if ((is_aborted) || (next_entry >= m_entries.size())) return;
+                    index = next_entry++;
+                }
+                std::function<bool(const AssetDedupTable::ContentKey&)> is_duplicated;
+                if (is_deduplicating)
+                {
+                    is_duplicated = [&claim_locker, &claimed_contents, index](const AssetDedupTable::ContentKey& key)
+                        {
+                            const std::lock_guard<std::mutex> lock{ claim_locker };
+                            const auto [it, is_inserted] = claimed_contents.try_emplace({ key.m_hash, key.m_orgSize, key.m_rawCrc }, index);
+                            if (is_inserted) return false;
+                            if (it->second < index) return true;
+                            // 後面的 entry 先處理完, 改由比較前面的這個壓縮, 後面的那個照樣寫入, writer 會找到共用內容
+                            it->second = index;
+                            return false;
+                        };
+                }
+                CompressedAsset asset = compressAssetFile(m_entries[index].m_filePath, m_codecPolicy, dictionary, is_duplicated);
+                {
+                    const std::lock_guard<std::mutex> lock{ slot_locker };
+                    slots[index] = std::move(asset);
+                }
+                slot_ready.notify_all();
+            }
+        };
+
+    SolidBlock solid_block;
+    // 呼叫端已經開了 batch 就併進去, 由呼叫端 commit
+    const bool is_owning_batch = !m_package->isBatching();
+    error er = ErrorCode::ok;
+    if (is_owning_batch) er = m_package->beginBatch();
+    if (er) return er;
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (unsigned i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back(worker_proc);
+    }
+    for (size_t index = 0; index < m_entries.size(); index++)
+    {
+        CompressedAsset asset;
+        {
+            std::unique_lock<std::mutex> lock{ slot_locker };
+            slot_ready.wait(lock, [&]() { return slots[index].has_value(); });
+            asset = std::move(slots[index].value());
+            slots[index].reset();
+        }
+        er = asset.m_error;
+        if ((!er) && (asset.m_isDuplicate))
+        {
+            // 沒有壓縮的 duplicate 用前面那個 entry 實際寫入的 codec 找共用內容
+            const AssetDedupTable::ContentKey& key = asset.m_contentKey.value();
+            size_t claimed_index = 0;
+            {
+                const std::lock_guard<std::mutex> lock{ claim_locker };
+                claimed_index = claimed_contents.at({ key.m_hash, key.m_orgSize, key.m_rawCrc });
+            }
+            const auto claimed_header = m_package->tryGetAssetHeaderData(m_entries[claimed_index].m_assetKey);
+            if (claimed_header)
+            {
+                asset.m_codec = claimed_header->m_codec;
+                asset.m_blockSize = claimed_header->m_blockSize;
+            }
+            else
+            {
+                er = ErrorCode::invalidHeaderData;
+            }
+        }
+        if (!er)
+        {
+            er = asset.m_isSolid ? appendSolidAsset(solid_block, asset, m_entries[index]) : appendCompressedAsset(asset, m_entries[index]);
+        }
+        {
+            const std::lock_guard<std::mutex> lock{ slot_locker };
+            next_write = index + 1;
+            if (er) is_aborted = true;
+        }
+        slot_consumed.notify_all();
+        if (er) break;
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    if (!er) er = flushSolidBlock(solid_block);
+    if (!is_owning_batch) return er;
+    // 失敗前已寫入的 asset 還是要 commit, header 才會跟 bundle 一致
+    const error er_commit = m_package->commitBatch();
+    if (er) return er;
+    return er_commit;
+}
@@ -0,0 +1,98 @@
+﻿/*****************************************************************
+ * \file   AssetPackageBuilder.hpp
+ * \brief  package builder, 用 worker threads 平行壓縮, 再依序寫入 bundle
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_PACKAGE_BUILDER_HPP
+#define ASSET_PACKAGE_BUILDER_HPP
+
+#include "AssetCodec.hpp"
+#include "AssetDedupTable.hpp"
+#include <functional>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <memory>
+
+namespace AssetPackage
+{
+    class AssetPackageFile;
+
+    using error = std::error_code;
+    class AssetPackageBuilder
+    {
+    public:
+        constexpr static std::uint64_t DEFAULT_SOLID_BLOCK_SIZE = 256 * 1024;
+        struct AssetFileEntry
+        {
+            std::string m_filePath;
+            std::string m_assetKey;
+            unsigned int m_version;
+        };
+        /** 每個 asset 的 codec 選擇方式 */
+        struct CodecPolicy
+        {
+            bool m_isPickByRatio = false;  ///< false 時全部用 m_codec
+            AssetCodecId m_codec = AssetCodecId::zlib;  ///< zlibDictionary 只用在有 dictionary 的小 asset, 其他的 (包括 solid block) 用 zlib
+            int m_zlibLevel = AssetCodec::DEFAULT_ZLIB_LEVEL;
+            float m_storedRatio = 0.95f;  ///< fastLz 壓縮後 / 原始大小 >= 這個值就不壓縮
+            float m_zlibGainRatio = 0.8f;  ///< zlib 結果 <= fastLz 結果 * 這個值才用 zlib, 不然用解壓較快的 fastLz
+            std::uint64_t m_seekableMinSize = 0;  ///< 原始大小 >= 這個值的 asset 用 seekable 格式, 0 表示不用
+            unsigned int m_seekableBlockSize = AssetCodec::DEFAULT_SEEKABLE_BLOCK_SIZE;
+            /** 原始大小 <= 這個值的 asset 用 package 共用的 dictionary 壓縮 (zlibDictionary), 0 表示不用;
+             * package 還沒有 dictionary 時, build 會先從這些小 asset 取樣建立 */
+            std::uint64_t m_dictionaryMaxAssetSize = 0;
+            size_t m_dictionarySampleCount = 1024;
+            /** 原始大小 <= 這個值的 asset 依 entry 順序串接成 solid block 一起壓縮, 0 表示不用; 優先於 dictionary.
+             * 讀取一整個目錄的小 asset 時只要讀幾個 block, 不用每個 asset 各讀一次 */
+            std::uint64_t m_solidMaxAssetSize = 0;
+            std::uint64_t m_solidBlockSize = DEFAULT_SOLID_BLOCK_SIZE;  ///< block 的原始內容累積到這個大小就壓縮寫入
+        };
+    public:
+        explicit AssetPackageBuilder(const std::shared_ptr<AssetPackageFile>& package);
+        AssetPackageBuilder(const AssetPackageBuilder&) = delete;
+        AssetPackageBuilder(AssetPackageBuilder&&) = delete;
+        ~AssetPackageBuilder() noexcept;
+
+        AssetPackageBuilder& operator=(const AssetPackageBuilder&) = delete;
+        AssetPackageBuilder& operator=(AssetPackageBuilder&&) = delete;
+
+        error appendAssetFile(const std::string& file_path, const std::string& asset_key, unsigned version);
+        /** 走訪目錄下所有檔案, asset key 為 key_prefix + 相對路徑 (以 '/' 分隔) */
+        error appendAssetDirectory(const std::string& dir_path, const std::string& key_prefix, unsigned version);
+
+        [[nodiscard]] const std::vector<AssetFileEntry>& getEntries() const { return m_entries; }
+        /** 依 access trace 的順序排列 entry, bundle 內一起讀取的 asset 才會相鄰; 不在 trace 裡的 entry 保持原本順序接在後面 */
+        void applyAccessOrder(const std::vector<std::string>& access_order);
+
+        void setCodecPolicy(const CodecPolicy& policy) { m_codecPolicy = policy; }
+        [[nodiscard]] const CodecPolicy& getCodecPolicy() const { return m_codecPolicy; }
+
+        /** worker_count 為 0 時使用 hardware concurrency; 全部寫入後只寫一次 header.
+         * package 已經在 batch 中時併入該 batch, 不會 commit */
+        error build(unsigned worker_count = 0);
+
+    private:
+        struct CompressedAsset;
+        struct SolidBlock;
+        /** is_duplicated 不是空的時候先算 content key, 回傳 true 表示前面的 entry 有相同內容, 不用壓縮 */
+        static CompressedAsset compressAssetFile(const std::string& file_path, const CodecPolicy& policy, const AssetCodec::Dictionary& dictionary,
+            const std::function<bool(const AssetDedupTable::ContentKey&)>& is_duplicated);
+        error appendCompressedAsset(const CompressedAsset& asset, const AssetFileEntry& entry);
+        /** 先放進還沒寫入的 block, 累積到 m_solidBlockSize 才壓縮寫入 */
+        error appendSolidAsset(SolidBlock& block, const CompressedAsset& asset, const AssetFileEntry& entry);
+        error flushSolidBlock(SolidBlock& block);
+        static error compressByPolicy(CompressedAsset& asset, const std::vector<char>& buff, const CodecPolicy& policy, const AssetCodec::Dictionary& dictionary);
+        /** 從小 asset 平均取樣建立 dictionary, 設定到 package; 樣本不夠時不設定 */
+        error trainPackageDictionary();
+
+    private:
+        std::shared_ptr<AssetPackageFile> m_package;
+        std::vector<AssetFileEntry> m_entries;
+        CodecPolicy m_codecPolicy;
+    };
+}
+
+#endif // ASSET_PACKAGE_BUILDER_HPP
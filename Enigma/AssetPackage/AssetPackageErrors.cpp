@@ -28,6 +28,18 @@ std::string ErrorCategory::message(int err) const
     case ErrorCode::emptyNameList: return "Empty name list";
     case ErrorCode::duplicatedKey: return "Duplicated asset key";
     case ErrorCode::notExistedKey: return "Not existed asset key";
+    case ErrorCode::fileMappingFail: return "File mapping fail";
+    case ErrorCode::readOnlyPackage: return "Package is read only";
+    case ErrorCode::invalidFreeSpaceList: return "Invalid free space list";
+    case ErrorCode::bufferTooSmall: return "Buffer too small";
+    case ErrorCode::unknownCodec: return "Unknown codec";
+    case ErrorCode::streamAborted: return "Stream aborted";
+    case ErrorCode::invalidRange: return "Invalid range";
+    case ErrorCode::crcMismatch: return "CRC mismatch";
+    case ErrorCode::missingDictionary: return "Missing compression dictionary";
+    case ErrorCode::dictionaryInUse: return "Compression dictionary in use";
+    case ErrorCode::requestCanceled: return "Request canceled";
+    case ErrorCode::batchInProgress: return "Batch in progress";
     }
     return "Unknown";
 }
@@ -38,7 +50,7 @@ const char* ErrorCategory::name() const noexcept
 }
 namespace AssetPackage
 {
-    inline std::error_code make_error_code(ErrorCode ec)
+    std::error_code make_error_code(ErrorCode ec)
     {
         return { static_cast<int>(ec), ErrorCategory::get() };
     }
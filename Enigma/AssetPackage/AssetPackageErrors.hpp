@@ -36,6 +36,18 @@ namespace AssetPackage
         emptyNameList,
         duplicatedKey,
         notExistedKey,
+        fileMappingFail,
+        readOnlyPackage,
+        invalidFreeSpaceList,
+        bufferTooSmall,
+        unknownCodec,
+        streamAborted,
+        invalidRange,
+        crcMismatch,
+        missingDictionary,
+        dictionaryInUse,
+        requestCanceled,
+        batchInProgress,
     };
     class ErrorCategory final : public std::error_category
     {
@@ -1,23 +1,81 @@
 ﻿// NOLINTBEGIN(clang-analyzer-optin.core.EnumCastOutOfRange)
 #include "AssetPackageFile.hpp"
 #include "AssetPackageErrors.hpp"
-#include "AssetNameList.hpp"
 #include "AssetHeaderDataMap.hpp"
+#include "AssetHeaderIndex.hpp"
+#include "AssetFreeSpaceList.hpp"
+#include "AssetCrc32.hpp"
+#include "AssetDedupTable.hpp"
+#include "AssetAccessTrace.hpp"
+#include "AssetAccessStatistics.hpp"
+#include "AssetHeaderJournal.hpp"
+#include "AssetPackageFormat.hpp"
+#include "MappedFile.hpp"
+#include "PositionalFile.hpp"
+#include "FileSync.hpp"
 #include "Platforms/Debug.hpp"
-#include "zlib.h"
 #include <ctime>
 #include <cstring>
 #include <cassert>
 #include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <iterator>
+#include <map>
+#include <unordered_set>
 
 using namespace AssetPackage;
 
-constexpr unsigned int PACKAGE_FORMAT_TAG = 0x01;
+constexpr std::uint64_t COMPACT_COPY_CHUNK_SIZE = 1024 * 1024;
+constexpr std::uint64_t VERIFY_READ_CHUNK_SIZE = 4 * 1024 * 1024;
+constexpr std::uint64_t JOURNAL_CHECKPOINT_MIN_BYTES = 64 * 1024;
+constexpr std::uint64_t SOLID_BLOCK_CACHE_BYTES = 4 * 1024 * 1024;
+// 批次讀取時, 間隔不超過 BATCH_READ_MAX_GAP 的內容合併成一次讀取, 中間的部分讀了丟掉
+constexpr std::uint64_t BATCH_READ_MAX_GAP = 16 * 1024;
+constexpr std::uint64_t BATCH_READ_MAX_SIZE = 4 * 1024 * 1024;
 const std::string PACKAGE_HEADER_FILE_EXT = ".eph";
 const std::string PACKAGE_BUNDLE_FILE_EXT = ".epb";
+// 重寫 bundle 時新的 bundle 跟對應的 header 先寫到這個副檔名的暫存檔
+const std::string PACKAGE_REWRITE_FILE_EXT = ".rewrite";
+// 整份重寫 header 時先寫到這個副檔名的暫存檔
+const std::string PACKAGE_CHECKPOINT_FILE_EXT = ".checkpoint";
 
 using AssetHeaderData = AssetHeaderDataMap::AssetHeaderData;
 
+static std::optional<std::pair<size_t, size_t>> findSizedSection(const char* data, size_t data_size, size_t pos)
+{
+    // header 檔的區段都是 32 bits 長度 + 內容, 回傳內容的位置跟長度
+    unsigned int byte_size = 0;
+    if ((pos > data_size) || (data_size - pos < sizeof(byte_size))) return std::nullopt;
+    std::memcpy(&byte_size, data + pos, sizeof(byte_size));
+    pos += sizeof(byte_size);
+    if (byte_size > data_size - pos) return std::nullopt;
+    return std::make_pair(pos, static_cast<size_t>(byte_size));
+}
+
+static std::uint64_t alignOffset(std::uint64_t offset, std::uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static std::unique_lock<std::mutex> lockFileLocker(std::mutex& file_locker, AssetAccessStatistics* statistics, AssetAccessStatistics::FileLocker locker_id)
+{
+    if (!statistics) return std::unique_lock<std::mutex>{ file_locker };
+    // 先試一次, 拿得到就不算等待, 不用量時間
+    std::unique_lock<std::mutex> locker{ file_locker, std::try_to_lock };
+    if (locker.owns_lock())
+    {
+        statistics->recordLockWait(locker_id, false, std::chrono::nanoseconds::zero());
+        return locker;
+    }
+    const auto wait_begin = std::chrono::steady_clock::now();
+    locker.lock();
+    statistics->recordLockWait(locker_id, true, std::chrono::steady_clock::now() - wait_begin);
+    return locker;
+}
+
 static unsigned int getFileVersionWithModifyTime(const std::string& file_path)
 {
     // NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
@@ -58,7 +116,7 @@ static time_t getTimeStampFromFileVersion(unsigned int ver)
     // NOLINTEND(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 }
 
-AssetPackageFile::AssetPackageFile() : m_formatTag(PACKAGE_FORMAT_TAG), m_fileVersion(0), m_assetCount(0), m_nameList(nullptr), m_headerDataMap(nullptr)
+AssetPackageFile::AssetPackageFile() : m_formatTag(PACKAGE_FORMAT_TAG), m_fileVersion(0), m_assetCount(0), m_isReadOnly(false), m_isBatching(false), m_isVerifyOnRetrieve(false), m_isDeduplicating(true), m_storedAlignment(0), m_headerDataMap(nullptr), m_freeSpaceList(nullptr), m_dedupTable(nullptr), m_headerMapping(nullptr), m_headerIndex(nullptr), m_contentCache(nullptr), m_solidBlockCache(std::make_unique<AssetContentCache>(SOLID_BLOCK_CACHE_BYTES)), m_accessTrace(nullptr), m_accessStatistics(nullptr), m_headerSnapshotBytes(0), m_headerJournalBytes(0), m_bundleMapping(nullptr), m_bundleReader(nullptr)
 {
 }
 
@@ -88,8 +146,9 @@ error AssetPackageFile::createNewPackageImp(const std::string& base_filename)
 
     resetPackage();
 
-    m_nameList = std::make_unique<AssetNameList>();
     m_headerDataMap = std::make_unique<AssetHeaderDataMap>();
+    m_freeSpaceList = std::make_unique<AssetFreeSpaceList>();
+    m_dedupTable = std::make_unique<AssetDedupTable>();
     m_baseFilename = base_filename;
 
     const std::string header_filename = m_baseFilename + PACKAGE_HEADER_FILE_EXT;
@@ -103,10 +162,10 @@ error AssetPackageFile::createNewPackageImp(const std::string& base_filename)
     {
         return ErrorCode::fileOpenFail;
     }
+    m_bundleReader = std::make_unique<PositionalFile>();
+    if (const error er = m_bundleReader->open(bundle_filename)) return er;
 
-    saveHeaderFile();
-
-    return ErrorCode::ok;
+    return saveHeaderFile();
 }
 
 std::shared_ptr<AssetPackageFile> AssetPackageFile::openPackage(const std::string& base_filename)
@@ -122,6 +181,11 @@ error AssetPackageFile::openPackageImp(const std::string& base_filename)
     if (base_filename.empty()) return ErrorCode::emptyFileName;
 
     resetPackage();
+    // 上次重寫 bundle 時中斷, 先把 header 跟 bundle 回復成一致
+    if (const error er = recoverBundleRewrite(base_filename)) return er;
+    // 上次寫 header checkpoint 時中斷, 原本的 header 還是完整的, 暫存檔直接丟掉
+    std::error_code ec;
+    std::filesystem::remove(base_filename + PACKAGE_HEADER_FILE_EXT + PACKAGE_CHECKPOINT_FILE_EXT, ec);
 
     m_baseFilename = base_filename;
 
@@ -134,39 +198,138 @@ error AssetPackageFile::openPackageImp(const std::string& base_filename)
     {
         return ErrorCode::fileOpenFail;
     }
+    m_bundleReader = std::make_unique<PositionalFile>();
+    if (const error er = m_bundleReader->open(bundle_filename)) return er;
+
+    readHeaderFile();
+    // 上次寫 journal 時中斷, 尾端留下不完整的 record, 整份重寫把它去掉
+    const std::uintmax_t header_file_size = std::filesystem::file_size(header_filename, ec);
+    if ((!ec) && (header_file_size > m_headerSnapshotBytes + m_headerJournalBytes)) return saveHeaderFile();
+
+    return ErrorCode::ok;
+}
+
+std::shared_ptr<AssetPackageFile> AssetPackageFile::openPackageReadOnly(const std::string& base_filename)
+{
+    const std::shared_ptr<AssetPackageFile> package = std::shared_ptr<AssetPackageFile>(new AssetPackageFile());
+    const error er = package->openPackageReadOnlyImp(base_filename);
+    assert(!er);
+    return package;
+}
+
+error AssetPackageFile::openPackageReadOnlyImp(const std::string& base_filename)
+{
+    if (base_filename.empty()) return ErrorCode::emptyFileName;
+
+    resetPackage();
+    // 上次重寫 bundle 時中斷, 先把 header 跟 bundle 回復成一致
+    if (const error er = recoverBundleRewrite(base_filename)) return er;
+
+    m_baseFilename = base_filename;
+    m_isReadOnly = true;
+
+    const std::string header_filename = m_baseFilename + PACKAGE_HEADER_FILE_EXT;
+    const std::string bundle_filename = m_baseFilename + PACKAGE_BUNDLE_FILE_EXT;
+
+    m_bundleMapping = std::make_unique<MappedFile>();
+    if (const error er = m_bundleMapping->open(bundle_filename)) return er;
+
+    m_headerMapping = std::make_unique<MappedFile>();
+    if (const error er = m_headerMapping->open(header_filename)) return er;
+    constexpr size_t header_prefix_size = sizeof(unsigned int) * 4;
+    if (m_headerMapping->size() < header_prefix_size) return ErrorCode::invalidHeaderData;
+    std::memcpy(&m_formatTag, m_headerMapping->data(), sizeof(m_formatTag));
+    if (m_formatTag >= PACKAGE_FORMAT_TAG_SORTED_INDEX)
+    {
+        // index 區段直接在 mapping 上查詢, 開啟時不用解析每一筆 header
+        std::memcpy(&m_fileVersion, m_headerMapping->data() + sizeof(unsigned int), sizeof(m_fileVersion));
+        std::memcpy(&m_assetCount, m_headerMapping->data() + sizeof(unsigned int) * 2, sizeof(m_assetCount));
+        m_headerIndex = std::make_unique<AssetHeaderIndex>();
+        if (const error er = m_headerIndex->attachIndexData(m_headerMapping->data() + header_prefix_size, m_headerMapping->size() - header_prefix_size, m_formatTag)) return er;
+        if (m_formatTag < PACKAGE_FORMAT_TAG_DICTIONARY) return ErrorCode::ok;
+        // free space list 跟去重複表唯讀時用不到, 跳過去取 dictionary
+        const auto free_space_section = findSizedSection(m_headerMapping->data(), m_headerMapping->size(), header_prefix_size + m_headerIndex->getIndexDataBytes());
+        if (!free_space_section) return ErrorCode::invalidHeaderData;
+        const auto dedup_section = findSizedSection(m_headerMapping->data(), m_headerMapping->size(), free_space_section->first + free_space_section->second);
+        if (!dedup_section) return ErrorCode::invalidHeaderData;
+        const auto dictionary_section = findSizedSection(m_headerMapping->data(), m_headerMapping->size(), dedup_section->first + dedup_section->second);
+        if (!dictionary_section) return ErrorCode::invalidHeaderData;
+        const char* dictionary_data = m_headerMapping->data() + dictionary_section->first;
+        m_dictionary.assign(dictionary_data, dictionary_data + dictionary_section->second);
+        if ((m_formatTag < PACKAGE_FORMAT_TAG_JOURNAL) || (dictionary_section->first + dictionary_section->second == m_headerMapping->size())) return ErrorCode::ok;
+        // 還有沒併回 index 的 journal, mapping 上的 index 不是最新的
+        m_headerIndex = nullptr;
+        m_dictionary.clear();
+    }
 
+    // 舊格式沒有 index 區段, 或是有 journal, 還是要讀進 header map
+    m_headerMapping = nullptr;
+    m_headerFile.open(header_filename.c_str(), std::fstream::in | std::fstream::binary);
+    if (!m_headerFile)
+    {
+        return ErrorCode::fileOpenFail;
+    }
     readHeaderFile();
 
     return ErrorCode::ok;
 }
 
+error AssetPackageFile::beginBatch()
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
+    if (m_isBatching) return ErrorCode::batchInProgress;
+    m_isBatching = true;
+    return ErrorCode::ok;
+}
+
+error AssetPackageFile::commitBatch()
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
+    if (!m_isBatching) return ErrorCode::ok;
+    m_isBatching = false;
+    {
+        const auto locker = lockBundleFile();
+        m_bundleFile.flush();
+        // 新的 header 寫入後就不再參照這些內容, 空間從這裡開始可以重複使用
+        for (const auto& [offset, size] : m_batchReleasedSpaces)
+        {
+            m_freeSpaceList->releaseSpace(offset, size);
+        }
+        m_batchReleasedSpaces.clear();
+    }
+    if (!m_bundleFile) return ErrorCode::fileWriteFail;
+    return saveHeaderFile();
+}
+
 error AssetPackageFile::addAssetFile(const std::string& file_path, const std::string& asset_key, unsigned version)
 {
+    return addAssetFile(file_path, asset_key, version, AssetCodecId::zlib, AssetCodec::DEFAULT_ZLIB_LEVEL);
+}
+
+error AssetPackageFile::addAssetFile(const std::string& file_path, const std::string& asset_key, unsigned version, AssetCodecId codec, int zlib_level)
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
     assert(m_headerFile.is_open());
     assert(m_bundleFile.is_open());
     if ((file_path.empty()) || (asset_key.empty()))
     {
         return ErrorCode::emptyFileName;
     }
-    unsigned int asset_ver = version;
-    if (version == VERSION_USE_FILE_TIME)
-    {
-        asset_ver = getFileVersionWithModifyTime(file_path);
-    }
+    const unsigned int asset_ver = resolveAssetVersion(file_path, version);
     std::ifstream asset_file{ file_path, std::fstream::in | std::fstream::binary };
     if (asset_file.fail()) return ErrorCode::fileOpenFail;
     asset_file.seekg(0, std::fstream::end);
-    const unsigned file_length = static_cast<unsigned>(asset_file.tellg());
+    const auto file_length = static_cast<size_t>(asset_file.tellg());
     asset_file.seekg(0);
     std::vector<char> buff;
     buff.resize(file_length, 0);
-    asset_file.read(buff.data(), file_length);
+    asset_file.read(buff.data(), static_cast<std::streamsize>(file_length));
     if (!asset_file)
     {
         asset_file.close();
         return ErrorCode::fileReadFail;
     }
-    const error add_result = addAssetMemory(buff, asset_key, asset_ver);
+    const error add_result = addAssetMemory(buff, asset_key, asset_ver, codec, zlib_level);
 
     asset_file.close();
     return add_result;
@@ -174,6 +337,23 @@ error AssetPackageFile::addAssetFile(const std::string& file_path, const std::st
 
 error AssetPackageFile::addAssetMemory(const std::vector<char>& buff, const std::string& asset_key, unsigned version)
 {
+    return addAssetMemory(buff, asset_key, version, AssetCodecId::zlib, AssetCodec::DEFAULT_ZLIB_LEVEL);
+}
+
+error AssetPackageFile::addAssetMemory(const std::vector<char>& buff, const std::string& asset_key, unsigned version, AssetCodecId codec, int zlib_level)
+{
+    return addAssetContent(buff, asset_key, version, codec, 0, zlib_level);
+}
+
+error AssetPackageFile::addAssetMemorySeekable(const std::vector<char>& buff, const std::string& asset_key, unsigned version, AssetCodecId codec, unsigned int block_size, int zlib_level)
+{
+    if (block_size == 0) return ErrorCode::invalidRange;
+    return addAssetContent(buff, asset_key, version, codec, block_size, zlib_level);
+}
+
+error AssetPackageFile::addAssetContent(const std::vector<char>& buff, const std::string& asset_key, unsigned version, AssetCodecId codec, unsigned int block_size, int zlib_level)
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
     assert(m_headerFile.is_open());
     assert(m_bundleFile.is_open());
     if (buff.empty())
@@ -184,46 +364,164 @@ error AssetPackageFile::addAssetMemory(const std::vector<char>& buff, const std:
     {
         return ErrorCode::emptyKey;
     }
-    unsigned long comp_length = compressBound(static_cast<uLong>(buff.size()));
-    std::vector<unsigned char> comp_buff;
-    comp_buff.resize(comp_length, 0);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    const int comp_result = compress(comp_buff.data(), &comp_length, reinterpret_cast<const unsigned char*>(buff.data()), static_cast<uLong>(buff.size()));
-    if (comp_result != Z_OK)
+    if ((codec == AssetCodecId::zlibDictionary) && (m_dictionary.empty())) return ErrorCode::missingDictionary;
+    std::optional<AssetDedupTable::ContentKey> content_key;
+    if (m_isDeduplicating)
+    {
+        // 相同內容已經在 bundle 裡, 不用再壓縮跟寫入
+        content_key = AssetDedupTable::computeContentKey(buff.data(), buff.size());
+        if (const error er = tryAppendSharedContent(content_key.value(), asset_key, version, codec, block_size); er != ErrorCode::notExistedKey) return er;
+    }
+    const auto comp_buff = block_size > 0
+        ? AssetCodec::compressSeekableContent(codec, block_size, buff.data(), buff.size(), zlib_level, getCodecDictionary())
+        : AssetCodec::compressContent(codec, buff.data(), buff.size(), zlib_level, getCodecDictionary());
+    if (!comp_buff)
     {
         return ErrorCode::compressFail;
     }
-
-    const std::lock_guard<std::mutex> locker{ m_bundleFileLocker };
-
-    m_bundleFile.seekp(0, std::fstream::end);
-    const unsigned int bundle_offset = static_cast<unsigned int>(m_bundleFile.tellp());
     AssetHeaderData header_data;
     header_data.m_name = asset_key;
-    header_data.m_offset = bundle_offset;
-    header_data.m_orgSize = static_cast<unsigned int>(buff.size());
-    header_data.m_size = comp_length;
     header_data.m_version = version;
-    header_data.m_crc = 0;
+    header_data.m_orgSize = buff.size();
+    header_data.m_codec = codec;
+    header_data.m_blockSize = block_size;
+    header_data.m_crc = AssetCrc32::compute(reinterpret_cast<const char*>(comp_buff->data()), comp_buff->size());  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    header_data.m_hasCrc = true;
+    return appendCompressedContent(comp_buff.value(), header_data, content_key);
+}
 
-    error er = m_nameList->appendAssetName(asset_key);
-    if (er) return er;
-    er = m_headerDataMap->insertHeaderData(header_data);
-    if (er)
+unsigned int AssetPackageFile::resolveAssetVersion(const std::string& file_path, unsigned version)
+{
+    if (version != VERSION_USE_FILE_TIME) return version;
+    return getFileVersionWithModifyTime(file_path);
+}
+
+error AssetPackageFile::appendCompressedContent(const std::vector<unsigned char>& comp_buff, AssetHeaderData header_data, const std::optional<AssetDedupTable::ContentKey>& content_key)
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
+    assert(m_bundleFile.is_open());
+    const std::string& asset_key = header_data.m_name;
+    if (asset_key.empty()) return ErrorCode::emptyKey;
+    const std::uint64_t comp_length = comp_buff.size();
+
+    const auto locker = lockBundleFile();
+
+    // 先找移除 asset 留下的空間, 沒有才 append 到 bundle 尾端
+    const std::uint64_t alignment = getContentAlignment(header_data);
+    const std::optional<std::uint64_t> free_offset = m_freeSpaceList->tryAllocateSpace(comp_length, alignment);
+    if (free_offset)
     {
-        // header add 失敗, 要再把 name list 改回
-        [[maybe_unused]] const error er_remove = m_nameList->removeAssetName(asset_key);
+        m_bundleFile.seekp(static_cast<std::streamoff>(free_offset.value()));
+    }
+    else
+    {
+        m_bundleFile.seekp(0, std::fstream::end);
+        const auto end_offset = static_cast<std::uint64_t>(m_bundleFile.tellp());
+        const std::uint64_t padding_size = alignOffset(end_offset, alignment) - end_offset;
+        if (padding_size > 0)
+        {
+            // 補 0 到對齊的位置, 補的空間可以給之後的小 asset 用
+            const std::vector<char> padding(static_cast<size_t>(padding_size), 0);
+            m_bundleFile.write(padding.data(), static_cast<std::streamsize>(padding_size));
+            m_freeSpaceList->releaseSpace(end_offset, padding_size);
+        }
+    }
+    header_data.m_offset = static_cast<std::uint64_t>(m_bundleFile.tellp());
+    header_data.m_size = comp_length;
+
+    if (const error er = m_headerDataMap->insertHeaderData(header_data))
+    {
+        // header add 失敗, 要再把 free space 改回
+        if (free_offset) m_freeSpaceList->releaseSpace(free_offset.value(), comp_length);
         return er;
     }
+    if (content_key) m_dedupTable->insertContent(content_key.value(), header_data);
 
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    m_bundleFile.write(reinterpret_cast<const char*>(comp_buff.data()), comp_length);
-    m_bundleFile.flush();
+    m_bundleFile.write(reinterpret_cast<const char*>(comp_buff.data()), static_cast<std::streamsize>(comp_length));
 
     m_assetCount++;
 
-    saveHeaderFile();
+    // bundle 內容要先落地, journal record 才能寫, 中斷時頂多留下沒人參照的 bundle 內容;
+    // 批次中也要 flush, 讀取走 positional read 或 mapping, 看不到 fstream buffer 裡的內容
+    m_bundleFile.flush();
+    if (!m_bundleFile) return ErrorCode::fileWriteFail;
+    // 批次中只 append bundle, header 留到 commitBatch 再寫
+    if (m_isBatching) return ErrorCode::ok;
+    return appendHeaderJournal(AssetHeaderJournal::exportPutRecord(header_data, content_key));
+}
 
+error AssetPackageFile::tryAppendSharedContent(const AssetDedupTable::ContentKey& content_key, const std::string& asset_key, unsigned version,
+    std::optional<AssetCodecId> codec, unsigned int block_size)
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
+    if (asset_key.empty()) return ErrorCode::emptyKey;
+    std::vector<char> record_buff;
+    {
+        const auto locker = lockBundleFile();
+        // 指定的 codec 不同的話照樣另外寫入, stored 才能直接讀 mapping, seekable 才能只解壓需要的範圍
+        const auto is_usable = [this, codec, block_size](const AssetDedupTable::SharedContent& content)
+            {
+                if (!codec) return true;
+                if ((content.m_header.m_codec != codec.value()) || (content.m_header.m_blockSize != block_size)) return false;
+                // 設定對齊之前寫入的 stored 內容不一定有對齊
+                return content.m_header.m_offset % getContentAlignment(content.m_header) == 0;
+            };
+        const auto shared_content = m_dedupTable->tryFindContent(content_key, is_usable);
+        if (!shared_content) return ErrorCode::notExistedKey;
+
+        // 新的 header 指到已經存在的 bundle 內容, 不寫 bundle
+        AssetHeaderData header_data = shared_content->m_header;
+        header_data.m_name = asset_key;
+        header_data.m_version = version;
+        error er = m_headerDataMap->insertHeaderData(header_data);
+        if (er) return er;
+        er = m_dedupTable->addReference(header_data.m_offset);
+        assert(!er);
+        m_assetCount++;
+        if (m_isBatching) return ErrorCode::ok;
+        record_buff = AssetHeaderJournal::exportPutRecord(header_data, std::nullopt);
+    }
+
+    return appendHeaderJournal(record_buff);
+}
+
+error AssetPackageFile::appendSolidBlock(const std::vector<unsigned char>& comp_buff, const AssetHeaderData& block_header,
+    const AssetDedupTable::ContentKey& block_key, const std::vector<AssetHeaderData>& members)
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
+    if (members.empty()) return ErrorCode::emptyBuffer;
+    const auto make_member_header = [&block_header](const AssetHeaderData& member)
+        {
+            AssetHeaderData header_data = block_header;
+            header_data.m_name = member.m_name;
+            header_data.m_version = member.m_version;
+            header_data.m_orgSize = member.m_orgSize;
+            header_data.m_solidOffset = member.m_solidOffset;
+            header_data.m_solidBlockSize = block_header.m_orgSize;
+            return header_data;
+        };
+    // 第一個成員跟一般 asset 一樣寫入 block 內容, 同時登記 block 的 content key
+    if (const error er = appendCompressedContent(comp_buff, make_member_header(members.front()), block_key)) return er;
+    const auto written_header = m_headerDataMap->tryGetHeaderData(members.front().m_name);
+    assert(written_header);
+    for (size_t i = 1; i < members.size(); i++)
+    {
+        AssetHeaderData header_data = make_member_header(members[i]);
+        header_data.m_offset = written_header->m_offset;
+        header_data.m_size = written_header->m_size;
+        std::vector<char> record_buff;
+        {
+            const auto locker = lockBundleFile();
+            if (const error er = m_headerDataMap->insertHeaderData(header_data)) return er;
+            [[maybe_unused]] const error er = m_dedupTable->addReference(header_data.m_offset);
+            assert(!er);
+            m_assetCount++;
+            if (m_isBatching) continue;
+            record_buff = AssetHeaderJournal::exportPutRecord(header_data, std::nullopt);
+        }
+        if (const error er = appendHeaderJournal(record_buff)) return er;
+    }
     return ErrorCode::ok;
 }
 
@@ -237,7 +535,7 @@ error AssetPackageFile::tryRetrieveAssetToFile(const std::string& file_path, con
     {
         return ErrorCode::emptyKey;
     }
-    const unsigned int asset_orig_size = getAssetOriginalSize(asset_key);
+    const std::uint64_t asset_orig_size = getAssetOriginalSize(asset_key);
     if (asset_orig_size == 0) return ErrorCode::zeroSizeAsset;
     const auto buff = tryRetrieveAssetToMemory(asset_key);
     if (!buff)
@@ -248,45 +546,352 @@ error AssetPackageFile::tryRetrieveAssetToFile(const std::string& file_path, con
     std::ofstream output_file{ file_path, std::fstream::out | std::fstream::binary | std::fstream::trunc };
     if (!output_file) return ErrorCode::fileOpenFail;
 
-    output_file.write(buff.value().data(), asset_orig_size);
+    output_file.write(buff.value().data(), static_cast<std::streamsize>(asset_orig_size));
     if (!output_file) return ErrorCode::fileWriteFail;
     const auto write_bytes = output_file.tellp();
 
     output_file.close();
 
-    if (write_bytes != asset_orig_size) return ErrorCode::writeSizeCheck;
+    if (static_cast<std::uint64_t>(write_bytes) != asset_orig_size) return ErrorCode::writeSizeCheck;
 
     return ErrorCode::ok;
 }
 
 std::optional<std::vector<char>> AssetPackageFile::tryRetrieveAssetToMemory(const std::string& asset_key)
 {
-    assert(m_bundleFile);
+    assert(m_bundleReader || m_bundleMapping);
 
     if (asset_key.empty()) return std::nullopt;
-    const unsigned int asset_orig_size = getAssetOriginalSize(asset_key);
+    const std::uint64_t asset_orig_size = getAssetOriginalSize(asset_key);
     if (asset_orig_size == 0) return std::nullopt;
 
     const auto header_data = tryGetAssetHeaderData(asset_key);
     if (!header_data) return std::nullopt;
+    recordAccess(asset_key);
+
+    if (header_data->isSolidMember())
+    {
+        // block 可能已經在 cache 裡, 先不讀壓縮資料
+        std::vector<char> buff(static_cast<size_t>(header_data->m_orgSize));
+        if (copySolidMemberTo(header_data.value(), nullptr, buff.data())) return std::nullopt;
+        return buff;
+    }
+    if (m_bundleMapping)
+    {
+        // mapping 是唯讀的, 直接把 mapping 內的指標交給 zlib, 不用 lock 也不用複製
+        if (header_data->m_offset + header_data->m_size > m_bundleMapping->size()) return std::nullopt;
+        return uncompressContent(header_data.value(), m_bundleMapping->data() + static_cast<size_t>(header_data->m_offset));
+    }
 
     auto [comp_buff, read_bytes] = readBundleContent(header_data->m_offset, header_data->m_size);
 
     if (read_bytes != header_data->m_size) return std::nullopt;
 
-    auto buff_out_length = static_cast<unsigned long>(asset_orig_size);
-    std::vector<char> buff;
-    buff.resize(buff_out_length, 0);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    const int z_result = uncompress(reinterpret_cast<unsigned char*>(buff.data()), &buff_out_length, reinterpret_cast<const unsigned char*>(comp_buff.data()), header_data->m_size);
-    if (z_result != Z_OK) return std::nullopt;
+    return uncompressContent(header_data.value(), comp_buff.data());
+}
 
-    return buff;
+error AssetPackageFile::tryRetrieveAssetToMemory(const std::string& asset_key, char* buff, size_t buff_size)
+{
+    assert(m_bundleReader || m_bundleMapping);
+
+    if (asset_key.empty()) return ErrorCode::emptyKey;
+    if (buff == nullptr) return ErrorCode::emptyBuffer;
+    const auto header_data = tryGetAssetHeaderData(asset_key);
+    if (!header_data) return ErrorCode::notExistedKey;
+    recordAccess(asset_key);
+    if (header_data->m_orgSize == 0) return ErrorCode::zeroSizeAsset;
+    if (buff_size < header_data->m_orgSize) return ErrorCode::bufferTooSmall;
+
+    if (header_data->isSolidMember()) return copySolidMemberTo(header_data.value(), nullptr, buff);
+    if (m_bundleMapping)
+    {
+        if (header_data->m_offset + header_data->m_size > m_bundleMapping->size()) return ErrorCode::readSizeCheck;
+        return uncompressContentTo(header_data.value(), m_bundleMapping->data() + static_cast<size_t>(header_data->m_offset), buff);
+    }
+
+    // 壓縮資料的暫存每個執行緒一份, 只會變大不會縮, 載入時不用每次配置跟清零
+    thread_local std::vector<char> comp_scratch;
+    if (comp_scratch.size() < header_data->m_size) comp_scratch.resize(static_cast<size_t>(header_data->m_size));
+    assert(m_bundleReader);
+    const size_t read_bytes = m_bundleReader->readAt(header_data->m_offset, comp_scratch.data(), static_cast<size_t>(header_data->m_size));
+    if (read_bytes != header_data->m_size) return ErrorCode::readSizeCheck;
+
+    return uncompressContentTo(header_data.value(), comp_scratch.data(), buff);
 }
 
-unsigned int AssetPackageFile::getAssetOriginalSize(const std::string& asset_key) const
+std::vector<std::optional<std::vector<char>>> AssetPackageFile::tryRetrieveAssetsToMemory(const std::vector<std::string>& asset_keys, unsigned worker_count)
 {
-    assert(m_headerDataMap);
+    assert(m_bundleReader || m_bundleMapping);
+    std::vector<std::optional<std::vector<char>>> results(asset_keys.size());
+    // header 先全部查好, 依 offset 排序後讀取才會接近循序
+    std::vector<std::pair<AssetHeaderData, size_t>> requests;
+    requests.reserve(asset_keys.size());
+    for (size_t i = 0; i < asset_keys.size(); i++)
+    {
+        if (asset_keys[i].empty()) continue;
+        auto header_data = tryGetAssetHeaderData(asset_keys[i]);
+        if ((!header_data) || (header_data->m_orgSize == 0)) continue;
+        recordAccess(asset_keys[i]);
+        requests.emplace_back(std::move(header_data.value()), i);
+    }
+    std::sort(requests.begin(), requests.end(), [](const auto& a, const auto& b) { return a.first.m_offset < b.first.m_offset; });
+
+    // 每個 range 是 requests 內連續的一段, 一次讀進來
+    std::vector<std::tuple<size_t, std::uint64_t, std::uint64_t>> ranges;  // 第一個 request, range 起點, range 終點
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        const AssetHeaderData& header_data = requests[i].first;
+        const std::uint64_t content_end = header_data.m_offset + header_data.m_size;
+        if (!ranges.empty())
+        {
+            auto& [first_request, range_begin, range_end] = ranges.back();
+            const std::uint64_t merged_end = std::max(range_end, content_end);
+            if ((header_data.m_offset <= range_end + BATCH_READ_MAX_GAP) && (merged_end - range_begin <= BATCH_READ_MAX_SIZE))
+            {
+                range_end = merged_end;
+                continue;
+            }
+        }
+        ranges.emplace_back(i, header_data.m_offset, content_end);
+    }
+    if (worker_count == 0) worker_count = std::max(1u, std::thread::hardware_concurrency());
+    worker_count = static_cast<unsigned>(std::min<size_t>(worker_count, std::max<size_t>(ranges.size(), 1)));
+
+    // 依 offset 順序領取 range, 各 worker 讀取後直接解壓; 每個結果只有一個 worker 會寫
+    std::atomic<size_t> next_range{ 0 };
+    auto worker_proc = [&]()
+        {
+            std::vector<char> read_buff;
+            for (size_t range = next_range++; range < ranges.size(); range = next_range++)
+            {
+                const auto [first_request, range_begin, range_end] = ranges[range];
+                const size_t last_request = range + 1 < ranges.size() ? std::get<0>(ranges[range + 1]) : requests.size();
+                const char* range_data = tryReadBundleContent(range_begin, range_end - range_begin, read_buff);
+                if (range_data == nullptr) continue;
+                for (size_t i = first_request; i < last_request; i++)
+                {
+                    const AssetHeaderData& header_data = requests[i].first;
+                    std::vector<char> buff(static_cast<size_t>(header_data.m_orgSize));
+                    if (uncompressContentTo(header_data, range_data + static_cast<size_t>(header_data.m_offset - range_begin), buff.data())) continue;
+                    results[requests[i].second] = std::move(buff);
+                }
+            }
+        };
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (unsigned i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back(worker_proc);
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    return results;
+}
+
+std::optional<AssetPackageFile::ContentView> AssetPackageFile::tryRetrieveAssetView(const std::string& asset_key)
+{
+    if ((asset_key.empty()) || (!m_bundleMapping)) return std::nullopt;
+    const auto header_data = tryGetAssetHeaderData(asset_key);
+    if (!header_data) return std::nullopt;
+    // 壓縮過的內容一定要解壓到另外的 buffer, 只有 stored 的內容可以直接用
+    if ((header_data->m_codec != AssetCodecId::stored) || (header_data->m_blockSize != 0)) return std::nullopt;
+    if (header_data->m_offset + header_data->m_size > m_bundleMapping->size()) return std::nullopt;
+    // stored 的 solid block 成員就是 block 內的一段
+    if ((header_data->isSolidMember()) && (header_data->m_solidOffset + header_data->m_orgSize > header_data->m_size)) return std::nullopt;
+    recordAccess(asset_key);
+    const char* data = m_bundleMapping->data() + static_cast<size_t>(header_data->m_offset);
+    const auto size = static_cast<size_t>(header_data->m_size);
+    if ((m_isVerifyOnRetrieve) && (header_data->m_hasCrc) && (AssetCrc32::compute(data, size) != header_data->m_crc)) return std::nullopt;
+    if (m_accessStatistics) m_accessStatistics->recordRead(asset_key, header_data->isSolidMember() ? header_data->m_orgSize : size);
+    if (header_data->isSolidMember()) return ContentView{ data + static_cast<size_t>(header_data->m_solidOffset), static_cast<size_t>(header_data->m_orgSize) };
+    return ContentView{ data, size };
+}
+
+error AssetPackageFile::tryRetrieveAssetStreaming(const std::string& asset_key, const AssetCodec::ContentSink& sink, size_t chunk_size)
+{
+    if (asset_key.empty()) return ErrorCode::emptyKey;
+    if (!sink) return ErrorCode::emptyBuffer;
+    const auto header_data = tryGetAssetHeaderData(asset_key);
+    if (!header_data) return ErrorCode::notExistedKey;
+    recordAccess(asset_key);
+    return streamAssetContent(header_data.value(), 0, header_data->m_orgSize, sink, chunk_size);
+}
+
+error AssetPackageFile::tryRetrieveAssetRange(const std::string& asset_key, std::uint64_t offset, char* buff, size_t size)
+{
+    if (asset_key.empty()) return ErrorCode::emptyKey;
+    if (buff == nullptr) return ErrorCode::emptyBuffer;
+    const auto header_data = tryGetAssetHeaderData(asset_key);
+    if (!header_data) return ErrorCode::notExistedKey;
+    recordAccess(asset_key);
+    if ((offset > header_data->m_orgSize) || (size > header_data->m_orgSize - offset)) return ErrorCode::invalidRange;
+    size_t write_pos = 0;
+    const AssetCodec::ContentSink sink = [buff, &write_pos](const char* data, size_t data_size)
+        {
+            std::memcpy(buff + write_pos, data, data_size);
+            write_pos += data_size;
+            return true;
+        };
+    if (const error er = streamAssetContent(header_data.value(), offset, offset + size, sink, AssetCodec::DEFAULT_STREAM_CHUNK_SIZE)) return er;
+    if (write_pos != size) return ErrorCode::readSizeCheck;
+    return ErrorCode::ok;
+}
+
+error AssetPackageFile::streamAssetContent(const AssetHeaderData& header_data, std::uint64_t begin, std::uint64_t end, const AssetCodec::ContentSink& sink, size_t chunk_size)
+{
+    assert(m_bundleReader || m_bundleMapping);
+    if (header_data.isSolidMember())
+    {
+        // 小 asset 才會放進 solid block, 直接從解壓後的 block 分段交給 sink
+        if ((begin > end) || (end > header_data.m_orgSize) || (chunk_size == 0)) return ErrorCode::invalidRange;
+        const auto block = tryGetSolidBlock(header_data, nullptr);
+        if (!block) return ErrorCode::decompressFail;
+        if (header_data.m_solidOffset + end > block->size()) return ErrorCode::invalidHeaderData;
+        for (std::uint64_t pos = begin; pos < end; pos += chunk_size)
+        {
+            const auto emit_size = static_cast<size_t>(std::min<std::uint64_t>(chunk_size, end - pos));
+            if (!sink(block->data() + static_cast<size_t>(header_data.m_solidOffset + pos), emit_size)) return ErrorCode::streamAborted;
+        }
+        return ErrorCode::ok;
+    }
+    if ((m_bundleMapping) && (header_data.m_offset + header_data.m_size > m_bundleMapping->size())) return ErrorCode::readSizeCheck;
+    // 壓縮資料一次只讀需要的一段, mapping 直接給指標, 不然用 positional read 讀到暫存
+    std::vector<char> fetch_buff;
+    const AssetCodec::ContentFetcher fetch = [this, &header_data, &fetch_buff](std::uint64_t offset, size_t size) -> const char*
+        {
+            if ((offset > header_data.m_size) || (size > header_data.m_size - offset)) return nullptr;
+            if (m_accessStatistics) m_accessStatistics->recordRead(header_data.m_name, size);
+            if (m_bundleMapping) return m_bundleMapping->data() + static_cast<size_t>(header_data.m_offset + offset);
+            if (fetch_buff.size() < size) fetch_buff.resize(size);
+            if (m_bundleReader->readAt(header_data.m_offset + offset, fetch_buff.data(), size) != size) return nullptr;
+            return fetch_buff.data();
+        };
+    return AssetCodec::uncompressContentRange(header_data.m_codec, header_data.m_blockSize, header_data.m_size, header_data.m_orgSize, begin, end, fetch, sink, chunk_size, getCodecDictionary());
+}
+
+AssetContentCache::Content AssetPackageFile::tryRetrieveAssetShared(const std::string& asset_key)
+{
+    if (m_contentCache)
+    {
+        // cache 命中也要記錄, trace 才是實際的使用順序; 沒命中的由 tryRetrieveAssetToMemory 記錄, 不重複計算讀取次數
+        if (auto content = m_contentCache->tryGetContent(asset_key))
+        {
+            recordAccess(asset_key);
+            return content;
+        }
+    }
+    auto buff = tryRetrieveAssetToMemory(asset_key);
+    if (!buff) return nullptr;
+    auto content = std::make_shared<const std::vector<char>>(std::move(buff.value()));
+    if (m_contentCache) m_contentCache->insertContent(asset_key, content);
+    return content;
+}
+
+void AssetPackageFile::enableContentCache(std::uint64_t budget_bytes)
+{
+    m_contentCache = std::make_unique<AssetContentCache>(budget_bytes);
+}
+
+void AssetPackageFile::disableContentCache()
+{
+    m_contentCache = nullptr;
+}
+
+std::optional<AssetContentCache::Statistics> AssetPackageFile::getContentCacheStatistics() const
+{
+    if (!m_contentCache) return std::nullopt;
+    return m_contentCache->getStatistics();
+}
+
+AssetContentCache::Statistics AssetPackageFile::getSolidBlockCacheStatistics() const
+{
+    return m_solidBlockCache->getStatistics();
+}
+
+std::vector<std::string> AssetPackageFile::verifyPackage(unsigned worker_count)
+{
+    assert(m_bundleReader || m_bundleMapping);
+    std::vector<AssetHeaderData> headers;
+    if (m_headerIndex)
+    {
+        headers.reserve(m_headerIndex->getRecordCount());
+        for (size_t i = 0; i < m_headerIndex->getRecordCount(); i++)
+        {
+            if (auto header = m_headerIndex->getHeaderData(i)) headers.push_back(std::move(header.value()));
+        }
+        std::sort(headers.begin(), headers.end(), [](const AssetHeaderData& a, const AssetHeaderData& b) { return a.m_offset < b.m_offset; });
+    }
+    else if (m_headerDataMap)
+    {
+        headers = m_headerDataMap->getHeaderDataOrderByOffset();
+    }
+    // 共用同一段內容的 header (去重複, solid block 的成員) 只檢查一次, 壞掉時全部回報
+    std::vector<size_t> group_begins;
+    for (size_t i = 0; i < headers.size(); i++)
+    {
+        if ((i == 0) || (headers[i].m_offset != headers[i - 1].m_offset)) group_begins.push_back(i);
+    }
+    group_begins.push_back(headers.size());
+    const size_t group_count = group_begins.size() - 1;
+    if (worker_count == 0) worker_count = std::max(1u, std::thread::hardware_concurrency());
+    worker_count = static_cast<unsigned>(std::min<size_t>(worker_count, std::max<size_t>(group_count, 1)));
+
+    // 依 offset 順序領取, 讀取大致是循序的
+    std::atomic<size_t> next_group{ 0 };
+    std::mutex corrupted_locker;
+    std::vector<std::string> corrupted_keys;
+    auto worker_proc = [&]()
+        {
+            std::vector<char> read_buff;
+            for (size_t group = next_group++; group < group_count; group = next_group++)
+            {
+                const AssetHeaderData& header = headers[group_begins[group]];
+                if ((!header.m_hasCrc) || (verifyContentCrc(header, read_buff))) continue;
+                const std::lock_guard<std::mutex> locker{ corrupted_locker };
+                for (size_t index = group_begins[group]; index < group_begins[group + 1]; index++)
+                {
+                    corrupted_keys.push_back(headers[index].m_name);
+                }
+            }
+        };
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (unsigned i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back(worker_proc);
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    std::sort(corrupted_keys.begin(), corrupted_keys.end());
+    return corrupted_keys;
+}
+
+bool AssetPackageFile::verifyContentCrc(const AssetHeaderData& header_data, std::vector<char>& read_buff) const
+{
+    if (m_bundleMapping)
+    {
+        if (header_data.m_offset + header_data.m_size > m_bundleMapping->size()) return false;
+        return AssetCrc32::compute(m_bundleMapping->data() + static_cast<size_t>(header_data.m_offset), static_cast<size_t>(header_data.m_size)) == header_data.m_crc;
+    }
+    // 大的 asset 分段讀, 每個 worker 只用一個固定大小的 buffer
+    unsigned int crc = 0;
+    for (std::uint64_t pos = 0; pos < header_data.m_size; pos += VERIFY_READ_CHUNK_SIZE)
+    {
+        const auto read_size = static_cast<size_t>(std::min(VERIFY_READ_CHUNK_SIZE, header_data.m_size - pos));
+        if (read_buff.size() < read_size) read_buff.resize(read_size);
+        if (m_bundleReader->readAt(header_data.m_offset + pos, read_buff.data(), read_size) != read_size) return false;
+        crc = AssetCrc32::compute(read_buff.data(), read_size, crc);
+    }
+    return crc == header_data.m_crc;
+}
+
+std::uint64_t AssetPackageFile::getAssetOriginalSize(const std::string& asset_key) const
+{
+    assert(m_headerDataMap || m_headerIndex);
 
     if (asset_key.empty()) return 0;
     const auto header_data = tryGetAssetHeaderData(asset_key);
@@ -296,7 +901,7 @@ unsigned int AssetPackageFile::getAssetOriginalSize(const std::string& asset_key
 
 time_t AssetPackageFile::getAssetTimeStamp(const std::string& asset_key) const
 {
-    assert(m_headerDataMap);
+    assert(m_headerDataMap || m_headerIndex);
 
     if (asset_key.empty()) return 0;
 
@@ -309,37 +914,319 @@ time_t AssetPackageFile::getAssetTimeStamp(const std::string& asset_key) const
 
 error AssetPackageFile::removeAsset(const std::string& asset_key)
 {
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
     if (asset_key.empty()) return ErrorCode::emptyKey;
     if (!m_headerDataMap) return ErrorCode::invalidHeaderData;
-    if (!m_nameList) return ErrorCode::invalidNameList;
+    if (!m_freeSpaceList) return ErrorCode::invalidFreeSpaceList;
+    assert(m_dedupTable);
     const auto header_data = tryGetAssetHeaderData(asset_key);
     if (!header_data) return ErrorCode::invalidHeaderData;
-    const unsigned int content_size = header_data->m_size;
-    const unsigned int content_offset = header_data->m_offset;
-
-    error er = repackBundleContent(content_size, content_offset);
-    if (er) return er;
 
     // 前面都檢查過可以移除，所以這後面的 error 都做 assert
-    er = m_nameList->removeAssetName(asset_key);
+    [[maybe_unused]] const error er = m_headerDataMap->removeHeaderData(asset_key);
     assert(!er);
-    m_headerDataMap->repackContentOffsets(content_size, content_offset);
-    er = m_headerDataMap->removeHeaderData(asset_key);
-    assert(!er);
-    saveHeaderFile();
+    if (m_contentCache) m_contentCache->invalidateContent(asset_key);
+    {
+        const auto locker = lockBundleFile();
+        // 共用的內容要等最後一個參照移除才釋放空間
+        if (m_dedupTable->releaseReference(header_data->m_offset) == 0)
+        {
+            // 共用 block 的一般 header 也可能是最後一個參照, 不論哪一種都要丟掉這個 offset 的 block cache
+            m_solidBlockCache->invalidateContent(std::to_string(header_data->m_offset));
+            // 批次 commit 前磁碟上的 header 還參照這段內容, 先不給新的 asset 覆寫
+            if (m_isBatching)
+            {
+                m_batchReleasedSpaces.emplace_back(header_data->m_offset, header_data->m_size);
+            }
+            else
+            {
+                m_freeSpaceList->releaseSpace(header_data->m_offset, header_data->m_size);
+            }
+        }
+    }
+    if (m_assetCount > 0) m_assetCount--;
+    if (m_isBatching) return ErrorCode::ok;
+
+    return appendHeaderJournal(AssetHeaderJournal::exportRemoveRecord(asset_key));
+}
+
+error AssetPackageFile::compact()
+{
+    // 依 offset 順序重寫, 就是去掉所有空洞
+    return relayoutBundle({});
+}
+
+void AssetPackageFile::enableAccessTrace()
+{
+    if (!m_accessTrace) m_accessTrace = std::make_unique<AssetAccessTrace>();
+}
+
+void AssetPackageFile::disableAccessTrace()
+{
+    m_accessTrace = nullptr;
+}
+
+void AssetPackageFile::enableAccessStatistics()
+{
+    if (!m_accessStatistics) m_accessStatistics = std::make_unique<AssetAccessStatistics>();
+}
+
+void AssetPackageFile::disableAccessStatistics()
+{
+    m_accessStatistics = nullptr;
+}
+
+void AssetPackageFile::recordAccess(const std::string& asset_key) const
+{
+    if (m_accessTrace) m_accessTrace->recordAccess(asset_key);
+    if (m_accessStatistics) m_accessStatistics->recordAccess(asset_key);
+}
+
+std::unique_lock<std::mutex> AssetPackageFile::lockBundleFile()
+{
+    return lockFileLocker(m_bundleFileLocker, m_accessStatistics.get(), AssetAccessStatistics::FileLocker::bundleFile);
+}
+
+std::unique_lock<std::mutex> AssetPackageFile::lockHeaderFile()
+{
+    return lockFileLocker(m_headerFileLocker, m_accessStatistics.get(), AssetAccessStatistics::FileLocker::headerFile);
+}
+
+error AssetPackageFile::relayoutBundle(const std::vector<std::string>& access_order)
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
+    // 批次中磁碟上的 header 還參照舊的 offset, 批次中移除的空間也還不能覆寫
+    if (m_isBatching) return ErrorCode::batchInProgress;
+    assert(m_headerDataMap);
+
+    // 新的順序 : trace 裡第一次讀取的順序, 沒讀過的 asset 依原本的 offset 接在後面
+    std::vector<AssetHeaderData> ordered_headers;
+    std::unordered_set<std::string> placed_keys;
+    for (const auto& asset_key : access_order)
+    {
+        if (!placed_keys.insert(asset_key).second) continue;
+        if (auto header = m_headerDataMap->tryGetHeaderData(asset_key)) ordered_headers.push_back(std::move(header.value()));
+    }
+    for (auto& header : m_headerDataMap->getHeaderDataOrderByOffset())
+    {
+        if (placed_keys.insert(header.m_name).second) ordered_headers.push_back(std::move(header));
+    }
+    return rewriteBundle(ordered_headers);
+}
+
+error AssetPackageFile::rewriteBundle(const std::vector<AssetHeaderData>& ordered_headers)
+{
+    assert(m_bundleFile.is_open());
+    assert(m_headerDataMap);
+    assert(m_freeSpaceList);
+
+    m_solidBlockCache->clear();
+    const std::string bundle_filename = m_baseFilename + PACKAGE_BUNDLE_FILE_EXT;
+    const std::string bundle_rewrite_filename = bundle_filename + PACKAGE_REWRITE_FILE_EXT;
+    const std::string header_rewrite_filename = m_baseFilename + PACKAGE_HEADER_FILE_EXT + PACKAGE_REWRITE_FILE_EXT;
+    std::map<std::uint64_t, std::uint64_t> offset_map;  // 舊 offset -> 新 offset, 共用的內容只複製一次
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> padding_spaces;
+
+    const auto locker = lockBundleFile();
+    // 已寫入 fstream 的內容要先 flush, positional read 才讀得到
+    m_bundleFile.flush();
+    {
+        // 原本的 bundle 完全不動, 內容依序寫到新的檔案
+        std::ofstream rewrite_file{ bundle_rewrite_filename, std::fstream::out | std::fstream::binary | std::fstream::trunc };
+        if (!rewrite_file) return ErrorCode::fileOpenFail;
+        std::vector<char> chunk_buff;
+        std::uint64_t write_offset = 0;
+        for (const auto& header : ordered_headers)
+        {
+            if (offset_map.count(header.m_offset) > 0) continue;
+            const std::uint64_t padding_size = alignOffset(write_offset, getContentAlignment(header)) - write_offset;
+            if (padding_size > 0)
+            {
+                const std::vector<char> padding(static_cast<size_t>(padding_size), 0);
+                rewrite_file.write(padding.data(), static_cast<std::streamsize>(padding_size));
+                padding_spaces.emplace_back(write_offset, padding_size);
+                write_offset += padding_size;
+            }
+            offset_map.emplace(header.m_offset, write_offset);
+            for (std::uint64_t copied_size = 0; copied_size < header.m_size; )
+            {
+                const auto chunk_size = static_cast<size_t>(std::min(header.m_size - copied_size, COMPACT_COPY_CHUNK_SIZE));
+                if (chunk_buff.size() < chunk_size) chunk_buff.resize(chunk_size);
+                if (m_bundleReader->readAt(header.m_offset + copied_size, chunk_buff.data(), chunk_size) != chunk_size)
+                {
+                    rewrite_file.close();
+                    std::filesystem::remove(bundle_rewrite_filename);
+                    return ErrorCode::readSizeCheck;
+                }
+                rewrite_file.write(chunk_buff.data(), static_cast<std::streamsize>(chunk_size));
+                copied_size += chunk_size;
+            }
+            write_offset += header.m_size;
+        }
+        rewrite_file.close();
+        if (!rewrite_file)
+        {
+            std::filesystem::remove(bundle_rewrite_filename);
+            return ErrorCode::fileWriteFail;
+        }
+        if (const error er = FileSync::syncFile(bundle_rewrite_filename))
+        {
+            std::filesystem::remove(bundle_rewrite_filename);
+            return er;
+        }
+    }
+
+    // 記憶體中的 header 先改成新的 offset 才能寫出新的 header 檔, 換檔失敗時再改回來
+    const unsigned int free_space_format_tag = m_formatTag;
+    const std::vector<char> free_space_buff = m_freeSpaceList->exportToByteBuffer(free_space_format_tag);
+    std::map<std::uint64_t, std::uint64_t> restore_offset_map;
+    for (const auto& [from_offset, to_offset] : offset_map)
+    {
+        restore_offset_map.emplace(to_offset, from_offset);
+    }
+    for (const auto& header : ordered_headers)
+    {
+        const error er = m_headerDataMap->updateContentOffset(header.m_name, offset_map.at(header.m_offset));
+        assert(!er);
+    }
+    m_dedupTable->remapContentOffsets(offset_map);
+    m_freeSpaceList->clear();
+    for (const auto& [offset, size] : padding_spaces)
+    {
+        m_freeSpaceList->releaseSpace(offset, size);
+    }
+    const auto restore_package = [&]()
+        {
+            for (const auto& header : ordered_headers)
+            {
+                const error er = m_headerDataMap->updateContentOffset(header.m_name, header.m_offset);
+                assert(!er);
+            }
+            m_dedupTable->remapContentOffsets(restore_offset_map);
+            m_freeSpaceList->clear();
+            if (!free_space_buff.empty()) m_freeSpaceList->importFromByteBuffer(free_space_buff, free_space_format_tag);
+            std::filesystem::remove(bundle_rewrite_filename);
+            std::filesystem::remove(header_rewrite_filename);
+        };
+
+    const auto header_locker = lockHeaderFile();
+    const auto [er, snapshot_bytes] = writeHeaderSnapshot(header_rewrite_filename);
+    if (er)
+    {
+        restore_package();
+        return er;
+    }
+    // 換 bundle 檔是 commit point: 換檔前中斷, 開啟時丟掉兩個暫存檔; 換檔後中斷, 開啟時把 header 也換過去
+    m_bundleFile.close();
+    m_bundleReader->close();
+    std::error_code ec;
+    std::filesystem::rename(bundle_rewrite_filename, bundle_filename, ec);
+    if (ec) restore_package();
+    m_bundleFile.open(bundle_filename.c_str(), std::fstream::in | std::fstream::out | std::fstream::binary);
+    if ((ec) || (!m_bundleFile)) return ErrorCode::fileWriteFail;
+    if (const error open_er = m_bundleReader->open(bundle_filename)) return open_er;
+    // 換 header 之前, 換 bundle 的結果要先寫到儲存裝置; 不然斷電後可能是新的 header 配舊的 bundle
+    if (const error sync_er = FileSync::syncParentDirectory(bundle_filename)) return sync_er;
+    return replaceHeaderFile(header_rewrite_filename, snapshot_bytes);
+}
 
+error AssetPackageFile::recoverBundleRewrite(const std::string& base_filename)
+{
+    const std::string header_filename = base_filename + PACKAGE_HEADER_FILE_EXT;
+    const std::string bundle_rewrite_filename = base_filename + PACKAGE_BUNDLE_FILE_EXT + PACKAGE_REWRITE_FILE_EXT;
+    const std::string header_rewrite_filename = header_filename + PACKAGE_REWRITE_FILE_EXT;
+    std::error_code ec;
+    if (std::filesystem::exists(bundle_rewrite_filename, ec))
+    {
+        // bundle 還沒換, 原本的 header 跟 bundle 是一致的
+        std::filesystem::remove(bundle_rewrite_filename, ec);
+        std::filesystem::remove(header_rewrite_filename, ec);
+        return ErrorCode::ok;
+    }
+    if (!std::filesystem::exists(header_rewrite_filename, ec)) return ErrorCode::ok;
+    // bundle 已經換成新的, header 也要換成對應的
+    std::filesystem::rename(header_rewrite_filename, header_filename, ec);
+    if (ec) return ErrorCode::fileWriteFail;
     return ErrorCode::ok;
 }
 
+std::uint64_t AssetPackageFile::getDeduplicatedBytes() const
+{
+    if (!m_dedupTable) return 0;
+    return m_dedupTable->getSavedBytes();
+}
+
+error AssetPackageFile::setCompressionDictionary(const std::vector<char>& dictionary)
+{
+    if (m_isReadOnly) return ErrorCode::readOnlyPackage;
+    if (!m_headerDataMap) return ErrorCode::invalidHeaderData;
+    if (dictionary == m_dictionary) return ErrorCode::ok;
+    // 已經壓縮的內容只能用原本的 dictionary 解壓
+    for (const auto& header : m_headerDataMap->getHeaderDataOrderByOffset())
+    {
+        if (header.m_codec == AssetCodecId::zlibDictionary) return ErrorCode::dictionaryInUse;
+    }
+    m_dictionary = dictionary;
+    if (!m_isBatching) return saveHeaderFile();
+    return ErrorCode::ok;
+}
+
+error AssetPackageFile::setStoredAlignment(std::uint64_t alignment)
+{
+    if ((alignment & (alignment - 1)) != 0) return ErrorCode::invalidRange;
+    m_storedAlignment = alignment;
+    return ErrorCode::ok;
+}
+
+std::uint64_t AssetPackageFile::getContentAlignment(const AssetHeaderData& header_data) const
+{
+    // 只有不壓縮的內容可以直接在 mapping 上使用, 對齊才有意義
+    if ((m_storedAlignment <= 1) || (header_data.m_codec != AssetCodecId::stored) || (header_data.m_blockSize != 0)) return 1;
+    return m_storedAlignment;
+}
+
+std::uint64_t AssetPackageFile::getFreeSpaceBytes() const
+{
+    if (!m_freeSpaceList) return 0;
+    return m_freeSpaceList->getTotalFreeBytes();
+}
+
 std::optional<AssetHeaderDataMap::AssetHeaderData> AssetPackageFile::tryGetAssetHeaderData(
     const std::string& asset_key) const
 {
+    if (m_headerIndex) return m_headerIndex->tryFindHeaderData(asset_key);
     assert(m_headerDataMap);
     return m_headerDataMap->tryGetHeaderData(asset_key);
 }
 
+std::vector<std::string> AssetPackageFile::getAssetKeys() const
+{
+    if (m_headerIndex)
+    {
+        std::vector<std::string> asset_keys;
+        asset_keys.reserve(m_headerIndex->getRecordCount());
+        for (size_t i = 0; i < m_headerIndex->getRecordCount(); i++)
+        {
+            asset_keys.emplace_back(m_headerIndex->getRecordName(i));
+        }
+        return asset_keys;
+    }
+    if (!m_headerDataMap) return {};
+    return m_headerDataMap->getAssetNames();
+}
+
 void AssetPackageFile::resetPackage()
 {
+    if (m_isBatching)
+    {
+        // 還沒 commit 的批次, 關檔前要寫回 header
+        [[maybe_unused]] const error er = commitBatch();
+    }
+    else if ((m_headerFile.is_open()) && (!m_isReadOnly) && (m_headerJournalBytes > 0))
+    {
+        // 關檔前把 journal 併回 index, 之後唯讀開啟才能直接在 mapping 上查詢
+        [[maybe_unused]] const error er = saveHeaderFile();
+    }
     if (m_headerFile.is_open())
     {
         m_headerFile.close();
@@ -348,52 +1235,121 @@ void AssetPackageFile::resetPackage()
     {
         m_bundleFile.close();
     }
+    m_bundleMapping = nullptr;
+    m_bundleReader = nullptr;
+    m_isReadOnly = false;
     m_formatTag = PACKAGE_FORMAT_TAG;
     m_fileVersion = 0;
     m_assetCount = 0;
-    m_nameList = nullptr;
     m_headerDataMap = nullptr;
+    m_freeSpaceList = nullptr;
+    m_dedupTable = nullptr;
+    m_headerIndex = nullptr;
+    m_headerMapping = nullptr;
+    m_contentCache = nullptr;
+    m_solidBlockCache->clear();
+    m_accessTrace = nullptr;
+    m_accessStatistics = nullptr;
+    m_dictionary.clear();
+    m_headerSnapshotBytes = 0;
+    m_headerJournalBytes = 0;
+    m_batchReleasedSpaces.clear();
 }
 
-void AssetPackageFile::saveHeaderFile()
+error AssetPackageFile::saveHeaderFile()
+{
+    const auto locker = lockHeaderFile();
+    // header 參照的 bundle 內容要先寫到儲存裝置, 斷電後 header 才不會指到沒寫入的內容
+    if (const error er = FileSync::syncFile(m_baseFilename + PACKAGE_BUNDLE_FILE_EXT)) return er;
+    // 不在原檔上改寫, 先寫完整的暫存檔再換檔, 中斷時原本的 header 檔 (含 journal) 還是完整的
+    const std::string checkpoint_filename = m_baseFilename + PACKAGE_HEADER_FILE_EXT + PACKAGE_CHECKPOINT_FILE_EXT;
+    const auto [er, snapshot_bytes] = writeHeaderSnapshot(checkpoint_filename);
+    if (er) return er;
+    return replaceHeaderFile(checkpoint_filename, snapshot_bytes);
+}
+
+std::tuple<error, std::uint64_t> AssetPackageFile::writeHeaderSnapshot(const std::string& file_path)
 {
     // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
-    assert(m_headerFile.is_open());
-    const std::lock_guard<std::mutex> locker{ m_headerFileLocker };
-    m_headerFile.seekp(0);
+    std::ofstream snapshot_file{ file_path, std::fstream::out | std::fstream::binary | std::fstream::trunc };
+    if (!snapshot_file) return { ErrorCode::fileOpenFail, 0 };
 
-    //m_headerFile << m_formatTag << m_fileVersion << m_assetCount;
-    m_headerFile.write(reinterpret_cast<const char*>(&m_formatTag), sizeof(m_formatTag));
-    m_headerFile.write(reinterpret_cast<const char*>(&m_fileVersion), sizeof(m_fileVersion));
-    m_headerFile.write(reinterpret_cast<const char*>(&m_assetCount), sizeof(m_assetCount));
+    // 舊格式的 package 在寫入時升級成目前的格式
+    m_formatTag = PACKAGE_FORMAT_TAG;
+    constexpr unsigned int reserved = 0;
+    //snapshot_file << m_formatTag << m_fileVersion << m_assetCount;
+    snapshot_file.write(reinterpret_cast<const char*>(&m_formatTag), sizeof(m_formatTag));
+    snapshot_file.write(reinterpret_cast<const char*>(&m_fileVersion), sizeof(m_fileVersion));
+    snapshot_file.write(reinterpret_cast<const char*>(&m_assetCount), sizeof(m_assetCount));
+    // 補齊 8 bytes 對齊, index 的 record table 才會對齊
+    snapshot_file.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+
+    // name list 已經包含在 index 的字串池裡, 不再另外寫
+    assert(m_headerDataMap);
+    const std::vector<char> index_buff = AssetHeaderIndex::exportFromHeaderDataMap(*m_headerDataMap);
+    snapshot_file.write(index_buff.data(), static_cast<std::streamsize>(index_buff.size()));
+
+    assert(m_freeSpaceList);
+    const std::vector<char> free_space_buff = m_freeSpaceList->exportToByteBuffer(m_formatTag);
+    const auto free_space_byte_size = static_cast<unsigned int>(free_space_buff.size());
+    snapshot_file.write(reinterpret_cast<const char*>(&free_space_byte_size), sizeof(free_space_byte_size));
+    if (free_space_byte_size > 0)
+    {
+        snapshot_file.write(free_space_buff.data(), free_space_byte_size);
+    }
 
-    assert(m_nameList);
-    const std::vector<char> name_buff = m_nameList->exportToByteBuffer();
-    const auto name_list_byte_size = static_cast<unsigned int>(name_buff.size());
-    m_headerFile.write(reinterpret_cast<const char*>(&name_list_byte_size), sizeof(name_list_byte_size));
-    if (name_list_byte_size > 0)
+    assert(m_dedupTable);
+    const std::vector<char> dedup_buff = m_dedupTable->exportToByteBuffer();
+    const auto dedup_byte_size = static_cast<unsigned int>(dedup_buff.size());
+    snapshot_file.write(reinterpret_cast<const char*>(&dedup_byte_size), sizeof(dedup_byte_size));
+    if (dedup_byte_size > 0)
     {
-        m_headerFile.write(name_buff.data(), name_list_byte_size);
+        snapshot_file.write(dedup_buff.data(), dedup_byte_size);
     }
 
-    assert(m_headerDataMap);
-    const std::vector<char> header_buff = m_headerDataMap->exportToByteBuffer();
-    const auto header_byte_size = static_cast<unsigned int>(header_buff.size());
-    m_headerFile.write(reinterpret_cast<const char*>(&header_byte_size), sizeof(header_byte_size));
-    if (header_byte_size > 0)
+    const auto dictionary_byte_size = static_cast<unsigned int>(m_dictionary.size());
+    snapshot_file.write(reinterpret_cast<const char*>(&dictionary_byte_size), sizeof(dictionary_byte_size));
+    if (dictionary_byte_size > 0)
     {
-        m_headerFile.write(header_buff.data(), header_byte_size);
+        snapshot_file.write(m_dictionary.data(), dictionary_byte_size);
     }
 
-    m_headerFile.flush();
+    const auto snapshot_bytes = static_cast<std::uint64_t>(snapshot_file.tellp());
+    snapshot_file.close();
+    if (!snapshot_file)
+    {
+        std::filesystem::remove(file_path);
+        return { ErrorCode::fileWriteFail, 0 };
+    }
+    // 換檔前內容要先寫到儲存裝置, 斷電後才不會換成不完整的 header
+    if (const error er = FileSync::syncFile(file_path))
+    {
+        std::filesystem::remove(file_path);
+        return { er, 0 };
+    }
+    return { ErrorCode::ok, snapshot_bytes };
     // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
 }
 
+error AssetPackageFile::replaceHeaderFile(const std::string& snapshot_filename, std::uint64_t snapshot_bytes)
+{
+    const std::string header_filename = m_baseFilename + PACKAGE_HEADER_FILE_EXT;
+    // 開著的檔案不一定能被換掉, 先關檔再重開
+    m_headerFile.close();
+    std::error_code ec;
+    std::filesystem::rename(snapshot_filename, header_filename, ec);
+    m_headerFile.open(header_filename.c_str(), std::fstream::in | std::fstream::out | std::fstream::binary);
+    if ((ec) || (!m_headerFile)) return ErrorCode::fileWriteFail;
+    m_headerSnapshotBytes = snapshot_bytes;
+    m_headerJournalBytes = 0;
+    return FileSync::syncParentDirectory(header_filename);
+}
+
 void AssetPackageFile::readHeaderFile()
 {
     // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
     assert(m_headerFile.is_open());
-    const std::lock_guard<std::mutex> locker{ m_headerFileLocker };
+    const auto locker = lockHeaderFile();
     m_headerFile.seekg(0);
 
     //m_headerFile >> m_formatTag >> m_fileVersion >> m_assetCount;
@@ -401,17 +1357,143 @@ void AssetPackageFile::readHeaderFile()
     m_headerFile.read(reinterpret_cast<char*>(&m_fileVersion), sizeof(m_fileVersion));
     m_headerFile.read(reinterpret_cast<char*>(&m_assetCount), sizeof(m_assetCount));
 
-    unsigned int name_list_byte_size = 0;
-    m_headerFile.read(reinterpret_cast<char*>(&name_list_byte_size), sizeof(name_list_byte_size));
-    std::vector<char> name_buff;
-    if (name_list_byte_size > 0)
+    error er;
+    if (m_formatTag >= PACKAGE_FORMAT_TAG_SORTED_INDEX)
     {
-        name_buff.resize(name_list_byte_size, 0);
-        m_headerFile.read(name_buff.data(), name_list_byte_size);
+        unsigned int reserved = 0;
+        m_headerFile.read(reinterpret_cast<char*>(&reserved), sizeof(reserved));
+        std::vector<char> index_buff;
+        index_buff.resize(AssetHeaderIndex::DESCRIPTOR_SIZE, 0);
+        m_headerFile.read(index_buff.data(), static_cast<std::streamsize>(AssetHeaderIndex::DESCRIPTOR_SIZE));
+        AssetHeaderIndex::IndexDescriptor descriptor{};
+        std::memcpy(&descriptor.m_recordCount, index_buff.data(), sizeof(std::uint64_t));
+        std::memcpy(&descriptor.m_stringPoolBytes, index_buff.data() + sizeof(std::uint64_t), sizeof(std::uint64_t));
+        index_buff.resize(static_cast<size_t>(AssetHeaderIndex::DESCRIPTOR_SIZE + descriptor.m_recordCount * AssetHeaderIndex::getRecordSize(m_formatTag) + descriptor.m_stringPoolBytes), 0);
+        m_headerFile.read(index_buff.data() + AssetHeaderIndex::DESCRIPTOR_SIZE, static_cast<std::streamsize>(index_buff.size() - AssetHeaderIndex::DESCRIPTOR_SIZE));
+
+        AssetHeaderIndex index;
+        er = index.attachIndexData(index_buff.data(), index_buff.size(), m_formatTag);
+        assert(!er);
+        m_headerDataMap = std::make_unique<AssetHeaderDataMap>();
+        er = index.importToHeaderDataMap(*m_headerDataMap);
+        assert(!er);
+    }
+    else
+    {
+        readLegacyHeaderSections();
+    }
+
+    m_freeSpaceList = std::make_unique<AssetFreeSpaceList>();
+    if (m_formatTag >= PACKAGE_FORMAT_TAG_FREE_SPACE)
+    {
+        unsigned int free_space_byte_size = 0;
+        m_headerFile.read(reinterpret_cast<char*>(&free_space_byte_size), sizeof(free_space_byte_size));
+        if (free_space_byte_size > 0)
+        {
+            std::vector<char> free_space_buff;
+            free_space_buff.resize(free_space_byte_size, 0);
+            m_headerFile.read(free_space_buff.data(), free_space_byte_size);
+            er = m_freeSpaceList->importFromByteBuffer(free_space_buff, m_formatTag);
+            assert(!er);
+        }
     }
-    m_nameList = std::make_unique<AssetNameList>();
-    error er = m_nameList->importFromByteBuffer(name_buff);
-    assert(!er);
+
+    // 0x07 之前沒有去重複表, 舊的 asset 都不共用
+    m_dedupTable = std::make_unique<AssetDedupTable>();
+    if (m_formatTag >= PACKAGE_FORMAT_TAG_DEDUP)
+    {
+        unsigned int dedup_byte_size = 0;
+        m_headerFile.read(reinterpret_cast<char*>(&dedup_byte_size), sizeof(dedup_byte_size));
+        if (dedup_byte_size > 0)
+        {
+            std::vector<char> dedup_buff;
+            dedup_buff.resize(dedup_byte_size, 0);
+            m_headerFile.read(dedup_buff.data(), dedup_byte_size);
+            er = m_dedupTable->importFromByteBuffer(dedup_buff);
+            assert(!er);
+            m_dedupTable->rebuildReferences(m_headerDataMap->getHeaderDataOrderByOffset());
+        }
+    }
+
+    if (m_formatTag >= PACKAGE_FORMAT_TAG_DICTIONARY)
+    {
+        unsigned int dictionary_byte_size = 0;
+        m_headerFile.read(reinterpret_cast<char*>(&dictionary_byte_size), sizeof(dictionary_byte_size));
+        m_dictionary.resize(dictionary_byte_size, 0);
+        if (dictionary_byte_size > 0)
+        {
+            m_headerFile.read(m_dictionary.data(), dictionary_byte_size);
+        }
+    }
+
+    m_headerSnapshotBytes = static_cast<std::uint64_t>(m_headerFile.tellg());
+    m_headerJournalBytes = 0;
+    if (m_formatTag >= PACKAGE_FORMAT_TAG_JOURNAL)
+    {
+        const std::vector<char> journal_buff{ std::istreambuf_iterator<char>(m_headerFile), std::istreambuf_iterator<char>() };
+        replayHeaderJournal(journal_buff);
+    }
+    m_headerFile.clear();
+    // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+error AssetPackageFile::appendHeaderJournal(const std::vector<char>& record_buff)
+{
+    // 舊格式的 header 後面不能接 journal; journal 太長時重開要 replay 太多筆, 都改成整份重寫
+    if ((m_formatTag < PACKAGE_FORMAT_TAG_JOURNAL)
+        || (m_headerJournalBytes + record_buff.size() > std::max(m_headerSnapshotBytes, JOURNAL_CHECKPOINT_MIN_BYTES))) return saveHeaderFile();
+
+    const auto locker = lockHeaderFile();
+    assert(m_headerFile.is_open());
+    m_headerFile.seekp(static_cast<std::streamoff>(m_headerSnapshotBytes + m_headerJournalBytes));
+    m_headerFile.write(record_buff.data(), static_cast<std::streamsize>(record_buff.size()));
+    m_headerFile.flush();
+    if (!m_headerFile) return ErrorCode::fileWriteFail;
+    m_headerJournalBytes += record_buff.size();
+    return ErrorCode::ok;
+}
+
+void AssetPackageFile::replayHeaderJournal(const std::vector<char>& journal_buff)
+{
+    size_t valid_bytes = 0;
+    const std::vector<AssetHeaderJournal::Record> records = AssetHeaderJournal::importRecords(journal_buff.data(), journal_buff.size(), valid_bytes);
+    m_headerJournalBytes = valid_bytes;
+    // 依寫入時的順序重做一次 add/remove 對 name list, header map, 去重複表, free space 的修改
+    for (const auto& record : records)
+    {
+        const AssetHeaderData& header_data = record.m_header;
+        if (record.m_type == AssetHeaderJournal::RecordType::removeAsset)
+        {
+            const auto removed_header = m_headerDataMap->tryGetHeaderData(header_data.m_name);
+            if (!removed_header) continue;
+            [[maybe_unused]] const error er = m_headerDataMap->removeHeaderData(header_data.m_name);
+            if (m_dedupTable->releaseReference(removed_header->m_offset) == 0) m_freeSpaceList->releaseSpace(removed_header->m_offset, removed_header->m_size);
+            if (m_assetCount > 0) m_assetCount--;
+            continue;
+        }
+        if (m_headerDataMap->hasAssetKey(header_data.m_name)) continue;
+        [[maybe_unused]] const error er = m_headerDataMap->insertHeaderData(header_data);
+        if (record.m_contentKey)
+        {
+            m_freeSpaceList->reserveSpace(header_data.m_offset, header_data.m_size);
+            m_dedupTable->insertContent(record.m_contentKey.value(), header_data);
+        }
+        else if (m_dedupTable->addReference(header_data.m_offset))
+        {
+            // 不是共用的內容, 才會佔用 bundle 空間
+            m_freeSpaceList->reserveSpace(header_data.m_offset, header_data.m_size);
+        }
+        m_assetCount++;
+    }
+}
+
+void AssetPackageFile::readLegacyHeaderSections()
+{
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+    // 0x04 之前的格式 : name list 區段 + header map 區段; header map 裡已經有名稱, name list 直接跳過
+    unsigned int name_list_byte_size = 0;
+    m_headerFile.read(reinterpret_cast<char*>(&name_list_byte_size), sizeof(name_list_byte_size));
+    m_headerFile.seekg(name_list_byte_size, std::fstream::cur);
 
     unsigned int header_byte_size = 0;
     m_headerFile.read(reinterpret_cast<char*>(&header_byte_size), sizeof(header_byte_size));
@@ -422,44 +1504,92 @@ void AssetPackageFile::readHeaderFile()
         m_headerFile.read(header_buff.data(), header_byte_size);
     }
     m_headerDataMap = std::make_unique<AssetHeaderDataMap>();
-    er = m_headerDataMap->importFromByteBuffer(header_buff);
+    [[maybe_unused]] const error er = m_headerDataMap->importFromByteBuffer(header_buff, m_formatTag);
     assert(!er);
     // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
 }
 
-std::tuple<std::vector<char>, unsigned int> AssetPackageFile::readBundleContent(unsigned int offset,
-    unsigned int content_size)
+std::tuple<std::vector<char>, std::uint64_t> AssetPackageFile::readBundleContent(std::uint64_t offset,
+    std::uint64_t content_size)
 {
-    assert(m_bundleFile.is_open());
-    const std::lock_guard<std::mutex> locker{ m_bundleFileLocker };
-    m_bundleFile.seekg(offset);
+    assert(m_bundleReader);
+    // positional read 不會動到 fstream 的 cursor, 所以讀取不用 bundle lock, 多執行緒可以同時讀
     std::vector<char> out_buff;
-    out_buff.resize(content_size, 0);
-    m_bundleFile.read(out_buff.data(), content_size);
-    if (!m_bundleFile) return { out_buff, 0 };
-    return { out_buff, static_cast<unsigned int>(m_bundleFile.tellg()) - offset };
+    out_buff.resize(static_cast<size_t>(content_size), 0);
+    const size_t read_bytes = m_bundleReader->readAt(offset, out_buff.data(), out_buff.size());
+    return { out_buff, read_bytes };
 }
 
-error AssetPackageFile::repackBundleContent(unsigned int content_size, unsigned int base_offset)
+const char* AssetPackageFile::tryReadBundleContent(std::uint64_t offset, std::uint64_t content_size, std::vector<char>& read_buff) const
 {
-    assert(m_bundleFile.is_open());
+    if (m_bundleMapping)
+    {
+        if ((offset > m_bundleMapping->size()) || (content_size > m_bundleMapping->size() - offset)) return nullptr;
+        return m_bundleMapping->data() + static_cast<size_t>(offset);
+    }
+    assert(m_bundleReader);
+    read_buff.resize(static_cast<size_t>(content_size));
+    if (m_bundleReader->readAt(offset, read_buff.data(), read_buff.size()) != content_size) return nullptr;
+    return read_buff.data();
+}
 
-    const std::lock_guard<std::mutex> locker{ m_bundleFileLocker };
-
-    m_bundleFile.seekp(0, std::fstream::end);
-    const auto bundle_org_size = m_bundleFile.tellp();
-    if (bundle_org_size == 0) return ErrorCode::fileSizeError;
-    std::vector<char> file_buff;
-    file_buff.resize(bundle_org_size, 0);
-    m_bundleFile.seekg(0);
-    m_bundleFile.read(file_buff.data(), bundle_org_size);
-    const auto read_bytes = m_bundleFile.tellg();
-    if (read_bytes != bundle_org_size) return ErrorCode::readSizeCheck;
-
-    file_buff.erase(file_buff.begin() + base_offset, file_buff.begin() + base_offset + content_size);
-    m_bundleFile.seekp(0);
-    m_bundleFile.write(file_buff.data(), static_cast<std::streamsize>(file_buff.size()));
-    m_bundleFile.flush();
+std::optional<std::vector<char>> AssetPackageFile::uncompressContent(const AssetHeaderData& header_data, const char* comp_data) const
+{
+    std::vector<char> buff;
+    buff.resize(static_cast<size_t>(header_data.m_orgSize), 0);
+    if (uncompressContentTo(header_data, comp_data, buff.data())) return std::nullopt;
+    return buff;
+}
+
+error AssetPackageFile::uncompressContentTo(const AssetHeaderData& header_data, const char* comp_data, char* out_data) const
+{
+    if (header_data.isSolidMember()) return copySolidMemberTo(header_data, comp_data, out_data);
+    if (m_accessStatistics) m_accessStatistics->recordRead(header_data.m_name, header_data.m_size);
+    if ((m_isVerifyOnRetrieve) && (header_data.m_hasCrc))
+    {
+        // 解壓之前先檢查, 壞掉的資料不會交給 decoder
+        if (AssetCrc32::compute(comp_data, static_cast<size_t>(header_data.m_size)) != header_data.m_crc) return ErrorCode::crcMismatch;
+    }
+    const auto decompress_begin = std::chrono::steady_clock::now();
+    error er;
+    if (header_data.m_blockSize > 0)
+    {
+        er = AssetCodec::uncompressSeekableContentTo(header_data.m_codec, header_data.m_blockSize, comp_data, header_data.m_size, out_data, header_data.m_orgSize, getCodecDictionary());
+    }
+    else
+    {
+        er = AssetCodec::uncompressContentTo(header_data.m_codec, comp_data, header_data.m_size, out_data, header_data.m_orgSize, getCodecDictionary());
+    }
+    // solid block 解壓時 header 的名稱是讀取的成員, 整個 block 的時間記在這個成員上
+    if ((m_accessStatistics) && (!er)) m_accessStatistics->recordDecompress(header_data.m_name, header_data.m_orgSize, std::chrono::steady_clock::now() - decompress_begin);
+    return er;
+}
+
+AssetContentCache::Content AssetPackageFile::tryGetSolidBlock(const AssetHeaderData& header_data, const char* comp_data) const
+{
+    const std::string block_key = std::to_string(header_data.m_offset);
+    if (auto block = m_solidBlockCache->tryGetContent(block_key)) return block;
+    std::vector<char> read_buff;
+    if (comp_data == nullptr) comp_data = tryReadBundleContent(header_data.m_offset, header_data.m_size, read_buff);
+    if (comp_data == nullptr) return nullptr;
+    // 整個 block 當成一個 asset 解壓, crc 也是整個 block 的
+    AssetHeaderData block_header = header_data;
+    block_header.m_orgSize = header_data.m_solidBlockSize;
+    block_header.m_solidOffset = 0;
+    block_header.m_solidBlockSize = 0;
+    auto buff = uncompressContent(block_header, comp_data);
+    if (!buff) return nullptr;
+    auto block = std::make_shared<const std::vector<char>>(std::move(buff.value()));
+    m_solidBlockCache->insertContent(block_key, block);
+    return block;
+}
+
+error AssetPackageFile::copySolidMemberTo(const AssetHeaderData& header_data, const char* comp_data, char* out_data) const
+{
+    const auto block = tryGetSolidBlock(header_data, comp_data);
+    if (!block) return ErrorCode::decompressFail;
+    if ((header_data.m_solidOffset > block->size()) || (header_data.m_orgSize > block->size() - header_data.m_solidOffset)) return ErrorCode::invalidHeaderData;
+    std::memcpy(out_data, block->data() + static_cast<size_t>(header_data.m_solidOffset), static_cast<size_t>(header_data.m_orgSize));
     return ErrorCode::ok;
 }
 
@@ -9,6 +9,9 @@
 #define ASSET_PACKAGE_FILE_HPP
 
 #include "AssetHeaderDataMap.hpp"
+#include "AssetCodec.hpp"
+#include "AssetContentCache.hpp"
+#include "AssetDedupTable.hpp"
 #include <system_error>
 #include <string>
 #include <fstream>
@@ -17,16 +20,35 @@
 #include <vector>
 #include <memory>
 #include <tuple>
+#include <utility>
+#include <cstdint>
 
 namespace AssetPackage
 {
-    class AssetNameList;
+    class AssetFreeSpaceList;
+    class AssetHeaderIndex;
+    class MappedFile;
+    class PositionalFile;
+    class AssetPackageBuilder;
+    class AssetRequestQueue;
+    class AssetAccessTrace;
+    class AssetAccessStatistics;
+    class AssetPackagePatch;
 
     using error = std::error_code;
     class AssetPackageFile
     {
+        friend class AssetPackageBuilder;
+        friend class AssetRequestQueue;
+        friend class AssetPackagePatch;
     public:
         constexpr static unsigned int VERSION_USE_FILE_TIME = 0;
+        /** 指到 bundle mapping 內的內容, 不複製也不解壓 */
+        struct ContentView
+        {
+            const char* m_data;
+            size_t m_size;
+        };
     public:
         AssetPackageFile(const AssetPackageFile&) = delete;
         AssetPackageFile(AssetPackageFile&&) = delete;
@@ -37,40 +59,178 @@ namespace AssetPackage
         const std::string& getBaseFilename() { return m_baseFilename; };
         static std::shared_ptr<AssetPackageFile> createNewPackage(const std::string& base_filename);
         static std::shared_ptr<AssetPackageFile> openPackage(const std::string& base_filename);
+        /** 以唯讀方式開啟, bundle 檔以 memory map 讀取, 多執行緒讀取不需要 bundle lock;
+         * header 檔也以 memory map 讀取, 查詢直接在 index 區段上做, 開啟時不用建 map */
+        static std::shared_ptr<AssetPackageFile> openPackageReadOnly(const std::string& base_filename);
+
+        [[nodiscard]] bool isReadOnly() const { return m_isReadOnly; }
+
+        /** 批次加入 asset, beginBatch 之後的 add/remove 只更新記憶體中的 header, commitBatch 時才寫一次 header 檔.
+         * batch 不能巢狀, 已經在 batch 中再 beginBatch 會回傳 batchInProgress.
+         * commitBatch 返回後的內容斷電也不會遺失; 不在 batch 中的單筆 add/remove 只保證 process crash 時不遺失 */
+        error beginBatch();
+        error commitBatch();
+        [[nodiscard]] bool isBatching() const { return m_isBatching; }
 
         error addAssetFile(const std::string& file_path, const std::string& asset_key, unsigned version);
         error addAssetMemory(const std::vector<char>& buff, const std::string& asset_key, unsigned version);
+        /** 指定這個 asset 的 codec, 沒有指定的版本用預設 level 的 zlib */
+        error addAssetFile(const std::string& file_path, const std::string& asset_key, unsigned version, AssetCodecId codec, int zlib_level = AssetCodec::DEFAULT_ZLIB_LEVEL);
+        error addAssetMemory(const std::vector<char>& buff, const std::string& asset_key, unsigned version, AssetCodecId codec, int zlib_level = AssetCodec::DEFAULT_ZLIB_LEVEL);
+        /** 以 seekable 格式加入, 每 block_size bytes 獨立壓縮, 之後可以只解壓需要的範圍 */
+        error addAssetMemorySeekable(const std::vector<char>& buff, const std::string& asset_key, unsigned version, AssetCodecId codec,
+            unsigned int block_size = AssetCodec::DEFAULT_SEEKABLE_BLOCK_SIZE, int zlib_level = AssetCodec::DEFAULT_ZLIB_LEVEL);
         error tryRetrieveAssetToFile(const std::string& file_path, const std::string& asset_key);
         std::optional<std::vector<char>> tryRetrieveAssetToMemory(const std::string& asset_key);
-        [[nodiscard]] unsigned getAssetOriginalSize(const std::string& asset_key) const;
+        /** 直接解壓到呼叫端的 buffer, buff_size 至少要 getAssetOriginalSize; 壓縮資料的暫存用 thread local buffer, 不另外配置 */
+        error tryRetrieveAssetToMemory(const std::string& asset_key, char* buff, size_t buff_size);
+        /** 一次讀取多個 asset: 依 bundle offset 排序, 間隔小的相鄰內容合併成一次讀取, 再由 worker threads 解壓.
+         * 結果依 asset_keys 的順序, 讀取失敗的是 nullopt; worker_count 為 0 時使用 hardware concurrency */
+        std::vector<std::optional<std::vector<char>>> tryRetrieveAssetsToMemory(const std::vector<std::string>& asset_keys, unsigned worker_count = 0);
+        /** 分段解壓, 每段最多 chunk_size bytes 交給 sink, 不會同時持有整個壓縮資料跟整個解壓結果; sink 回傳 false 時停止並回傳 streamAborted */
+        error tryRetrieveAssetStreaming(const std::string& asset_key, const AssetCodec::ContentSink& sink, size_t chunk_size = AssetCodec::DEFAULT_STREAM_CHUNK_SIZE);
+        /** 讀取解壓後 [offset, offset + size) 的內容, seekable asset 只解壓涵蓋的 block */
+        error tryRetrieveAssetRange(const std::string& asset_key, std::uint64_t offset, char* buff, size_t size);
+        /** 唯讀開啟時, stored (非 seekable) 的 asset 直接回傳 mapping 內的位置; 其他情況回傳 nullopt, 呼叫端改用一般的讀取.
+         * 內容在 package 關閉前有效; 有開 verify 時會先檢查 crc */
+        std::optional<ContentView> tryRetrieveAssetView(const std::string& asset_key);
+
+        /** 開啟後, 整個 asset 讀取時先檢查 bundle 內容的 crc (串流跟範圍讀取不檢查); 要在多執行緒開始讀取之前設定 */
+        void setVerifyOnRetrieve(bool is_verify) { m_isVerifyOnRetrieve = is_verify; }
+        [[nodiscard]] bool isVerifyOnRetrieve() const { return m_isVerifyOnRetrieve; }
+        /** 用 worker threads 檢查所有 asset 的 crc, 回傳 crc 不符或讀取失敗的 asset key; 沒有 crc 的舊 asset 不檢查 */
+        [[nodiscard]] std::vector<std::string> verifyPackage(unsigned worker_count = 0);
+        /** 有開 content cache 時先查 cache, 沒有開就跟 tryRetrieveAssetToMemory 一樣每次解壓; 回傳的內容是共用且不可修改的 */
+        AssetContentCache::Content tryRetrieveAssetShared(const std::string& asset_key);
+        /** cache 要在多執行緒開始讀取之前開關 */
+        void enableContentCache(std::uint64_t budget_bytes);
+        void disableContentCache();
+        [[nodiscard]] bool isContentCacheEnabled() const { return m_contentCache != nullptr; }
+        [[nodiscard]] std::optional<AssetContentCache::Statistics> getContentCacheStatistics() const;
+        /** solid block 解壓後的內容一律放在一個小的 cache, 同一個 block 的成員連續讀取只解壓一次 */
+        [[nodiscard]] AssetContentCache::Statistics getSolidBlockCacheStatistics() const;
+        [[nodiscard]] std::uint64_t getAssetOriginalSize(const std::string& asset_key) const;
         [[nodiscard]] time_t getAssetTimeStamp(const std::string& asset_key) const;
 
+        /** 只移除 header, bundle 內的空間記到 free space list, 之後加入的 asset 可以重複使用 */
         error removeAsset(const std::string& asset_key);
+        /** 依 offset 順序重寫 bundle, 去掉 bundle 內所有的空洞; 跟 relayoutBundle 一樣寫到暫存檔再換檔. 批次中回傳 batchInProgress, 不可跟讀取同時進行 */
+        error compact();
+        [[nodiscard]] std::uint64_t getFreeSpaceBytes() const;
+        /** 之後寫入的 stored (非 seekable) asset 起始 offset 對齊到 alignment (2 的次方, 0 或 1 表示不對齊), compact 跟 relayoutBundle 也會維持對齊;
+         * 對齊補的空間記到 free space list. 設定不存在 package 裡, 每次開啟後要重新設定 */
+        error setStoredAlignment(std::uint64_t alignment);
+        [[nodiscard]] std::uint64_t getStoredAlignment() const { return m_storedAlignment; }
+
+        /** 加入時以原始內容找重複, 相同內容的 asset 共用 bundle 空間 (預設開啟) */
+        void setDeduplication(bool is_deduplicating) { m_isDeduplicating = is_deduplicating; }
+        [[nodiscard]] bool isDeduplicating() const { return m_isDeduplicating; }
+        /** 共用內容省下的 bundle bytes */
+        [[nodiscard]] std::uint64_t getDeduplicatedBytes() const;
 
-        const std::unique_ptr<AssetNameList>& getAssetNameList() { return m_nameList; };
+        /** 記錄 asset 第一次讀取的順序, 給 relayoutBundle 用; 要在多執行緒開始讀取之前開關 */
+        void enableAccessTrace();
+        void disableAccessTrace();
+        [[nodiscard]] const std::unique_ptr<AssetAccessTrace>& getAccessTrace() const { return m_accessTrace; }
+        /** 依 access_order 的順序重寫 bundle, 一起讀取的 asset 放在相鄰位置; 不在 access_order 裡的 asset 依原本順序接在後面.
+         * 新的 bundle 跟 header 都寫到暫存檔再換檔, 原本的檔案不改寫, 中斷後開啟會是換檔前或換檔後其中一個完整的狀態;
+         * 同時也去掉所有空洞. 批次中回傳 batchInProgress, 不可跟讀取同時進行 */
+        error relayoutBundle(const std::vector<std::string>& access_order);
+
+        /** 記錄每個 asset 的讀取次數, 從 bundle 讀取的 bytes, 解壓時間跟 bundle/header file lock 的等待時間; 要在多執行緒開始讀取之前開關.
+         * 串流跟範圍讀取只記讀取的 bytes, 解壓時間包含 sink 的處理所以不記 */
+        void enableAccessStatistics();
+        void disableAccessStatistics();
+        [[nodiscard]] const std::unique_ptr<AssetAccessStatistics>& getAccessStatistics() const { return m_accessStatistics; }
+
+        /** zlibDictionary codec 用的共用 dictionary, 存在 header 檔; 已經有 asset 用 zlibDictionary 時不可以再換 */
+        error setCompressionDictionary(const std::vector<char>& dictionary);
+        [[nodiscard]] const std::vector<char>& getCompressionDictionary() const { return m_dictionary; }
+
+        [[nodiscard]] std::vector<std::string> getAssetKeys() const;
         [[nodiscard]] std::optional<AssetHeaderDataMap::AssetHeaderData> tryGetAssetHeaderData(const std::string& asset_key) const;
     private:
         AssetPackageFile();
         error createNewPackageImp(const std::string& base_filename);
         error openPackageImp(const std::string& base_filename);
+        error openPackageReadOnlyImp(const std::string& base_filename);
         void resetPackage();
 
-        void saveHeaderFile();
+        /** 整份 header 先寫到暫存檔再換檔, 寫到一半中斷不會留下不完整的 header 檔; 寫完 journal 歸零.
+         * 換檔前 bundle 跟暫存檔都會 sync 到儲存裝置, 斷電後也是一致的 */
+        error saveHeaderFile();
+        /** 目前的 header 整份寫到 file_path, 回傳寫入的 bytes; 呼叫端要持有 header lock */
+        std::tuple<error, std::uint64_t> writeHeaderSnapshot(const std::string& file_path);
+        /** 把 writeHeaderSnapshot 寫好的檔案換成 header 檔; 呼叫端要持有 header lock */
+        error replaceHeaderFile(const std::string& snapshot_filename, std::uint64_t snapshot_bytes);
+        /** 依序寫到暫存的 bundle 跟 header, 換 bundle 檔是 commit point, 之後再換 header */
+        error rewriteBundle(const std::vector<AssetHeaderDataMap::AssetHeaderData>& ordered_headers);
+        /** 開啟前處理 rewriteBundle 中斷留下的暫存檔: bundle 還沒換就丟掉, 換過了就把 header 也換過去 */
+        static error recoverBundleRewrite(const std::string& base_filename);
         void readHeaderFile();
+        void readLegacyHeaderSections();
+        /** 單筆修改只 append 一筆 journal record; journal 比 header 本身大時改成整份重寫.
+         * record 只 flush 到 OS 不 sync, 只保證 process crash 時不遺失; 斷電時最近的 record 可能遺失, 或指到沒寫入的 bundle 內容 */
+        error appendHeaderJournal(const std::vector<char>& record_buff);
+        void replayHeaderJournal(const std::vector<char>& journal_buff);
+
+        static unsigned int resolveAssetVersion(const std::string& file_path, unsigned version);
+        error addAssetContent(const std::vector<char>& buff, const std::string& asset_key, unsigned version, AssetCodecId codec, unsigned int block_size, int zlib_level);
+        /** header_data 要先填好 offset, size 以外的欄位 */
+        error appendCompressedContent(const std::vector<unsigned char>& comp_buff, AssetHeaderDataMap::AssetHeaderData header_data, const std::optional<AssetDedupTable::ContentKey>& content_key);
+        /** 多個小 asset 的原始內容串接成一個 block 一起壓縮寫入; block_header 填好 codec, crc, m_orgSize (block 解壓後的大小),
+         * members 填好名稱, 版本, m_orgSize, m_solidOffset. block 以 block_key 登記到去重複表, reference count 就是成員數 */
+        error appendSolidBlock(const std::vector<unsigned char>& comp_buff, const AssetHeaderDataMap::AssetHeaderData& block_header,
+            const AssetDedupTable::ContentKey& block_key, const std::vector<AssetHeaderDataMap::AssetHeaderData>& members);
+        /** 找不到相同內容時回傳 notExistedKey; codec 有指定時, 只共用 codec 跟 block size 都相同, 而且 offset 符合目前對齊的內容 */
+        error tryAppendSharedContent(const AssetDedupTable::ContentKey& content_key, const std::string& asset_key, unsigned version,
+            std::optional<AssetCodecId> codec, unsigned int block_size);
 
-        std::tuple<std::vector<char>, unsigned int> readBundleContent(unsigned int offset, unsigned int content_size);
-        error repackBundleContent(unsigned int content_size, unsigned int base_offset);
+        std::tuple<std::vector<char>, std::uint64_t> readBundleContent(std::uint64_t offset, std::uint64_t content_size);
+        /** 唯讀時直接回傳 mapping 內的指標, 不然讀到 read_buff; 讀不到回傳 nullptr */
+        const char* tryReadBundleContent(std::uint64_t offset, std::uint64_t content_size, std::vector<char>& read_buff) const;
+        std::optional<std::vector<char>> uncompressContent(const AssetHeaderDataMap::AssetHeaderData& header_data, const char* comp_data) const;
+        error uncompressContentTo(const AssetHeaderDataMap::AssetHeaderData& header_data, const char* comp_data, char* out_data) const;
+        /** 先查 block cache, 沒有的話解壓整個 block 再放進 cache; comp_data 是 nullptr 時自己讀取 block 的壓縮資料 */
+        AssetContentCache::Content tryGetSolidBlock(const AssetHeaderDataMap::AssetHeaderData& header_data, const char* comp_data) const;
+        error copySolidMemberTo(const AssetHeaderDataMap::AssetHeaderData& header_data, const char* comp_data, char* out_data) const;
+        bool verifyContentCrc(const AssetHeaderDataMap::AssetHeaderData& header_data, std::vector<char>& read_buff) const;
+        error streamAssetContent(const AssetHeaderDataMap::AssetHeaderData& header_data, std::uint64_t begin, std::uint64_t end, const AssetCodec::ContentSink& sink, size_t chunk_size);
+        void recordAccess(const std::string& asset_key) const;
+        /** 有開 access statistics 時記錄等待時間 */
+        [[nodiscard]] std::unique_lock<std::mutex> lockBundleFile();
+        [[nodiscard]] std::unique_lock<std::mutex> lockHeaderFile();
+        [[nodiscard]] AssetCodec::Dictionary getCodecDictionary() const { return { m_dictionary.data(), m_dictionary.size() }; }
+        [[nodiscard]] std::uint64_t getContentAlignment(const AssetHeaderDataMap::AssetHeaderData& header_data) const;
 
     private:
         unsigned int m_formatTag;
         unsigned int m_fileVersion;
         unsigned int m_assetCount;
-        std::unique_ptr<AssetNameList> m_nameList;
+        bool m_isReadOnly;
+        bool m_isBatching;
+        bool m_isVerifyOnRetrieve;
+        bool m_isDeduplicating;
+        std::uint64_t m_storedAlignment;
         std::unique_ptr<AssetHeaderDataMap> m_headerDataMap;
+        std::unique_ptr<AssetFreeSpaceList> m_freeSpaceList;
+        std::unique_ptr<AssetDedupTable> m_dedupTable;
+        std::unique_ptr<MappedFile> m_headerMapping;
+        std::unique_ptr<AssetHeaderIndex> m_headerIndex;
+        std::unique_ptr<AssetContentCache> m_contentCache;
+        std::unique_ptr<AssetContentCache> m_solidBlockCache;  ///< key 是 block 的 bundle offset
+        std::unique_ptr<AssetAccessTrace> m_accessTrace;
+        std::unique_ptr<AssetAccessStatistics> m_accessStatistics;
+        std::vector<char> m_dictionary;
+        std::uint64_t m_headerSnapshotBytes;  ///< header 檔中 journal 之前的部分
+        std::uint64_t m_headerJournalBytes;
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> m_batchReleasedSpaces;  ///< 批次中移除的內容, commit 之後才能重複使用
 
         std::string m_baseFilename;
         std::fstream m_headerFile;
         std::fstream m_bundleFile;
+        std::unique_ptr<MappedFile> m_bundleMapping;
+        std::unique_ptr<PositionalFile> m_bundleReader;
 
         std::mutex m_headerFileLocker;
         std::mutex m_bundleFileLocker;
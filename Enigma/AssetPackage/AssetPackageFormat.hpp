@@ -0,0 +1,26 @@
+﻿/*****************************************************************
+ * \file   AssetPackageFormat.hpp
+ * \brief  package 檔案格式的版本 tag, 讀取時要支援所有舊版本
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_PACKAGE_FORMAT_HPP
+#define ASSET_PACKAGE_FORMAT_HPP
+
+namespace AssetPackage
+{
+    constexpr unsigned int PACKAGE_FORMAT_TAG_ORIGINAL = 0x01;
+    constexpr unsigned int PACKAGE_FORMAT_TAG_FREE_SPACE = 0x02;  ///< header 檔加上 free space list
+    constexpr unsigned int PACKAGE_FORMAT_TAG_WIDE_OFFSET = 0x03;  ///< offset, size 改為 64 bits
+    constexpr unsigned int PACKAGE_FORMAT_TAG_SORTED_INDEX = 0x04;  ///< name list + header map 改為排序的 index 區段
+    constexpr unsigned int PACKAGE_FORMAT_TAG_CODEC = 0x05;  ///< index record 加上每個 asset 的 codec id 跟 seekable block size
+    constexpr unsigned int PACKAGE_FORMAT_TAG_CRC = 0x06;  ///< crc32 改為 bundle 內容的實際值, 有沒有算記在 record 的 flag
+    constexpr unsigned int PACKAGE_FORMAT_TAG_DEDUP = 0x07;  ///< header 檔加上去重複表
+    constexpr unsigned int PACKAGE_FORMAT_TAG_DICTIONARY = 0x08;  ///< header 檔加上 zlibDictionary 共用的 dictionary
+    constexpr unsigned int PACKAGE_FORMAT_TAG_JOURNAL = 0x09;  ///< header 檔尾端可以接 journal record, 單筆修改不再改寫整個 header
+    constexpr unsigned int PACKAGE_FORMAT_TAG_SOLID_BLOCK = 0x0A;  ///< index record 加上 solid block 內的位置跟 block 解壓後的大小
+    constexpr unsigned int PACKAGE_FORMAT_TAG = PACKAGE_FORMAT_TAG_SOLID_BLOCK;
+}
+
+#endif // ASSET_PACKAGE_FORMAT_HPP
@@ -0,0 +1,164 @@
+﻿#include "AssetPackageOverlay.hpp"
+#include "AssetPackageFile.hpp"
+#include "AssetPackageErrors.hpp"
+#include <algorithm>
+
+using namespace AssetPackage;
+
+AssetPackageOverlay::AssetPackageOverlay() : m_nextMountSequence(0)
+{
+}
+
+AssetPackageOverlay::~AssetPackageOverlay() noexcept
+{
+    unmountAll();
+}
+
+error AssetPackageOverlay::mountPackage(const std::shared_ptr<AssetPackageFile>& package, int priority)
+{
+    if (!package) return ErrorCode::fileOpenFail;
+    const bool is_mounted = std::any_of(m_layers.begin(), m_layers.end(), [&package](const Layer& layer) { return layer.m_package == package; });
+    if (is_mounted) return ErrorCode::duplicatedKey;
+    const Layer layer{ package, priority, m_nextMountSequence++ };
+    const auto position = std::upper_bound(m_layers.begin(), m_layers.end(), layer, [](const Layer& a, const Layer& b)
+        {
+            return (a.m_priority < b.m_priority) || ((a.m_priority == b.m_priority) && (a.m_mountSequence < b.m_mountSequence));
+        });
+    const bool is_top_layer = (position == m_layers.end());
+    m_layers.insert(position, layer);
+    // 一般是由下往上依序 mount, 新的一層直接蓋上去就好; 插到中間時下層的 key 可能被蓋住, 整個重建
+    if (is_top_layer)
+    {
+        mergeLayerKeys(m_layers.back());
+    }
+    else
+    {
+        rebuildLookup();
+    }
+    return ErrorCode::ok;
+}
+
+error AssetPackageOverlay::unmountPackage(const std::shared_ptr<AssetPackageFile>& package)
+{
+    const auto it = std::find_if(m_layers.begin(), m_layers.end(), [&package](const Layer& layer) { return layer.m_package == package; });
+    if (it == m_layers.end()) return ErrorCode::notExistedKey;
+    m_layers.erase(it);
+    // 被這層蓋住的 key 要回到下層
+    rebuildLookup();
+    return ErrorCode::ok;
+}
+
+void AssetPackageOverlay::unmountAll()
+{
+    m_lookup.clear();
+    m_layers.clear();
+}
+
+void AssetPackageOverlay::rebuildLookup()
+{
+    m_lookup.clear();
+    for (const auto& layer : m_layers)
+    {
+        mergeLayerKeys(layer);
+    }
+}
+
+void AssetPackageOverlay::mergeLayerKeys(const Layer& layer)
+{
+    const auto asset_names = layer.m_package->getAssetKeys();
+    m_lookup.reserve(m_lookup.size() + asset_names.size());
+    for (const auto& asset_name : asset_names)
+    {
+        m_lookup.insert_or_assign(asset_name, layer.m_package);
+    }
+}
+
+std::vector<std::string> AssetPackageOverlay::getAssetKeys() const
+{
+    std::vector<std::string> asset_keys;
+    asset_keys.reserve(m_lookup.size());
+    for (const auto& [asset_key, package] : m_lookup)
+    {
+        asset_keys.push_back(asset_key);
+    }
+    return asset_keys;
+}
+
+bool AssetPackageOverlay::hasAssetKey(const std::string& asset_key) const
+{
+    return m_lookup.find(asset_key) != m_lookup.end();
+}
+
+std::shared_ptr<AssetPackageFile> AssetPackageOverlay::tryFindPackage(const std::string& asset_key) const
+{
+    const auto it = m_lookup.find(asset_key);
+    if (it == m_lookup.end()) return nullptr;
+    return it->second;
+}
+
+std::optional<AssetHeaderDataMap::AssetHeaderData> AssetPackageOverlay::tryGetAssetHeaderData(const std::string& asset_key) const
+{
+    const auto it = m_lookup.find(asset_key);
+    if (it == m_lookup.end()) return std::nullopt;
+    return it->second->tryGetAssetHeaderData(asset_key);
+}
+
+std::optional<std::vector<char>> AssetPackageOverlay::tryRetrieveAssetToMemory(const std::string& asset_key)
+{
+    const auto it = m_lookup.find(asset_key);
+    if (it == m_lookup.end()) return std::nullopt;
+    return it->second->tryRetrieveAssetToMemory(asset_key);
+}
+
+error AssetPackageOverlay::tryRetrieveAssetToMemory(const std::string& asset_key, char* buff, size_t buff_size)
+{
+    const auto it = m_lookup.find(asset_key);
+    if (it == m_lookup.end()) return ErrorCode::notExistedKey;
+    return it->second->tryRetrieveAssetToMemory(asset_key, buff, buff_size);
+}
+
+std::vector<std::optional<std::vector<char>>> AssetPackageOverlay::tryRetrieveAssetsToMemory(const std::vector<std::string>& asset_keys, unsigned worker_count)
+{
+    std::vector<std::optional<std::vector<char>>> results(asset_keys.size());
+    // package -> 這個 package 要讀的 key 跟在 asset_keys 的位置
+    std::unordered_map<AssetPackageFile*, std::pair<std::vector<std::string>, std::vector<size_t>>> package_requests;
+    for (size_t i = 0; i < asset_keys.size(); i++)
+    {
+        const auto it = m_lookup.find(asset_keys[i]);
+        if (it == m_lookup.end()) continue;
+        auto& [package_keys, key_indices] = package_requests[it->second.get()];
+        package_keys.push_back(asset_keys[i]);
+        key_indices.push_back(i);
+    }
+    for (auto& [package, request] : package_requests)
+    {
+        auto& [package_keys, key_indices] = request;
+        auto package_results = package->tryRetrieveAssetsToMemory(package_keys, worker_count);
+        for (size_t i = 0; i < key_indices.size(); i++)
+        {
+            results[key_indices[i]] = std::move(package_results[i]);
+        }
+    }
+    return results;
+}
+
+error AssetPackageOverlay::tryRetrieveAssetStreaming(const std::string& asset_key, const AssetCodec::ContentSink& sink, size_t chunk_size)
+{
+    const auto it = m_lookup.find(asset_key);
+    if (it == m_lookup.end()) return ErrorCode::notExistedKey;
+    return it->second->tryRetrieveAssetStreaming(asset_key, sink, chunk_size);
+}
+
+AssetContentCache::Content AssetPackageOverlay::tryRetrieveAssetShared(const std::string& asset_key)
+{
+    const auto it = m_lookup.find(asset_key);
+    if (it == m_lookup.end()) return nullptr;
+    return it->second->tryRetrieveAssetShared(asset_key);
+}
+
+std::optional<AssetPackageFile::ContentView> AssetPackageOverlay::tryRetrieveAssetView(const std::string& asset_key)
+{
+    const auto it = m_lookup.find(asset_key);
+    if (it == m_lookup.end()) return std::nullopt;
+    return it->second->tryRetrieveAssetView(asset_key);
+}
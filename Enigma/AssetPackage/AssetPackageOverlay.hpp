@@ -0,0 +1,77 @@
+﻿/*****************************************************************
+ * \file   AssetPackageOverlay.hpp
+ * \brief  把多個 package 疊成一個 (base + patch + DLC), 上層的 asset 蓋過下層同名的 asset
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_PACKAGE_OVERLAY_HPP
+#define ASSET_PACKAGE_OVERLAY_HPP
+
+#include "AssetCodec.hpp"
+#include "AssetContentCache.hpp"
+#include "AssetHeaderDataMap.hpp"
+#include "AssetPackageFile.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class AssetPackageOverlay
+    {
+    public:
+        AssetPackageOverlay();
+        AssetPackageOverlay(const AssetPackageOverlay&) = delete;
+        AssetPackageOverlay(AssetPackageOverlay&&) = delete;
+        ~AssetPackageOverlay() noexcept;
+
+        AssetPackageOverlay& operator=(const AssetPackageOverlay&) = delete;
+        AssetPackageOverlay& operator=(AssetPackageOverlay&&) = delete;
+
+        /** priority 大的在上層, 相同 priority 時後 mount 的在上層; mount 時合併到查詢表, 查詢不用逐層找.
+         * mount, unmount 不可跟讀取同時進行 */
+        error mountPackage(const std::shared_ptr<AssetPackageFile>& package, int priority);
+        error unmountPackage(const std::shared_ptr<AssetPackageFile>& package);
+        void unmountAll();
+        /** mount 之後 package 有新增或移除 asset 時要重建查詢表 */
+        void rebuildLookup();
+
+        [[nodiscard]] size_t getLayerCount() const { return m_layers.size(); }
+        [[nodiscard]] size_t getAssetCount() const { return m_lookup.size(); }
+        /** 合併後所有的 asset key, 順序不固定 */
+        [[nodiscard]] std::vector<std::string> getAssetKeys() const;
+        [[nodiscard]] bool hasAssetKey(const std::string& asset_key) const;
+        /** asset 實際所在的 package (最上層的那個) */
+        [[nodiscard]] std::shared_ptr<AssetPackageFile> tryFindPackage(const std::string& asset_key) const;
+        [[nodiscard]] std::optional<AssetHeaderDataMap::AssetHeaderData> tryGetAssetHeaderData(const std::string& asset_key) const;
+
+        std::optional<std::vector<char>> tryRetrieveAssetToMemory(const std::string& asset_key);
+        error tryRetrieveAssetToMemory(const std::string& asset_key, char* buff, size_t buff_size);
+        /** 依所在的 package 分組, 每個 package 一次批次讀取 */
+        std::vector<std::optional<std::vector<char>>> tryRetrieveAssetsToMemory(const std::vector<std::string>& asset_keys, unsigned worker_count = 0);
+        error tryRetrieveAssetStreaming(const std::string& asset_key, const AssetCodec::ContentSink& sink, size_t chunk_size = AssetCodec::DEFAULT_STREAM_CHUNK_SIZE);
+        AssetContentCache::Content tryRetrieveAssetShared(const std::string& asset_key);
+        std::optional<AssetPackageFile::ContentView> tryRetrieveAssetView(const std::string& asset_key);
+
+    private:
+        struct Layer
+        {
+            std::shared_ptr<AssetPackageFile> m_package;
+            int m_priority;
+            unsigned int m_mountSequence;
+        };
+        void mergeLayerKeys(const Layer& layer);
+
+    private:
+        std::vector<Layer> m_layers;  ///< 由下層往上層排序
+        unsigned int m_nextMountSequence;
+        std::unordered_map<std::string, std::shared_ptr<AssetPackageFile>> m_lookup;  ///< asset key -> 最上層有這個 key 的 package
+    };
+}
+
+#endif // ASSET_PACKAGE_OVERLAY_HPP
@@ -0,0 +1,209 @@
+﻿#include "AssetPackagePatch.hpp"
+#include "AssetPackageFile.hpp"
+#include "AssetPackageErrors.hpp"
+#include <algorithm>
+#include <unordered_set>
+
+using namespace AssetPackage;
+
+using AssetHeaderData = AssetHeaderDataMap::AssetHeaderData;
+
+static std::vector<std::string> getSortedAssetKeys(const std::shared_ptr<AssetPackageFile>& package)
+{
+    std::vector<std::string> asset_keys = package->getAssetKeys();
+    asset_keys.erase(std::remove(asset_keys.begin(), asset_keys.end(), AssetPackagePatch::REMOVED_ASSETS_KEY), asset_keys.end());
+    // 排序後 patch 的內容才是固定的
+    std::sort(asset_keys.begin(), asset_keys.end());
+    return asset_keys;
+}
+
+static bool isContentChanged(const AssetHeaderData& old_header, const AssetHeaderData& new_header)
+{
+    if ((old_header.m_version != new_header.m_version) || (old_header.m_orgSize != new_header.m_orgSize) || (old_header.m_size != new_header.m_size)) return true;
+    if ((old_header.m_codec != new_header.m_codec) || (old_header.m_blockSize != new_header.m_blockSize)) return true;
+    // 沒有 crc 的舊 asset 只能靠 version 跟大小判斷
+    if (old_header.m_hasCrc != new_header.m_hasCrc) return true;
+    return (old_header.m_hasCrc) && (old_header.m_crc != new_header.m_crc);
+}
+
+/** solid block 成員的 crc, 大小是整個 block 的, 同一個 block 的其他成員改了也會不同, 要比較解壓後的內容 */
+static bool isSolidMemberChanged(const std::shared_ptr<AssetPackageFile>& old_package, const std::shared_ptr<AssetPackageFile>& new_package,
+    const std::string& asset_key, const AssetHeaderData& old_header, const AssetHeaderData& new_header)
+{
+    if ((old_header.m_version != new_header.m_version) || (old_header.m_orgSize != new_header.m_orgSize)) return true;
+    const auto old_content = old_package->tryRetrieveAssetToMemory(asset_key);
+    const auto new_content = new_package->tryRetrieveAssetToMemory(asset_key);
+    return (!old_content) || (!new_content) || (old_content.value() != new_content.value());
+}
+
+static bool isUsingDictionary(const std::shared_ptr<AssetPackageFile>& package, const std::vector<std::string>& asset_keys)
+{
+    return std::any_of(asset_keys.begin(), asset_keys.end(), [&package](const std::string& asset_key)
+        {
+            const auto header = package->tryGetAssetHeaderData(asset_key);
+            return (header) && (header->m_codec == AssetCodecId::zlibDictionary);
+        });
+}
+
+AssetPackagePatch::PatchSummary AssetPackagePatch::diffPackages(const std::shared_ptr<AssetPackageFile>& old_package, const std::shared_ptr<AssetPackageFile>& new_package)
+{
+    PatchSummary summary{ {}, {}, {}, 0 };
+    for (const auto& asset_key : getSortedAssetKeys(new_package))
+    {
+        const auto new_header = new_package->tryGetAssetHeaderData(asset_key);
+        if (!new_header) continue;
+        const auto old_header = old_package->tryGetAssetHeaderData(asset_key);
+        if (!old_header)
+        {
+            summary.m_addedKeys.push_back(asset_key);
+        }
+        else if ((old_header->isSolidMember()) && (new_header->isSolidMember())
+            ? isSolidMemberChanged(old_package, new_package, asset_key, old_header.value(), new_header.value())
+            : isContentChanged(old_header.value(), new_header.value()))
+        {
+            summary.m_changedKeys.push_back(asset_key);
+        }
+        else
+        {
+            continue;
+        }
+        summary.m_contentBytes += new_header->isSolidMember() ? new_header->m_orgSize : new_header->m_size;
+    }
+    for (const auto& asset_key : getSortedAssetKeys(old_package))
+    {
+        if (!new_package->tryGetAssetHeaderData(asset_key)) summary.m_removedKeys.push_back(asset_key);
+    }
+    return summary;
+}
+
+error AssetPackagePatch::createPatch(const std::shared_ptr<AssetPackageFile>& old_package, const std::shared_ptr<AssetPackageFile>& new_package,
+    const std::shared_ptr<AssetPackageFile>& patch_package)
+{
+    if ((!old_package) || (!new_package) || (!patch_package)) return ErrorCode::fileOpenFail;
+    if (patch_package->isReadOnly()) return ErrorCode::readOnlyPackage;
+    const PatchSummary summary = diffPackages(old_package, new_package);
+    std::vector<std::string> patch_keys = summary.m_changedKeys;
+    patch_keys.insert(patch_keys.end(), summary.m_addedKeys.begin(), summary.m_addedKeys.end());
+    if (isUsingDictionary(new_package, patch_keys))
+    {
+        // 用 dictionary 壓縮的內容直接複製, patch 要帶著同一份 dictionary
+        if (const error er = patch_package->setCompressionDictionary(new_package->getCompressionDictionary())) return er;
+    }
+
+    // 呼叫端已經開了 batch 就併進去, 由呼叫端 commit
+    const bool is_owning_batch = !patch_package->isBatching();
+    error er = ErrorCode::ok;
+    if (is_owning_batch) er = patch_package->beginBatch();
+    if (er) return er;
+    for (const auto& asset_key : patch_keys)
+    {
+        er = copyCompressedAsset(new_package, asset_key, patch_package);
+        if (er) break;
+    }
+    if ((!er) && (!summary.m_removedKeys.empty()))
+    {
+        std::vector<char> removed_buff;
+        for (const auto& asset_key : summary.m_removedKeys)
+        {
+            removed_buff.insert(removed_buff.end(), asset_key.begin(), asset_key.end());
+            removed_buff.push_back('\n');
+        }
+        er = patch_package->addAssetMemory(removed_buff, REMOVED_ASSETS_KEY, 1);
+    }
+    if (!is_owning_batch) return er;
+    const error er_commit = patch_package->commitBatch();
+    if (er) return er;
+    return er_commit;
+}
+
+error AssetPackagePatch::applyPatch(const std::shared_ptr<AssetPackageFile>& target_package, const std::shared_ptr<AssetPackageFile>& patch_package)
+{
+    if ((!target_package) || (!patch_package)) return ErrorCode::fileOpenFail;
+    if (target_package->isReadOnly()) return ErrorCode::readOnlyPackage;
+    std::vector<std::string> removed_keys;
+    if (patch_package->tryGetAssetHeaderData(REMOVED_ASSETS_KEY))
+    {
+        const auto removed_buff = patch_package->tryRetrieveAssetToMemory(REMOVED_ASSETS_KEY);
+        if (!removed_buff) return ErrorCode::decompressFail;
+        std::string asset_key;
+        for (const char c : removed_buff.value())
+        {
+            if (c != '\n')
+            {
+                asset_key.push_back(c);
+                continue;
+            }
+            if (!asset_key.empty()) removed_keys.push_back(asset_key);
+            asset_key.clear();
+        }
+    }
+    const std::vector<std::string> patch_keys = getSortedAssetKeys(patch_package);
+
+    // 換 dictionary 前先確認 target 留下來的 asset 沒有在用舊的, 不然套用到一半才失敗
+    const bool is_replacing_dictionary = (isUsingDictionary(patch_package, patch_keys))
+        && (target_package->getCompressionDictionary() != patch_package->getCompressionDictionary());
+    if (is_replacing_dictionary)
+    {
+        std::unordered_set<std::string> replaced_keys{ removed_keys.begin(), removed_keys.end() };
+        replaced_keys.insert(patch_keys.begin(), patch_keys.end());
+        for (const auto& asset_key : getSortedAssetKeys(target_package))
+        {
+            if (replaced_keys.count(asset_key) > 0) continue;
+            const auto header = target_package->tryGetAssetHeaderData(asset_key);
+            if ((header) && (header->m_codec == AssetCodecId::zlibDictionary)) return ErrorCode::dictionaryInUse;
+        }
+    }
+
+    const bool is_owning_batch = !target_package->isBatching();
+    error er = ErrorCode::ok;
+    if (is_owning_batch) er = target_package->beginBatch();
+    if (er) return er;
+    // 先移除, 釋放的空間可以給新的內容用
+    for (const auto& asset_key : removed_keys)
+    {
+        if (!target_package->tryGetAssetHeaderData(asset_key)) continue;
+        er = target_package->removeAsset(asset_key);
+        if (er) break;
+    }
+    for (size_t i = 0; (!er) && (i < patch_keys.size()); i++)
+    {
+        if (!target_package->tryGetAssetHeaderData(patch_keys[i])) continue;
+        er = target_package->removeAsset(patch_keys[i]);
+    }
+    if ((!er) && (is_replacing_dictionary))
+    {
+        er = target_package->setCompressionDictionary(patch_package->getCompressionDictionary());
+    }
+    for (size_t i = 0; (!er) && (i < patch_keys.size()); i++)
+    {
+        er = copyCompressedAsset(patch_package, patch_keys[i], target_package);
+    }
+    if (!is_owning_batch) return er;
+    // 失敗前已做的修改還是要 commit, header 才會跟 bundle 一致
+    const error er_commit = target_package->commitBatch();
+    if (er) return er;
+    return er_commit;
+}
+
+error AssetPackagePatch::copyCompressedAsset(const std::shared_ptr<AssetPackageFile>& source_package, const std::string& asset_key,
+    const std::shared_ptr<AssetPackageFile>& target_package)
+{
+    const auto header_data = source_package->tryGetAssetHeaderData(asset_key);
+    if (!header_data) return ErrorCode::notExistedKey;
+    if (header_data->isSolidMember())
+    {
+        // solid block 的成員只取出自己的內容重新壓縮, 不複製整個 block
+        // 用 block 的 codec 重新壓縮; target 去重複時只會共用相同 codec 寫入的內容
+        const auto buff = source_package->tryRetrieveAssetToMemory(asset_key);
+        if (!buff) return ErrorCode::decompressFail;
+        return target_package->addAssetContent(buff.value(), asset_key, header_data->m_version, header_data->m_codec, 0, AssetCodec::DEFAULT_ZLIB_LEVEL);
+    }
+    std::vector<char> read_buff;
+    const char* comp_data = source_package->tryReadBundleContent(header_data->m_offset, header_data->m_size, read_buff);
+    if (comp_data == nullptr) return ErrorCode::readSizeCheck;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* comp_begin = reinterpret_cast<const unsigned char*>(comp_data);
+    const std::vector<unsigned char> comp_buff{ comp_begin, comp_begin + header_data->m_size };
+    // 沒有原始內容, 不算 content key, 這些 asset 不參與去重複
+    return target_package->appendCompressedContent(comp_buff, header_data.value(), std::nullopt);
+}
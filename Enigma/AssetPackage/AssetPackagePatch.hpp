@@ -0,0 +1,51 @@
+﻿/*****************************************************************
+ * \file   AssetPackagePatch.hpp
+ * \brief  兩個版本 package 的差異, patch 本身也是一個 package, 只有變更跟新增的 asset 加上移除清單
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_PACKAGE_PATCH_HPP
+#define ASSET_PACKAGE_PATCH_HPP
+
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    class AssetPackageFile;
+
+    using error = std::error_code;
+    class AssetPackagePatch
+    {
+    public:
+        /** 移除清單存成 patch package 裡的這個 asset, 一行一個 key */
+        constexpr static const char* REMOVED_ASSETS_KEY = "$patch/removed_assets";
+
+        struct PatchSummary
+        {
+            std::vector<std::string> m_changedKeys;
+            std::vector<std::string> m_addedKeys;
+            std::vector<std::string> m_removedKeys;
+            std::uint64_t m_contentBytes;  ///< 變更跟新增的 asset 壓縮後的大小, solid block 的成員以原始大小計
+        };
+
+        /** 以 key 比對, version 不同, 或 crc, 大小, codec 不同的算變更 */
+        [[nodiscard]] static PatchSummary diffPackages(const std::shared_ptr<AssetPackageFile>& old_package, const std::shared_ptr<AssetPackageFile>& new_package);
+        /** patch_package 要是新建的空 package; 壓縮過的內容直接複製, 不重新壓縮.
+         * createPatch, applyPatch 寫入的 package 已經在 batch 中時併入該 batch, 由呼叫端 commit */
+        static error createPatch(const std::shared_ptr<AssetPackageFile>& old_package, const std::shared_ptr<AssetPackageFile>& new_package,
+            const std::shared_ptr<AssetPackageFile>& patch_package);
+        /** 讀寫量只跟 patch 大小有關: 移除的空間記到 free space list 給新內容用, header 只寫一次 */
+        static error applyPatch(const std::shared_ptr<AssetPackageFile>& target_package, const std::shared_ptr<AssetPackageFile>& patch_package);
+
+    private:
+        static error copyCompressedAsset(const std::shared_ptr<AssetPackageFile>& source_package, const std::string& asset_key,
+            const std::shared_ptr<AssetPackageFile>& target_package);
+    };
+}
+
+#endif // ASSET_PACKAGE_PATCH_HPP
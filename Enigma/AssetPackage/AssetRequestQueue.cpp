@@ -0,0 +1,268 @@
+﻿#include "AssetRequestQueue.hpp"
+#include "AssetPackageFile.hpp"
+#include "AssetPackageErrors.hpp"
+#include <algorithm>
+#include <cassert>
+
+using namespace AssetPackage;
+
+constexpr unsigned int PRIORITY_LEVEL_COUNT = static_cast<unsigned int>(AssetRequestQueue::Priority::high) + 1;
+
+AssetRequestQueue::AssetRequestQueue(const std::shared_ptr<AssetPackageFile>& package, unsigned worker_count)
+    : m_package(package), m_isStopping(false), m_isPaused(false), m_nextRequestId(INVALID_REQUEST_ID + 1), m_statistics{ 0, 0, 0, 0 }
+{
+    assert(m_package);
+    if (worker_count == 0) worker_count = std::max(1u, std::thread::hardware_concurrency());
+    m_workers.reserve(worker_count);
+    for (unsigned i = 0; i < worker_count; i++)
+    {
+        m_workers.emplace_back([this]() { workerProc(); });
+    }
+}
+
+AssetRequestQueue::~AssetRequestQueue() noexcept
+{
+    {
+        const std::lock_guard<std::mutex> lock{ m_queueLocker };
+        m_isStopping = true;
+    }
+    m_queueReady.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+    // worker 都結束了, 剩下的 request 不會再被領走
+    cancelAllRequests();
+}
+
+AssetRequestQueue::RequestId AssetRequestQueue::requestAsset(const std::string& asset_key, Priority priority, const Completion& completion)
+{
+    return enqueueRequest(asset_key, priority, completion, std::nullopt);
+}
+
+AssetRequestQueue::FutureRequest AssetRequestQueue::requestAsset(const std::string& asset_key, Priority priority)
+{
+    std::promise<Result> promise;
+    std::future<Result> future = promise.get_future();
+    const RequestId request_id = enqueueRequest(asset_key, priority, nullptr, std::move(promise));
+    return { request_id, std::move(future) };
+}
+
+AssetRequestQueue::RequestId AssetRequestQueue::enqueueRequest(const std::string& asset_key, Priority priority, Completion completion, std::optional<std::promise<Result>> promise)
+{
+    // header 在呼叫端的 thread 先查好, worker 領取時才能依 offset 合併
+    PendingRequest request{ INVALID_REQUEST_ID, asset_key, { 0, INVALID_REQUEST_ID }, std::nullopt, std::move(completion), std::move(promise) };
+    if (!asset_key.empty()) request.m_header = m_package->tryGetAssetHeaderData(asset_key);
+    // trace 記的是送出 request 的順序, 跟 worker 完成的先後無關
+    if (request.m_header) m_package->recordAccess(asset_key);
+    const unsigned int priority_level = std::min(static_cast<unsigned int>(priority), PRIORITY_LEVEL_COUNT - 1);
+    RequestId request_id = INVALID_REQUEST_ID;
+    {
+        const std::lock_guard<std::mutex> lock{ m_queueLocker };
+        request_id = m_nextRequestId++;
+        request.m_id = request_id;
+        request.m_priorityKey = { PRIORITY_LEVEL_COUNT - 1 - priority_level, request_id };
+        m_priorityOrder.insert(request.m_priorityKey);
+        if (request.m_header) m_offsetOrder.emplace(request.m_header->m_offset, request_id);
+        m_pendingRequests.emplace(request_id, std::move(request));
+    }
+    m_queueReady.notify_one();
+    return request_id;
+}
+
+bool AssetRequestQueue::cancelRequest(RequestId request_id)
+{
+    std::optional<PendingRequest> request;
+    {
+        const std::lock_guard<std::mutex> lock{ m_queueLocker };
+        request = takePendingRequest(request_id);
+        if (request) m_statistics.m_canceledCount++;
+    }
+    if (!request) return false;
+    completeRequest(request.value(), { ErrorCode::requestCanceled, nullptr });
+    return true;
+}
+
+void AssetRequestQueue::cancelAllRequests()
+{
+    std::vector<PendingRequest> requests;
+    {
+        const std::lock_guard<std::mutex> lock{ m_queueLocker };
+        requests.reserve(m_pendingRequests.size());
+        while (!m_priorityOrder.empty())
+        {
+            requests.push_back(std::move(takePendingRequest(m_priorityOrder.begin()->second).value()));
+        }
+        m_statistics.m_canceledCount += requests.size();
+    }
+    // callback 可能再送 request 進來, 不可以在 lock 內呼叫
+    for (auto& request : requests)
+    {
+        completeRequest(request, { ErrorCode::requestCanceled, nullptr });
+    }
+}
+
+void AssetRequestQueue::pause()
+{
+    const std::lock_guard<std::mutex> lock{ m_queueLocker };
+    m_isPaused = true;
+}
+
+void AssetRequestQueue::resume()
+{
+    {
+        const std::lock_guard<std::mutex> lock{ m_queueLocker };
+        m_isPaused = false;
+    }
+    m_queueReady.notify_all();
+}
+
+size_t AssetRequestQueue::getPendingCount() const
+{
+    const std::lock_guard<std::mutex> lock{ m_queueLocker };
+    return m_pendingRequests.size();
+}
+
+AssetRequestQueue::Statistics AssetRequestQueue::getStatistics() const
+{
+    const std::lock_guard<std::mutex> lock{ m_queueLocker };
+    return m_statistics;
+}
+
+std::optional<AssetRequestQueue::PendingRequest> AssetRequestQueue::takePendingRequest(RequestId request_id)
+{
+    const auto it = m_pendingRequests.find(request_id);
+    if (it == m_pendingRequests.end()) return std::nullopt;
+    PendingRequest request = std::move(it->second);
+    m_pendingRequests.erase(it);
+    m_priorityOrder.erase(request.m_priorityKey);
+    if (request.m_header)
+    {
+        const auto [offset_begin, offset_end] = m_offsetOrder.equal_range(request.m_header->m_offset);
+        const auto offset_it = std::find_if(offset_begin, offset_end, [request_id](const auto& entry) { return entry.second == request_id; });
+        if (offset_it != offset_end) m_offsetOrder.erase(offset_it);
+    }
+    return request;
+}
+
+std::vector<AssetRequestQueue::PendingRequest> AssetRequestQueue::takeCoalescedRequests()
+{
+    assert(!m_priorityOrder.empty());
+    std::vector<PendingRequest> requests;
+    requests.push_back(std::move(takePendingRequest(m_priorityOrder.begin()->second).value()));
+    if (!requests.front().m_header) return requests;
+
+    // 優先順序最高的 request 決定讀取位置, 前後相鄰的 request 不管優先順序都一起讀
+    std::uint64_t range_begin = requests.front().m_header->m_offset;
+    std::uint64_t range_end = range_begin + requests.front().m_header->m_size;
+    std::vector<RequestId> coalesced_ids;
+    for (auto it = m_offsetOrder.lower_bound(range_begin); it != m_offsetOrder.end(); ++it)
+    {
+        const std::uint64_t content_end = it->first + m_pendingRequests.at(it->second).m_header->m_size;
+        if (it->first > range_end + COALESCE_MAX_GAP) break;
+        if (std::max(range_end, content_end) - range_begin > COALESCE_MAX_READ_SIZE) break;
+        range_end = std::max(range_end, content_end);
+        coalesced_ids.push_back(it->second);
+    }
+    for (auto it = m_offsetOrder.lower_bound(range_begin); it != m_offsetOrder.begin(); )
+    {
+        --it;
+        const std::uint64_t content_end = it->first + m_pendingRequests.at(it->second).m_header->m_size;
+        if (content_end + COALESCE_MAX_GAP < range_begin) break;
+        if (range_end - it->first > COALESCE_MAX_READ_SIZE) break;
+        range_begin = it->first;
+        coalesced_ids.push_back(it->second);
+    }
+    for (const RequestId request_id : coalesced_ids)
+    {
+        requests.push_back(std::move(takePendingRequest(request_id).value()));
+    }
+    m_statistics.m_coalescedCount += coalesced_ids.size();
+    return requests;
+}
+
+void AssetRequestQueue::processRequests(std::vector<PendingRequest>& requests)
+{
+    std::vector<Result> results(requests.size());
+    std::vector<size_t> read_indices;
+    AssetContentCache* cache = m_package->m_contentCache.get();
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        const PendingRequest& request = requests[i];
+        if (request.m_assetKey.empty())
+        {
+            results[i].m_error = ErrorCode::emptyKey;
+        }
+        else if (!request.m_header)
+        {
+            results[i].m_error = ErrorCode::notExistedKey;
+        }
+        else if (Content content = cache != nullptr ? cache->tryGetContent(request.m_assetKey) : nullptr)
+        {
+            results[i].m_content = std::move(content);
+        }
+        else
+        {
+            read_indices.push_back(i);
+        }
+    }
+
+    if (!read_indices.empty())
+    {
+        // cache 沒有的部分合併成一次讀取, 再各自解壓
+        std::uint64_t range_begin = UINT64_MAX;
+        std::uint64_t range_end = 0;
+        for (const size_t i : read_indices)
+        {
+            range_begin = std::min(range_begin, requests[i].m_header->m_offset);
+            range_end = std::max(range_end, requests[i].m_header->m_offset + requests[i].m_header->m_size);
+        }
+        std::vector<char> read_buff;
+        const char* range_data = m_package->tryReadBundleContent(range_begin, range_end - range_begin, read_buff);
+        for (const size_t i : read_indices)
+        {
+            const AssetHeaderDataMap::AssetHeaderData& header_data = requests[i].m_header.value();
+            if (range_data == nullptr)
+            {
+                results[i].m_error = ErrorCode::readSizeCheck;
+                continue;
+            }
+            std::vector<char> buff(static_cast<size_t>(header_data.m_orgSize));
+            results[i].m_error = m_package->uncompressContentTo(header_data, range_data + (header_data.m_offset - range_begin), buff.data());
+            if (results[i].m_error) continue;
+            results[i].m_content = std::make_shared<const std::vector<char>>(std::move(buff));
+            if (cache != nullptr) cache->insertContent(requests[i].m_assetKey, results[i].m_content);
+        }
+    }
+
+    {
+        const std::lock_guard<std::mutex> lock{ m_queueLocker };
+        m_statistics.m_completedCount += requests.size();
+        if (!read_indices.empty()) m_statistics.m_readCount++;
+    }
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        completeRequest(requests[i], results[i]);
+    }
+}
+
+void AssetRequestQueue::completeRequest(PendingRequest& request, const Result& result)
+{
+    if (request.m_completion) request.m_completion(request.m_assetKey, result);
+    if (request.m_promise) request.m_promise->set_value(result);
+}
+
+void AssetRequestQueue::workerProc()
+{
+    while (true)
+    {
+        std::vector<PendingRequest> requests;
+        {
+            std::unique_lock<std::mutex> lock{ m_queueLocker };
+            m_queueReady.wait(lock, [this]() { return m_isStopping || ((!m_isPaused) && (!m_priorityOrder.empty())); });
+            if (m_isStopping) return;
+            requests = takeCoalescedRequests();
+        }
+        processRequests(requests);
+    }
+}
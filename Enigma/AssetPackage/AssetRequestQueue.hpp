@@ -0,0 +1,129 @@
+﻿/*****************************************************************
+ * \file   AssetRequestQueue.hpp
+ * \brief  非同步的 asset 讀取, 由 worker threads 依優先順序讀取跟解壓, 完成時呼叫 callback 或設定 future
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_REQUEST_QUEUE_HPP
+#define ASSET_REQUEST_QUEUE_HPP
+
+#include "AssetContentCache.hpp"
+#include "AssetHeaderDataMap.hpp"
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    class AssetPackageFile;
+
+    using error = std::error_code;
+    class AssetRequestQueue
+    {
+    public:
+        using Content = AssetContentCache::Content;
+        using RequestId = std::uint64_t;
+        constexpr static RequestId INVALID_REQUEST_ID = 0;
+        /** bundle 內兩段內容間隔不超過這個值就合併成一次讀取, 中間的部分讀了丟掉 */
+        constexpr static std::uint64_t COALESCE_MAX_GAP = 16 * 1024;
+        constexpr static std::uint64_t COALESCE_MAX_READ_SIZE = 4 * 1024 * 1024;
+
+        enum class Priority : unsigned int
+        {
+            background = 0,
+            normal = 1,
+            high = 2,
+        };
+        struct Result
+        {
+            error m_error;
+            Content m_content;
+        };
+        /** 在 worker thread 上呼叫, 不可以在裡面等待同一個 queue 的其他 request */
+        using Completion = std::function<void(const std::string& asset_key, const Result& result)>;
+        struct FutureRequest
+        {
+            RequestId m_id;
+            std::future<Result> m_future;
+        };
+        struct Statistics
+        {
+            std::uint64_t m_completedCount;
+            std::uint64_t m_canceledCount;
+            std::uint64_t m_readCount;  ///< 實際讀 bundle 的次數, 合併的 request 只算一次
+            std::uint64_t m_coalescedCount;  ///< 合併到其他 request 一起讀的數量
+        };
+    public:
+        /** worker_count 為 0 時使用 hardware concurrency; 讀取期間 package 不可以新增或移除 asset */
+        explicit AssetRequestQueue(const std::shared_ptr<AssetPackageFile>& package, unsigned worker_count = 0);
+        AssetRequestQueue(const AssetRequestQueue&) = delete;
+        AssetRequestQueue(AssetRequestQueue&&) = delete;
+        /** 還沒開始的 request 都以 requestCanceled 完成, 等進行中的完成後才返回 */
+        ~AssetRequestQueue() noexcept;
+
+        AssetRequestQueue& operator=(const AssetRequestQueue&) = delete;
+        AssetRequestQueue& operator=(AssetRequestQueue&&) = delete;
+
+        RequestId requestAsset(const std::string& asset_key, Priority priority, const Completion& completion);
+        FutureRequest requestAsset(const std::string& asset_key, Priority priority);
+        /** 只能取消還沒開始讀取的 request, 取消的 request 以 requestCanceled 完成; 回傳是否有取消 */
+        bool cancelRequest(RequestId request_id);
+        void cancelAllRequests();
+
+        /** 暫停時 worker 不領新的 request, 進行中的照樣完成 */
+        void pause();
+        void resume();
+
+        [[nodiscard]] size_t getPendingCount() const;
+        [[nodiscard]] Statistics getStatistics() const;
+
+    private:
+        using PriorityKey = std::pair<unsigned int, RequestId>;  ///< 數字小的先處理, 相同優先順序依 request 先後
+        struct PendingRequest
+        {
+            RequestId m_id;
+            std::string m_assetKey;
+            PriorityKey m_priorityKey;
+            std::optional<AssetHeaderDataMap::AssetHeaderData> m_header;  ///< 沒有的話由 worker 回報 notExistedKey
+            Completion m_completion;
+            std::optional<std::promise<Result>> m_promise;
+        };
+
+        RequestId enqueueRequest(const std::string& asset_key, Priority priority, Completion completion, std::optional<std::promise<Result>> promise);
+        /** 要在 m_queueLocker 內呼叫 */
+        std::optional<PendingRequest> takePendingRequest(RequestId request_id);
+        std::vector<PendingRequest> takeCoalescedRequests();
+        void processRequests(std::vector<PendingRequest>& requests);
+        void completeRequest(PendingRequest& request, const Result& result);
+        void workerProc();
+
+    private:
+        std::shared_ptr<AssetPackageFile> m_package;
+        std::vector<std::thread> m_workers;
+
+        mutable std::mutex m_queueLocker;
+        std::condition_variable m_queueReady;
+        bool m_isStopping;
+        bool m_isPaused;
+        RequestId m_nextRequestId;
+        std::unordered_map<RequestId, PendingRequest> m_pendingRequests;
+        std::set<PriorityKey> m_priorityOrder;
+        std::multimap<std::uint64_t, RequestId> m_offsetOrder;  ///< 有 header 的 request 依 bundle offset 排序, 找可以合併讀取的
+        Statistics m_statistics;
+    };
+}
+
+#endif // ASSET_REQUEST_QUEUE_HPP
@@ -0,0 +1,27 @@
+﻿/*****************************************************************
+ * \file   FileSync.hpp
+ * \brief  把檔案已寫入的內容寫到儲存裝置 (fsync / FlushFileBuffers), 實作分平台
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_FILE_SYNC_HPP
+#define ASSET_FILE_SYNC_HPP
+
+#include <string>
+#include <system_error>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class FileSync
+    {
+    public:
+        /** file_path 的內容寫到儲存裝置後才返回; fstream 的 buffer 要先 flush */
+        static error syncFile(const std::string& file_path);
+        /** rename 之後同步檔案所在的目錄, 斷電後換檔的結果才會留下; win32 不需要 */
+        static error syncParentDirectory(const std::string& file_path);
+    };
+}
+
+#endif // ASSET_FILE_SYNC_HPP
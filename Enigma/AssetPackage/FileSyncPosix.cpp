@@ -0,0 +1,41 @@
+﻿#include "Platforms/PlatformConfig.hpp"
+#include "FileSync.hpp"
+#include "AssetPackageErrors.hpp"
+
+#if TARGET_PLATFORM != PLATFORM_WIN32
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+using namespace AssetPackage;
+
+static error syncPath(const std::string& path)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return ErrorCode::fileOpenFail;
+    int result = 0;
+    do
+    {
+        result = ::fsync(fd);
+    } while ((result != 0) && (errno == EINTR));
+    ::close(fd);
+    if (result != 0) return ErrorCode::fileWriteFail;
+    return ErrorCode::ok;
+}
+
+error FileSync::syncFile(const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    return syncPath(file_path);
+}
+
+error FileSync::syncParentDirectory(const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    const std::filesystem::path parent_path = std::filesystem::path(file_path).parent_path();
+    return syncPath(parent_path.empty() ? std::string(".") : parent_path.string());
+}
+
+#endif
@@ -0,0 +1,29 @@
+﻿#include "Platforms/PlatformConfig.hpp"
+#include "FileSync.hpp"
+#include "AssetPackageErrors.hpp"
+
+#if TARGET_PLATFORM == PLATFORM_WIN32
+#include <Windows.h>
+
+using namespace AssetPackage;
+
+error FileSync::syncFile(const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    // FlushFileBuffers 要有寫入權限; package 寫入時檔案也被 fstream 開著, 要允許共用
+    HANDLE handle = CreateFileA(file_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) return ErrorCode::fileOpenFail;
+    const BOOL is_flushed = FlushFileBuffers(handle);
+    CloseHandle(handle);
+    if (!is_flushed) return ErrorCode::fileWriteFail;
+    return ErrorCode::ok;
+}
+
+error FileSync::syncParentDirectory(const std::string& file_path)
+{
+    // NTFS 的 rename 會寫進 metadata journal, 不用另外同步目錄
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    return ErrorCode::ok;
+}
+
+#endif
@@ -0,0 +1,43 @@
+﻿/*****************************************************************
+ * \file   MappedFile.hpp
+ * \brief  read-only memory mapped file, 實作分平台
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_MAPPED_FILE_HPP
+#define ASSET_MAPPED_FILE_HPP
+
+#include <string>
+#include <system_error>
+#include <cstddef>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile(MappedFile&&) = delete;
+        ~MappedFile() noexcept;
+
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile& operator=(MappedFile&&) = delete;
+
+        error open(const std::string& file_path);
+        void close();
+
+        [[nodiscard]] bool isOpen() const { return m_isOpen; }
+        [[nodiscard]] const char* data() const { return m_data; }
+        [[nodiscard]] size_t size() const { return m_size; }
+
+    private:
+        bool m_isOpen;
+        const char* m_data;
+        size_t m_size;
+    };
+}
+
+#endif // ASSET_MAPPED_FILE_HPP
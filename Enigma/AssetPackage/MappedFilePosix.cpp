@@ -0,0 +1,68 @@
+﻿#include "Platforms/PlatformConfig.hpp"
+#include "MappedFile.hpp"
+#include "AssetPackageErrors.hpp"
+
+#if TARGET_PLATFORM != PLATFORM_WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace AssetPackage;
+
+MappedFile::MappedFile() : m_isOpen(false), m_data(nullptr), m_size(0)
+{
+}
+
+MappedFile::~MappedFile() noexcept
+{
+    close();
+}
+
+error MappedFile::open(const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    close();
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    const int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) return ErrorCode::fileOpenFail;
+    struct stat file_stat {};
+    if (::fstat(fd, &file_stat) != 0)
+    {
+        ::close(fd);
+        return ErrorCode::fileSizeError;
+    }
+    // 空檔案不能 mmap, 視為已開啟的空內容
+    if (file_stat.st_size == 0)
+    {
+        ::close(fd);
+        m_isOpen = true;
+        return ErrorCode::ok;
+    }
+    const auto file_size = static_cast<size_t>(file_stat.st_size);
+    void* view = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    // mapping 建立後就不需要 fd 了
+    ::close(fd);
+    if (view == MAP_FAILED) return ErrorCode::fileMappingFail;
+    ::madvise(view, file_size, MADV_RANDOM);
+
+    m_data = static_cast<const char*>(view);
+    m_size = file_size;
+    m_isOpen = true;
+    return ErrorCode::ok;
+}
+
+void MappedFile::close()
+{
+    if (m_data != nullptr)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        ::munmap(const_cast<char*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+}
+
+#endif
@@ -0,0 +1,65 @@
+﻿#include "Platforms/PlatformConfig.hpp"
+#include "MappedFile.hpp"
+#include "AssetPackageErrors.hpp"
+
+#if TARGET_PLATFORM == PLATFORM_WIN32
+#include <Windows.h>
+
+using namespace AssetPackage;
+
+MappedFile::MappedFile() : m_isOpen(false), m_data(nullptr), m_size(0)
+{
+}
+
+MappedFile::~MappedFile() noexcept
+{
+    close();
+}
+
+error MappedFile::open(const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    close();
+
+    HANDLE file_handle = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) return ErrorCode::fileOpenFail;
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(file_handle, &file_size))
+    {
+        CloseHandle(file_handle);
+        return ErrorCode::fileSizeError;
+    }
+    // 空檔案不能建 mapping, 視為已開啟的空內容
+    if (file_size.QuadPart == 0)
+    {
+        CloseHandle(file_handle);
+        m_isOpen = true;
+        return ErrorCode::ok;
+    }
+    HANDLE mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    // view 會保有 mapping 的參考, 所以 handle 都可以先關掉
+    CloseHandle(file_handle);
+    if (mapping_handle == nullptr) return ErrorCode::fileMappingFail;
+    const void* view = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping_handle);
+    if (view == nullptr) return ErrorCode::fileMappingFail;
+
+    m_data = static_cast<const char*>(view);
+    m_size = static_cast<size_t>(file_size.QuadPart);
+    m_isOpen = true;
+    return ErrorCode::ok;
+}
+
+void MappedFile::close()
+{
+    if (m_data != nullptr)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+}
+
+#endif
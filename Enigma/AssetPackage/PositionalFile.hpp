@@ -0,0 +1,43 @@
+﻿/*****************************************************************
+ * \file   PositionalFile.hpp
+ * \brief  read-only file with positional read (pread), 沒有共用的 file cursor,
+ *         所以多個執行緒可以同時讀取, 實作分平台
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#ifndef ASSET_POSITIONAL_FILE_HPP
+#define ASSET_POSITIONAL_FILE_HPP
+
+#include <string>
+#include <system_error>
+#include <cstddef>
+#include <cstdint>
+
+namespace AssetPackage
+{
+    using error = std::error_code;
+    class PositionalFile
+    {
+    public:
+        PositionalFile();
+        PositionalFile(const PositionalFile&) = delete;
+        PositionalFile(PositionalFile&&) = delete;
+        ~PositionalFile() noexcept;
+
+        PositionalFile& operator=(const PositionalFile&) = delete;
+        PositionalFile& operator=(PositionalFile&&) = delete;
+
+        error open(const std::string& file_path);
+        void close();
+
+        [[nodiscard]] bool isOpen() const;
+        /** 從 offset 讀 size bytes 到 buff, 回傳實際讀到的 bytes; thread safe */
+        size_t readAt(std::uint64_t offset, char* buff, size_t size) const;
+
+    private:
+        std::intptr_t m_handle;  // win32 : HANDLE, posix : file descriptor
+    };
+}
+
+#endif // ASSET_POSITIONAL_FILE_HPP
@@ -0,0 +1,66 @@
+﻿#include "Platforms/PlatformConfig.hpp"
+#include "PositionalFile.hpp"
+#include "AssetPackageErrors.hpp"
+
+#if TARGET_PLATFORM != PLATFORM_WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+using namespace AssetPackage;
+
+constexpr std::intptr_t INVALID_FILE_HANDLE = -1;
+
+PositionalFile::PositionalFile() : m_handle(INVALID_FILE_HANDLE)
+{
+}
+
+PositionalFile::~PositionalFile() noexcept
+{
+    close();
+}
+
+error PositionalFile::open(const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    close();
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    const int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) return ErrorCode::fileOpenFail;
+    m_handle = fd;
+    return ErrorCode::ok;
+}
+
+void PositionalFile::close()
+{
+    if (m_handle != INVALID_FILE_HANDLE)
+    {
+        ::close(static_cast<int>(m_handle));
+    }
+    m_handle = INVALID_FILE_HANDLE;
+}
+
+bool PositionalFile::isOpen() const
+{
+    return m_handle != INVALID_FILE_HANDLE;
+}
+
+size_t PositionalFile::readAt(std::uint64_t offset, char* buff, size_t size) const
+{
+    if (!isOpen()) return 0;
+    size_t total = 0;
+    while (total < size)
+    {
+        const ssize_t read_bytes = ::pread(static_cast<int>(m_handle), buff + total, size - total, static_cast<off_t>(offset + total));
+        if (read_bytes < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (read_bytes == 0) break;
+        total += static_cast<size_t>(read_bytes);
+    }
+    return total;
+}
+
+#endif
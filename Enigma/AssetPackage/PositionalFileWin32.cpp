@@ -0,0 +1,70 @@
+﻿#include "Platforms/PlatformConfig.hpp"
+#include "PositionalFile.hpp"
+#include "AssetPackageErrors.hpp"
+
+#if TARGET_PLATFORM == PLATFORM_WIN32
+#include <Windows.h>
+#include <algorithm>
+
+using namespace AssetPackage;
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+static HANDLE toHandle(std::intptr_t handle) { return reinterpret_cast<HANDLE>(handle); }
+static const std::intptr_t INVALID_FILE_HANDLE = reinterpret_cast<std::intptr_t>(INVALID_HANDLE_VALUE);
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+
+PositionalFile::PositionalFile() : m_handle(INVALID_FILE_HANDLE)
+{
+}
+
+PositionalFile::~PositionalFile() noexcept
+{
+    close();
+}
+
+error PositionalFile::open(const std::string& file_path)
+{
+    if (file_path.empty()) return ErrorCode::emptyFileName;
+    close();
+    // package 寫入時 bundle 檔也被 fstream 開著, 所以要允許共用寫入
+    HANDLE handle = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) return ErrorCode::fileOpenFail;
+    m_handle = reinterpret_cast<std::intptr_t>(handle);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    return ErrorCode::ok;
+}
+
+void PositionalFile::close()
+{
+    if (m_handle != INVALID_FILE_HANDLE)
+    {
+        CloseHandle(toHandle(m_handle));
+    }
+    m_handle = INVALID_FILE_HANDLE;
+}
+
+bool PositionalFile::isOpen() const
+{
+    return m_handle != INVALID_FILE_HANDLE;
+}
+
+size_t PositionalFile::readAt(std::uint64_t offset, char* buff, size_t size) const
+{
+    if (!isOpen()) return 0;
+    size_t total = 0;
+    while (total < size)
+    {
+        // OVERLAPPED 帶 offset 的 ReadFile 不依賴 file pointer, 可以多執行緒同時讀
+        OVERLAPPED overlapped{};
+        const std::uint64_t pos = offset + total;
+        overlapped.Offset = static_cast<DWORD>(pos & 0xffffffffULL);
+        overlapped.OffsetHigh = static_cast<DWORD>(pos >> 32);
+        const auto chunk = static_cast<DWORD>(std::min<size_t>(size - total, MAXDWORD));
+        DWORD read_bytes = 0;
+        if ((!ReadFile(toHandle(m_handle), buff + total, chunk, &read_bytes, &overlapped)) || (read_bytes == 0)) break;
+        total += read_bytes;
+    }
+    return total;
+}
+
+#endif
@@ -0,0 +1,28 @@
+﻿#include "PlatformConfig.hpp"
+
+#if TARGET_PLATFORM == PLATFORM_LINUX
+#include "Debug.hpp"
+#include <cstdarg>
+#include <cstdio>
+
+namespace Platforms
+{
+    int Debug::printf(const char* format, ...)
+    {
+        va_list arg_list;
+        va_start(arg_list, format);
+        int n_written = std::vfprintf(stdout, format, arg_list);
+        va_end(arg_list);
+        return n_written;
+    }
+    int Debug::errorPrintf(const char* format, ...)
+    {
+        va_list arg_list;
+        va_start(arg_list, format);
+        int n_written = std::vfprintf(stderr, format, arg_list);
+        va_end(arg_list);
+        return n_written;
+    }
+}
+
+#endif
@@ -14,6 +14,7 @@
 #define PLATFORM_ANDROID            2
 #define PLATFORM_IOS                3
 #define PLATFORM_MAC                4
+#define PLATFORM_LINUX              5
 
 // Determine target platform by compile environment macro.
 #define TARGET_PLATFORM             PLATFORM_UNKNOWN
@@ -30,4 +31,10 @@
 #define TARGET_PLATFORM         PLATFORM_ANDROID
 #endif
 
+// linux (android 也有定義 __linux__)
+#if defined(__linux__) && !defined(ANDROID)
+#undef  TARGET_PLATFORM
+#define TARGET_PLATFORM         PLATFORM_LINUX
+#endif
+
 #endif // PLATFORM_CONFIG_HPP
@@ -0,0 +1,526 @@
+﻿/*****************************************************************
+ * \file   AssetPackageBenchmark.cpp
+ * \brief  AssetPackage 的效能量測 : build, open, 隨機/循序讀取, remove;
+ *         每個量測結果輸出一行 JSON 到 stdout, 進度訊息輸出到 stderr
+ *
+ * \author Lancelot 'Robin' Chen
+ * \date   October 2026
+ ******************************************************************/
+#include "AssetPackage/AssetPackageFile.hpp"
+#include "AssetPackage/AssetPackageErrors.hpp"
+#include "AssetPackage/AssetCodec.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AssetPackage;
+
+using Clock = std::chrono::steady_clock;
+
+enum class ContentMix
+{
+    small,  ///< 64 bytes ~ 4KB 的文字設定檔
+    large,  ///< 64KB ~ 1MB, 可壓縮一半左右
+    incompressible,  ///< 4KB ~ 64KB 的亂數, 已經壓縮過的內容 (png, ogg...)
+    mixed,  ///< 80% small, 15% incompressible, 5% large
+};
+
+struct BenchmarkOptions
+{
+    std::vector<size_t> m_entryCounts{ 1000, 10000 };
+    std::vector<ContentMix> m_mixes{ ContentMix::small, ContentMix::large, ContentMix::incompressible, ContentMix::mixed };
+    std::vector<unsigned> m_threadCounts{ 1, 2, 4, 8 };
+    size_t m_readCount = 20000;  ///< 每個 thread count 的讀取次數 (所有 thread 加總)
+    size_t m_removeCount = 1000;
+    unsigned m_openRepeat = 5;
+    AssetCodecId m_codec = AssetCodecId::zlib;
+    bool m_isDeduplicating = true;
+    bool m_isBatching = false;  ///< build 時用 beginBatch/commitBatch, header 只寫一次
+    unsigned m_seed = 1;
+    std::string m_workDir;
+};
+
+/** 一個量測結果; seconds 是整個量測的時間, open 是多次中的中位數 */
+struct BenchmarkResult
+{
+    const char* m_benchmark;
+    ContentMix m_mix;
+    size_t m_entryCount;
+    unsigned m_threadCount;
+    const char* m_readMode;
+    std::uint64_t m_operations;
+    std::uint64_t m_bytes;
+    double m_seconds;
+};
+
+static const char* getMixName(ContentMix mix)
+{
+    switch (mix)
+    {
+    case ContentMix::small: return "small";
+    case ContentMix::large: return "large";
+    case ContentMix::incompressible: return "incompressible";
+    case ContentMix::mixed: return "mixed";
+    }
+    return "unknown";
+}
+
+static const char* getCodecName(AssetCodecId codec)
+{
+    switch (codec)
+    {
+    case AssetCodecId::zlib: return "zlib";
+    case AssetCodecId::stored: return "stored";
+    case AssetCodecId::fastLz: return "fastLz";
+    case AssetCodecId::zlibDictionary: return "zlibDictionary";
+    }
+    return "unknown";
+}
+
+static double getSeconds(Clock::time_point begin, Clock::time_point end)
+{
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+static void printResult(const BenchmarkResult& result)
+{
+    const double seconds = std::max(result.m_seconds, 1e-9);
+    std::printf("{\"benchmark\":\"%s\",\"mix\":\"%s\",\"entries\":%zu,\"threads\":%u,\"read_mode\":\"%s\",\"operations\":%llu,\"bytes\":%llu,"
+        "\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"mb_per_sec\":%.2f,\"us_per_op\":%.3f}\n",
+        result.m_benchmark, getMixName(result.m_mix), result.m_entryCount, result.m_threadCount, result.m_readMode,
+        static_cast<unsigned long long>(result.m_operations), static_cast<unsigned long long>(result.m_bytes), result.m_seconds,
+        static_cast<double>(result.m_operations) / seconds, static_cast<double>(result.m_bytes) / seconds / (1024.0 * 1024.0),
+        result.m_operations > 0 ? result.m_seconds * 1e6 / static_cast<double>(result.m_operations) : 0.0);
+    std::fflush(stdout);
+}
+
+static std::string makeAssetKey(ContentMix mix, size_t index)
+{
+    // 每 1000 個 asset 一個目錄, key 的長度跟分布接近實際的 asset 路徑
+    return std::string{ getMixName(mix) } + "/group_" + std::to_string(index / 1000) + "/asset_" + std::to_string(index) + ".bin";
+}
+
+/** 內容只由 seed 跟 index 決定, build 時不用把全部內容留在記憶體裡 */
+static std::vector<char> makeAssetContent(ContentMix mix, size_t index, unsigned seed)
+{
+    std::mt19937_64 generator(static_cast<std::uint64_t>(seed) * 0x9e3779b97f4a7c15ULL + index);
+    if (mix == ContentMix::mixed)
+    {
+        const size_t kind = index % 20;
+        mix = kind == 0 ? ContentMix::large : (kind <= 3 ? ContentMix::incompressible : ContentMix::small);
+    }
+    std::vector<char> buff;
+    switch (mix)
+    {
+    case ContentMix::small:
+    {
+        std::uniform_int_distribution<size_t> size_rand(64, 4096);
+        std::uniform_int_distribution<int> value_rand(0, 100000);
+        const size_t size = size_rand(generator);
+        buff.reserve(size + 64);
+        while (buff.size() < size)
+        {
+            const std::string line = "  \"field_" + std::to_string(buff.size() % 17) + "\": " + std::to_string(value_rand(generator)) + ",\n";
+            buff.insert(buff.end(), line.begin(), line.end());
+        }
+        buff.resize(size);
+        break;
+    }
+    case ContentMix::large:
+    {
+        std::uniform_int_distribution<size_t> size_rand(64 * 1024, 1024 * 1024);
+        buff.resize(size_rand(generator));
+        for (size_t i = 0; i < buff.size(); i++)
+        {
+            buff[i] = (i % 2 == 0) ? static_cast<char>(generator() & 0xff) : static_cast<char>(i & 0x7f);
+        }
+        break;
+    }
+    case ContentMix::incompressible:
+    case ContentMix::mixed:
+    {
+        std::uniform_int_distribution<size_t> size_rand(4 * 1024, 64 * 1024);
+        buff.resize(size_rand(generator));
+        for (char& c : buff)
+        {
+            c = static_cast<char>(generator() & 0xff);
+        }
+        break;
+    }
+    }
+    return buff;
+}
+
+static void removePackageFiles(const std::string& base_filename)
+{
+    std::error_code ec;
+    std::filesystem::remove(base_filename + ".eph", ec);
+    std::filesystem::remove(base_filename + ".epb", ec);
+}
+
+static std::optional<BenchmarkResult> benchmarkBuild(const BenchmarkOptions& options, const std::string& base_filename, ContentMix mix, size_t entry_count)
+{
+    removePackageFiles(base_filename);
+    std::uint64_t total_bytes = 0;
+    Clock::duration add_time{ 0 };
+    Clock::time_point begin = Clock::now();
+    auto package = AssetPackageFile::createNewPackage(base_filename);
+    add_time += Clock::now() - begin;
+    if (!package) return std::nullopt;
+    package->setDeduplication(options.m_isDeduplicating);
+    if ((options.m_isBatching) && (package->beginBatch())) return std::nullopt;
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        // 產生內容的時間不算
+        const std::vector<char> content = makeAssetContent(mix, i, options.m_seed);
+        const std::string asset_key = makeAssetKey(mix, i);
+        begin = Clock::now();
+        const error er = package->addAssetMemory(content, asset_key, 1, options.m_codec);
+        add_time += Clock::now() - begin;
+        if (er)
+        {
+            std::fprintf(stderr, "add %s fail : %s\n", asset_key.c_str(), er.message().c_str());
+            return std::nullopt;
+        }
+        total_bytes += content.size();
+    }
+    // commit 跟關檔 (journal 併回 index) 也算在 build 時間內
+    begin = Clock::now();
+    if ((options.m_isBatching) && (package->commitBatch())) return std::nullopt;
+    package = nullptr;
+    add_time += Clock::now() - begin;
+    return BenchmarkResult{ "build", mix, entry_count, 1, "", entry_count, total_bytes, std::chrono::duration<double>(add_time).count() };
+}
+
+static std::vector<BenchmarkResult> benchmarkOpen(const BenchmarkOptions& options, const std::string& base_filename, ContentMix mix, size_t entry_count)
+{
+    std::vector<BenchmarkResult> results;
+    for (const bool is_read_only : { false, true })
+    {
+        std::vector<double> latencies;
+        for (unsigned r = 0; r < options.m_openRepeat; r++)
+        {
+            const Clock::time_point begin = Clock::now();
+            auto package = is_read_only ? AssetPackageFile::openPackageReadOnly(base_filename) : AssetPackageFile::openPackage(base_filename);
+            const Clock::time_point end = Clock::now();
+            if (!package) return results;
+            latencies.push_back(getSeconds(begin, end));
+        }
+        std::sort(latencies.begin(), latencies.end());
+        results.push_back({ "open", mix, entry_count, 1, is_read_only ? "mapped" : "pread", 1, 0, latencies[latencies.size() / 2] });
+    }
+    return results;
+}
+
+/** indices 是每次讀取的 asset, 依 thread 數切成連續的幾段, 各 thread 讀自己那段 */
+static std::optional<BenchmarkResult> benchmarkRead(const std::shared_ptr<AssetPackageFile>& package, const std::vector<std::string>& asset_keys,
+    const std::vector<size_t>& indices, unsigned thread_count)
+{
+    std::atomic<std::uint64_t> total_bytes{ 0 };
+    std::atomic<bool> is_failed{ false };
+    std::atomic<unsigned> ready_count{ 0 };
+    std::atomic<bool> is_started{ false };
+    auto worker_proc = [&](size_t begin, size_t end)
+        {
+            std::uint64_t read_bytes = 0;
+            ready_count++;
+            while (!is_started) std::this_thread::yield();
+            for (size_t i = begin; i < end; i++)
+            {
+                const auto buff = package->tryRetrieveAssetToMemory(asset_keys[indices[i]]);
+                if (!buff)
+                {
+                    is_failed = true;
+                    return;
+                }
+                read_bytes += buff->size();
+            }
+            total_bytes += read_bytes;
+        };
+    std::vector<std::thread> workers;
+    workers.reserve(thread_count);
+    for (unsigned t = 0; t < thread_count; t++)
+    {
+        workers.emplace_back(worker_proc, indices.size() * t / thread_count, indices.size() * (t + 1) / thread_count);
+    }
+    while (ready_count < thread_count) std::this_thread::yield();
+    const Clock::time_point begin = Clock::now();
+    is_started = true;
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    const Clock::time_point end = Clock::now();
+    if (is_failed) return std::nullopt;
+    return BenchmarkResult{ "", ContentMix::small, 0, thread_count, "", indices.size(), total_bytes, getSeconds(begin, end) };
+}
+
+static std::vector<BenchmarkResult> benchmarkReads(const BenchmarkOptions& options, const std::string& base_filename, ContentMix mix, size_t entry_count)
+{
+    std::vector<BenchmarkResult> results;
+    std::vector<std::string> asset_keys;
+    asset_keys.reserve(entry_count);
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        asset_keys.push_back(makeAssetKey(mix, i));
+    }
+    std::mt19937_64 generator(options.m_seed);
+    std::uniform_int_distribution<size_t> index_rand(0, entry_count - 1);
+    std::vector<size_t> random_indices(options.m_readCount);
+    for (size_t& index : random_indices)
+    {
+        index = index_rand(generator);
+    }
+    for (const bool is_read_only : { true, false })
+    {
+        const auto package = is_read_only ? AssetPackageFile::openPackageReadOnly(base_filename) : AssetPackageFile::openPackage(base_filename);
+        if (!package) return results;
+        // 循序讀取 : 依 bundle offset 的順序, 最多讀 m_readCount 個
+        std::vector<std::pair<std::uint64_t, size_t>> offsets;
+        offsets.reserve(entry_count);
+        for (size_t i = 0; i < entry_count; i++)
+        {
+            if (const auto header = package->tryGetAssetHeaderData(asset_keys[i])) offsets.emplace_back(header->m_offset, i);
+        }
+        std::sort(offsets.begin(), offsets.end());
+        std::vector<size_t> sequential_indices;
+        for (size_t i = 0; i < std::min(offsets.size(), options.m_readCount); i++)
+        {
+            sequential_indices.push_back(offsets[i].second);
+        }
+        const char* read_mode = is_read_only ? "mapped" : "pread";
+        for (const unsigned thread_count : options.m_threadCounts)
+        {
+            if (auto result = benchmarkRead(package, asset_keys, random_indices, thread_count))
+            {
+                result->m_benchmark = "random_read";
+                result->m_mix = mix;
+                result->m_entryCount = entry_count;
+                result->m_readMode = read_mode;
+                results.push_back(result.value());
+            }
+            if (auto result = benchmarkRead(package, asset_keys, sequential_indices, thread_count))
+            {
+                result->m_benchmark = "sequential_read";
+                result->m_mix = mix;
+                result->m_entryCount = entry_count;
+                result->m_readMode = read_mode;
+                results.push_back(result.value());
+            }
+        }
+    }
+    return results;
+}
+
+static std::vector<BenchmarkResult> benchmarkRemove(const BenchmarkOptions& options, const std::string& base_filename, ContentMix mix, size_t entry_count)
+{
+    std::vector<BenchmarkResult> results;
+    std::vector<size_t> indices(entry_count);
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        indices[i] = i;
+    }
+    std::mt19937_64 generator(options.m_seed);
+    std::shuffle(indices.begin(), indices.end(), generator);
+    indices.resize(std::min(entry_count, options.m_removeCount));
+
+    auto package = AssetPackageFile::openPackage(base_filename);
+    if (!package) return results;
+    const Clock::time_point begin = Clock::now();
+    for (const size_t index : indices)
+    {
+        if (const error er = package->removeAsset(makeAssetKey(mix, index)))
+        {
+            std::fprintf(stderr, "remove fail : %s\n", er.message().c_str());
+            return results;
+        }
+    }
+    const Clock::time_point removed = Clock::now();
+    // 關檔時把 journal 併回 index
+    package = nullptr;
+    const Clock::time_point closed = Clock::now();
+    results.push_back({ "remove", mix, entry_count, 1, "", indices.size(), 0, getSeconds(begin, removed) });
+    results.push_back({ "remove_close", mix, entry_count, 1, "", 1, 0, getSeconds(removed, closed) });
+    return results;
+}
+
+template <class T, class Parser>
+static bool parseList(const std::string& text, std::vector<T>& values, Parser parser)
+{
+    values.clear();
+    size_t pos = 0;
+    while (pos <= text.size())
+    {
+        const size_t comma = std::min(text.find(',', pos), text.size());
+        const auto value = parser(text.substr(pos, comma - pos));
+        if (!value) return false;
+        values.push_back(value.value());
+        pos = comma + 1;
+    }
+    return !values.empty();
+}
+
+static std::optional<size_t> parseCount(const std::string& text)
+{
+    if ((text.empty()) || (text.find_first_not_of("0123456789") != std::string::npos)) return std::nullopt;
+    return static_cast<size_t>(std::strtoull(text.c_str(), nullptr, 10));
+}
+
+static std::optional<ContentMix> parseMix(const std::string& text)
+{
+    for (const ContentMix mix : { ContentMix::small, ContentMix::large, ContentMix::incompressible, ContentMix::mixed })
+    {
+        if (text == getMixName(mix)) return mix;
+    }
+    return std::nullopt;
+}
+
+static void printUsage()
+{
+    std::fprintf(stderr,
+        "usage : AssetPackageBenchmark [options]\n"
+        "  --entries N[,N...]   asset count of each package (default 1000,10000)\n"
+        "  --mix M[,M...]       small, large, incompressible, mixed (default all)\n"
+        "                       large averages about 550KB per asset, keep its entry count low\n"
+        "  --threads N[,N...]   reader thread counts (default 1,2,4,8)\n"
+        "  --reads N            reads per thread count, all threads together (default 20000)\n"
+        "  --removes N          removed assets (default 1000)\n"
+        "  --codec C            zlib, stored, fastLz (default zlib)\n"
+        "  --no-dedup           disable content deduplication\n"
+        "  --batch              build inside beginBatch/commitBatch\n"
+        "  --seed N             content seed (default 1)\n"
+        "  --dir PATH           working directory (default system temp)\n");
+}
+
+static bool parseOptions(int argc, char* argv[], BenchmarkOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        const std::string value = has_value ? argv[i + 1] : std::string{};
+        bool is_valid = true;
+        if (arg == "--no-dedup")
+        {
+            options.m_isDeduplicating = false;
+            continue;
+        }
+        if (arg == "--batch")
+        {
+            options.m_isBatching = true;
+            continue;
+        }
+        if (!has_value) return false;
+        i++;
+        if (arg == "--entries")
+        {
+            is_valid = parseList(value, options.m_entryCounts, parseCount)
+                && std::none_of(options.m_entryCounts.begin(), options.m_entryCounts.end(), [](size_t count) { return count == 0; });
+        }
+        else if (arg == "--mix")
+        {
+            is_valid = parseList(value, options.m_mixes, parseMix);
+        }
+        else if (arg == "--threads")
+        {
+            std::vector<size_t> thread_counts;
+            is_valid = parseList(value, thread_counts, parseCount)
+                && std::none_of(thread_counts.begin(), thread_counts.end(), [](size_t count) { return count == 0; });
+            options.m_threadCounts.assign(thread_counts.begin(), thread_counts.end());
+        }
+        else if ((arg == "--reads") || (arg == "--removes") || (arg == "--seed"))
+        {
+            const auto count = parseCount(value);
+            is_valid = count.has_value();
+            if (!is_valid) return false;
+            if (arg == "--reads") options.m_readCount = count.value();
+            if (arg == "--removes") options.m_removeCount = count.value();
+            if (arg == "--seed") options.m_seed = static_cast<unsigned>(count.value());
+        }
+        else if (arg == "--codec")
+        {
+            is_valid = false;
+            for (const AssetCodecId codec : { AssetCodecId::zlib, AssetCodecId::stored, AssetCodecId::fastLz })
+            {
+                if (value != getCodecName(codec)) continue;
+                options.m_codec = codec;
+                is_valid = true;
+            }
+        }
+        else if (arg == "--dir")
+        {
+            options.m_workDir = value;
+        }
+        else
+        {
+            is_valid = false;
+        }
+        if (!is_valid) return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    options.m_workDir = (std::filesystem::temp_directory_path() / "asset_package_benchmark").string();
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(options.m_workDir, ec);
+    if (ec)
+    {
+        std::fprintf(stderr, "can not create %s\n", options.m_workDir.c_str());
+        return 1;
+    }
+    // 第一行記錄這次量測的設定, 比較結果時對照用
+    std::printf("{\"benchmark\":\"config\",\"codec\":\"%s\",\"dedup\":%s,\"batch\":%s,\"seed\":%u,\"reads\":%zu,\"removes\":%zu,\"hardware_threads\":%u}\n",
+        getCodecName(options.m_codec), options.m_isDeduplicating ? "true" : "false", options.m_isBatching ? "true" : "false",
+        options.m_seed, options.m_readCount, options.m_removeCount, std::thread::hardware_concurrency());
+    int exit_code = 0;
+    for (const ContentMix mix : options.m_mixes)
+    {
+        for (const size_t entry_count : options.m_entryCounts)
+        {
+            const std::string base_filename = (std::filesystem::path{ options.m_workDir } / ("bench_" + std::string{ getMixName(mix) } + "_" + std::to_string(entry_count))).string();
+            std::fprintf(stderr, "%s x %zu : build\n", getMixName(mix), entry_count);
+            const auto build_result = benchmarkBuild(options, base_filename, mix, entry_count);
+            if (!build_result)
+            {
+                exit_code = 1;
+                removePackageFiles(base_filename);
+                continue;
+            }
+            printResult(build_result.value());
+            std::fprintf(stderr, "%s x %zu : open\n", getMixName(mix), entry_count);
+            for (const auto& result : benchmarkOpen(options, base_filename, mix, entry_count))
+            {
+                printResult(result);
+            }
+            std::fprintf(stderr, "%s x %zu : read\n", getMixName(mix), entry_count);
+            for (const auto& result : benchmarkReads(options, base_filename, mix, entry_count))
+            {
+                printResult(result);
+            }
+            std::fprintf(stderr, "%s x %zu : remove\n", getMixName(mix), entry_count);
+            for (const auto& result : benchmarkRemove(options, base_filename, mix, entry_count))
+            {
+                printResult(result);
+            }
+            removePackageFiles(base_filename);
+        }
+    }
+    return exit_code;
+}
@@ -0,0 +1,1814 @@
+﻿#include "pch.h"
+#include "CppUnitTest.h"
+#include "AssetPackage/AssetPackageFile.hpp"
+#include "AssetPackage/AssetPackageBuilder.hpp"
+#include "AssetPackage/AssetPackageErrors.hpp"
+#include "AssetPackage/AssetHeaderDataMap.hpp"
+#include "AssetPackage/AssetPackageFormat.hpp"
+#include "AssetPackage/AssetCodec.hpp"
+#include "AssetPackage/AssetCrc32.hpp"
+#include "AssetPackage/AssetDictionaryTrainer.hpp"
+#include "AssetPackage/AssetRequestQueue.hpp"
+#include "AssetPackage/AssetAccessTrace.hpp"
+#include "AssetPackage/AssetAccessStatistics.hpp"
+#include "AssetPackage/AssetPackageOverlay.hpp"
+#include "AssetPackage/AssetPackagePatch.hpp"
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <map>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace AssetPackage;
+
+namespace AssetPackageTest
+{
+    static std::string makeTestPackageName(const std::string& name)
+    {
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+
+    static void removeTestPackage(const std::string& base_filename)
+    {
+        std::filesystem::remove(base_filename + ".eph");
+        std::filesystem::remove(base_filename + ".epb");
+    }
+
+    static std::vector<char> makeAssetContent(std::default_random_engine& generator, size_t size)
+    {
+        // 一半隨機, 一半重複, 讓壓縮率接近一般的 asset
+        std::uniform_int_distribution<int> byte_rand(0, 255);
+        std::vector<char> buff(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            buff[i] = (i % 2 == 0) ? static_cast<char>(byte_rand(generator)) : static_cast<char>(i & 0x7f);
+        }
+        return buff;
+    }
+
+    static std::vector<char> makeConfigContent(std::default_random_engine& generator, unsigned index)
+    {
+        // 很多小的設定檔, 欄位名稱相同, 值不同
+        std::uniform_int_distribution<int> value_rand(0, 100000);
+        const std::string text = "{\n  \"name\": \"item_" + std::to_string(index) + "\",\n  \"category\": \"weapon\",\n"
+            + "  \"damage\": " + std::to_string(value_rand(generator)) + ",\n  \"durability\": " + std::to_string(value_rand(generator)) + ",\n"
+            + "  \"description\": \"A common blade carried by the guards of the northern kingdom.\",\n"
+            + "  \"icon\": \"textures/icons/item_" + std::to_string(value_rand(generator)) + ".png\"\n}\n";
+        return { text.begin(), text.end() };
+    }
+
+    TEST_CLASS(AssetPackageTest)
+    {
+    public:
+        TEST_METHOD(TestAddAndRetrieve)
+        {
+            const std::string base_filename = makeTestPackageName("test_add_retrieve");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                for (unsigned i = 0; i < 16; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 1000 + i * 333));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+                Assert::IsTrue(package->addAssetMemory(contents.front(), "asset_0", 1) == ErrorCode::duplicatedKey);
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_3")));
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                for (unsigned i = 0; i < 16; i++)
+                {
+                    const auto buff = package->tryRetrieveAssetToMemory("asset_" + std::to_string(i));
+                    if (i == 3)
+                    {
+                        Assert::IsFalse(buff.has_value());
+                        continue;
+                    }
+                    Assert::IsTrue(buff.has_value());
+                    Assert::IsTrue(buff.value() == contents[i]);
+                }
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestRemoveAndCompact)
+        {
+            const std::string base_filename = makeTestPackageName("test_remove_compact");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                for (unsigned i = 0; i < 10; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 4000));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+                const auto bundle_size = std::filesystem::file_size(base_filename + ".epb");
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_2")));
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_6")));
+                Assert::IsTrue(package->removeAsset("asset_6") == ErrorCode::invalidHeaderData);
+                Assert::IsTrue(package->getFreeSpaceBytes() > 0);
+                // 移除只記錄空間, bundle 檔不會改寫
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".epb") == bundle_size);
+                // 小的 asset 會放進移除留下的空間
+                contents[2] = makeAssetContent(generator, 100);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[2], "asset_2", 2)));
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".epb") == bundle_size);
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                const size_t free_bytes = package->getFreeSpaceBytes();
+                Assert::IsTrue(free_bytes > 0);
+                const auto bundle_size = std::filesystem::file_size(base_filename + ".epb");
+                Assert::IsFalse(static_cast<bool>(package->compact()));
+                Assert::IsTrue(package->getFreeSpaceBytes() == 0);
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".epb") == bundle_size - free_bytes);
+                for (unsigned i = 0; i < 10; i++)
+                {
+                    const auto buff = package->tryRetrieveAssetToMemory("asset_" + std::to_string(i));
+                    Assert::IsTrue(buff.has_value() == (i != 6));
+                    if (buff) Assert::IsTrue(buff.value() == contents[i]);
+                }
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestCompactCrashRecovery)
+        {
+            const std::string base_filename = makeTestPackageName("test_compact_recovery");
+            const std::string old_filename = makeTestPackageName("test_compact_recovery_old");
+            const std::string new_filename = makeTestPackageName("test_compact_recovery_new");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                for (unsigned i = 0; i < 10; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 3000 + i * 500));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_1")));
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_4")));
+                // 批次中磁碟上的 header 還參照舊的 offset, 不可以重寫 bundle
+                Assert::IsFalse(static_cast<bool>(package->beginBatch()));
+                Assert::IsTrue(package->compact() == ErrorCode::batchInProgress);
+                Assert::IsTrue(package->relayoutBundle({ "asset_9" }) == ErrorCode::batchInProgress);
+                Assert::IsFalse(static_cast<bool>(package->commitBatch()));
+            }
+            const auto copy_package = [](const std::string& from, const std::string& to)
+                {
+                    for (const std::string ext : { ".eph", ".epb" })
+                    {
+                        std::filesystem::copy_file(from + ext, to + ext, std::filesystem::copy_options::overwrite_existing);
+                    }
+                };
+            copy_package(base_filename, old_filename);
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                Assert::IsFalse(static_cast<bool>(package->compact()));
+                Assert::IsTrue(package->getFreeSpaceBytes() == 0);
+            }
+            Assert::IsFalse(std::filesystem::exists(base_filename + ".epb.rewrite"));
+            Assert::IsFalse(std::filesystem::exists(base_filename + ".eph.rewrite"));
+            copy_package(base_filename, new_filename);
+            const auto check_contents = [&](std::uint64_t bundle_size)
+                {
+                    const auto package = AssetPackageFile::openPackage(base_filename);
+                    for (unsigned i = 0; i < 10; i++)
+                    {
+                        const auto buff = package->tryRetrieveAssetToMemory("asset_" + std::to_string(i));
+                        Assert::IsTrue(buff.has_value() == ((i != 1) && (i != 4)));
+                        if (buff) Assert::IsTrue(buff.value() == contents[i]);
+                    }
+                    Assert::IsTrue(std::filesystem::file_size(base_filename + ".epb") == bundle_size);
+                    Assert::IsFalse(std::filesystem::exists(base_filename + ".epb.rewrite"));
+                    Assert::IsFalse(std::filesystem::exists(base_filename + ".eph.rewrite"));
+                };
+            // 換 bundle 之前中斷 : 兩個暫存檔都在, 丟掉後回到 compact 之前
+            copy_package(old_filename, base_filename);
+            std::filesystem::copy_file(new_filename + ".epb", base_filename + ".epb.rewrite", std::filesystem::copy_options::overwrite_existing);
+            std::filesystem::copy_file(new_filename + ".eph", base_filename + ".eph.rewrite", std::filesystem::copy_options::overwrite_existing);
+            check_contents(std::filesystem::file_size(old_filename + ".epb"));
+            // 換 bundle 之後中斷 : bundle 是新的, header 還是舊的, 開啟時把新的 header 換過去
+            copy_package(old_filename, base_filename);
+            std::filesystem::copy_file(new_filename + ".epb", base_filename + ".epb", std::filesystem::copy_options::overwrite_existing);
+            std::filesystem::copy_file(new_filename + ".eph", base_filename + ".eph.rewrite", std::filesystem::copy_options::overwrite_existing);
+            check_contents(std::filesystem::file_size(new_filename + ".epb"));
+            removeTestPackage(old_filename);
+            removeTestPackage(new_filename);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestReadOnlyMapping)
+        {
+            const std::string base_filename = makeTestPackageName("test_read_only");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto content = makeAssetContent(generator, 40000);
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content, "asset", 1)));
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                Assert::IsTrue(package->isReadOnly());
+                const auto buff = package->tryRetrieveAssetToMemory("asset");
+                Assert::IsTrue(buff.has_value());
+                Assert::IsTrue(buff.value() == content);
+                Assert::IsTrue(package->addAssetMemory(content, "other", 1) == ErrorCode::readOnlyPackage);
+                Assert::IsTrue(package->removeAsset("asset") == ErrorCode::readOnlyPackage);
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestRetrieveToBuffer)
+        {
+            const std::string base_filename = makeTestPackageName("test_retrieve_buffer");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto content = makeAssetContent(generator, 50000);
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content, "asset", 1)));
+                std::vector<char> buff(content.size() + 16);
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetToMemory("asset", buff.data(), buff.size())));
+                Assert::IsTrue(std::equal(content.begin(), content.end(), buff.begin()));
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset", buff.data(), content.size() - 1) == ErrorCode::bufferTooSmall);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("none", buff.data(), buff.size()) == ErrorCode::notExistedKey);
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                std::vector<char> buff(content.size());
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetToMemory("asset", buff.data(), buff.size())));
+                Assert::IsTrue(buff == content);
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestContentCache)
+        {
+            const std::string base_filename = makeTestPackageName("test_content_cache");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto content_a = makeAssetContent(generator, 10000);
+            const auto content_b = makeAssetContent(generator, 10000);
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_a, "a", 1)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_b, "b", 1)));
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                Assert::IsFalse(package->getContentCacheStatistics().has_value());
+                // 只放得下一個 asset
+                package->enableContentCache(15000);
+                const auto first_a = package->tryRetrieveAssetShared("a");
+                Assert::IsTrue(static_cast<bool>(first_a));
+                Assert::IsTrue(*first_a == content_a);
+                const auto second_a = package->tryRetrieveAssetShared("a");
+                Assert::IsTrue(first_a == second_a);
+                const auto first_b = package->tryRetrieveAssetShared("b");
+                Assert::IsTrue(*first_b == content_b);
+                const auto third_a = package->tryRetrieveAssetShared("a");
+                Assert::IsTrue(*third_a == content_a);
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetShared("none")));
+
+                const auto statistics = package->getContentCacheStatistics();
+                Assert::IsTrue(statistics.has_value());
+                Assert::IsTrue(statistics->m_hitCount == 1);
+                Assert::IsTrue(statistics->m_missCount == 4);
+                Assert::IsTrue(statistics->m_evictionCount == 2);
+                Assert::IsTrue(statistics->m_cachedBytes == content_a.size());
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestAssetCodecs)
+        {
+            const std::string base_filename = makeTestPackageName("test_asset_codecs");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto content = makeAssetContent(generator, 300000);
+            std::vector<char> text_content;
+            const std::string line = "texture diffuse = \"res/textures/stone_wall.png\";\n";
+            while (text_content.size() < 100000) text_content.insert(text_content.end(), line.begin(), line.end());
+            // 小 asset 的 fastLz hash table 會縮小
+            const std::vector<char> small_content(text_content.begin(), text_content.begin() + 300);
+            const std::vector<std::pair<AssetCodecId, int>> codecs = {
+                { AssetCodecId::stored, AssetCodec::DEFAULT_ZLIB_LEVEL }, { AssetCodecId::fastLz, AssetCodec::DEFAULT_ZLIB_LEVEL },
+                { AssetCodecId::zlib, 1 }, { AssetCodecId::zlib, 9 } };
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                // 同一份內容要分別存成不同的 asset
+                package->setDeduplication(false);
+                for (size_t i = 0; i < codecs.size(); i++)
+                {
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content, "asset_" + std::to_string(i), 1, codecs[i].first, codecs[i].second)));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(text_content, "text_" + std::to_string(i), 1, codecs[i].first, codecs[i].second)));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(small_content, "small_" + std::to_string(i), 1, codecs[i].first, codecs[i].second)));
+                }
+                const auto stored_header = package->tryGetAssetHeaderData("asset_0");
+                Assert::IsTrue(stored_header->m_codec == AssetCodecId::stored);
+                Assert::IsTrue(stored_header->m_size == content.size());
+                Assert::IsTrue(package->tryGetAssetHeaderData("text_1")->m_size < text_content.size() / 10);
+                Assert::IsTrue(package->tryGetAssetHeaderData("small_1")->m_size < small_content.size() / 2);
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                for (size_t i = 0; i < codecs.size(); i++)
+                {
+                    const auto header = package->tryGetAssetHeaderData("asset_" + std::to_string(i));
+                    Assert::IsTrue(header->m_codec == codecs[i].first);
+                    const auto buff = package->tryRetrieveAssetToMemory("asset_" + std::to_string(i));
+                    Assert::IsTrue(buff.has_value());
+                    Assert::IsTrue(buff.value() == content);
+                    const auto text_buff = package->tryRetrieveAssetToMemory("text_" + std::to_string(i));
+                    Assert::IsTrue(text_buff.has_value());
+                    Assert::IsTrue(text_buff.value() == text_content);
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory("small_" + std::to_string(i)).value() == small_content);
+                }
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestBuilderCodecPolicy)
+        {
+            const std::string base_filename = makeTestPackageName("test_builder_codec_policy");
+            const std::filesystem::path asset_dir = std::filesystem::temp_directory_path() / "test_builder_codec_policy_assets";
+            std::filesystem::remove_all(asset_dir);
+            std::filesystem::create_directories(asset_dir);
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::uniform_int_distribution<int> byte_rand(0, 255);
+            // 隨機內容模擬已經壓縮過的檔案
+            std::vector<char> noise(50000);
+            for (auto& c : noise) c = static_cast<char>(byte_rand(generator));
+            std::vector<char> text(50000);
+            for (size_t i = 0; i < text.size(); i++) text[i] = static_cast<char>('a' + (i % 26));
+            {
+                std::ofstream noise_file{ asset_dir / "noise.ogg", std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                noise_file.write(noise.data(), static_cast<std::streamsize>(noise.size()));
+                std::ofstream text_file{ asset_dir / "text.txt", std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                text_file.write(text.data(), static_cast<std::streamsize>(text.size()));
+            }
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                AssetPackageBuilder builder(package);
+                AssetPackageBuilder::CodecPolicy policy;
+                policy.m_isPickByRatio = true;
+                builder.setCodecPolicy(policy);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetDirectory(asset_dir.string(), "", 1)));
+                Assert::IsFalse(static_cast<bool>(builder.build(2)));
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                Assert::IsTrue(package->tryGetAssetHeaderData("noise.ogg")->m_codec == AssetCodecId::stored);
+                Assert::IsTrue(package->tryGetAssetHeaderData("text.txt")->m_codec != AssetCodecId::stored);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("noise.ogg").value() == noise);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("text.txt").value() == text);
+            }
+            std::filesystem::remove_all(asset_dir);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestStreamingAndRangeRead)
+        {
+            const std::string base_filename = makeTestPackageName("test_streaming_range");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto content = makeAssetContent(generator, 1000000);
+            constexpr unsigned int block_size = 64 * 1024;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                // 同一份內容要分別存成不同的 asset
+                package->setDeduplication(false);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content, "zlib", 1)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content, "stored", 1, AssetCodecId::stored)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content, "fast", 1, AssetCodecId::fastLz)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemorySeekable(content, "seek_zlib", 1, AssetCodecId::zlib, block_size)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemorySeekable(content, "seek_fast", 1, AssetCodecId::fastLz, block_size)));
+                Assert::IsTrue(package->tryGetAssetHeaderData("seek_zlib")->m_blockSize == block_size);
+            }
+            const std::vector<std::string> keys = { "zlib", "stored", "fast", "seek_zlib", "seek_fast" };
+            std::uniform_int_distribution<size_t> offset_rand(0, content.size() - 1);
+            for (const bool is_read_only : { false, true })
+            {
+                const auto package = is_read_only ? AssetPackageFile::openPackageReadOnly(base_filename) : AssetPackageFile::openPackage(base_filename);
+                for (const auto& key : keys)
+                {
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == content);
+                    std::vector<char> streamed;
+                    size_t max_chunk = 0;
+                    Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetStreaming(key, [&](const char* data, size_t size)
+                        {
+                            streamed.insert(streamed.end(), data, data + size);
+                            max_chunk = std::max(max_chunk, size);
+                            return true;
+                        }, 10000)));
+                    Assert::IsTrue(streamed == content);
+                    Assert::IsTrue(max_chunk <= 10000);
+                    size_t chunk_count = 0;
+                    Assert::IsTrue(package->tryRetrieveAssetStreaming(key, [&](const char*, size_t) { return ++chunk_count < 3; }) == ErrorCode::streamAborted);
+                    Assert::IsTrue(chunk_count == 3);
+
+                    for (int i = 0; i < 20; i++)
+                    {
+                        const size_t offset = offset_rand(generator);
+                        const size_t size = std::min<size_t>(content.size() - offset, 1 + offset_rand(generator) % 200000);
+                        std::vector<char> range(size);
+                        Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetRange(key, offset, range.data(), size)));
+                        Assert::IsTrue(std::equal(range.begin(), range.end(), content.begin() + static_cast<std::ptrdiff_t>(offset)));
+                    }
+                    char last_byte = 0;
+                    Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetRange(key, content.size() - 1, &last_byte, 1)));
+                    Assert::IsTrue(last_byte == content.back());
+                    Assert::IsTrue(package->tryRetrieveAssetRange(key, content.size(), &last_byte, 1) == ErrorCode::invalidRange);
+                }
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestCrcVerify)
+        {
+            Assert::IsTrue(AssetCrc32::compute("123456789", 9) == 0xCBF43926U);
+            Assert::IsTrue(AssetCrc32::compute("56789", 5, AssetCrc32::compute("1234", 4)) == 0xCBF43926U);
+
+            const std::string base_filename = makeTestPackageName("test_crc_verify");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto content = makeAssetContent(generator, 30000);
+            std::uint64_t corrupt_offset = 0;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                // 同一份內容要分別存成不同的 asset
+                package->setDeduplication(false);
+                for (int i = 0; i < 16; i++)
+                {
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content, "asset_" + std::to_string(i), 1, AssetCodecId::stored)));
+                }
+                const auto header = package->tryGetAssetHeaderData("asset_5");
+                Assert::IsTrue(header->m_hasCrc);
+                Assert::IsTrue(header->m_crc == AssetCrc32::compute(content.data(), content.size()));
+                Assert::IsTrue(package->verifyPackage(4).empty());
+                corrupt_offset = header->m_offset + 100;
+            }
+            {
+                // 模擬下載時壞掉的 bundle
+                std::fstream bundle_file{ base_filename + ".epb", std::fstream::in | std::fstream::out | std::fstream::binary };
+                bundle_file.seekp(static_cast<std::streamoff>(corrupt_offset));
+                bundle_file.put(static_cast<char>(content[100] ^ 0x5a));
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                const auto corrupted_keys = package->verifyPackage();
+                Assert::IsTrue(corrupted_keys.size() == 1);
+                Assert::IsTrue(corrupted_keys[0] == "asset_5");
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_5").has_value());
+                package->setVerifyOnRetrieve(true);
+                Assert::IsFalse(package->tryRetrieveAssetToMemory("asset_5").has_value());
+                std::vector<char> buff(content.size());
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_5", buff.data(), buff.size()) == ErrorCode::crcMismatch);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_6").value() == content);
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                Assert::IsTrue(package->verifyPackage(2).size() == 1);
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestDeduplication)
+        {
+            const std::string base_filename = makeTestPackageName("test_dedup");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto content_a = makeAssetContent(generator, 20000);
+            const auto content_b = makeAssetContent(generator, 30000);
+            const auto content_c = makeAssetContent(generator, 10000);
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                Assert::IsTrue(package->isDeduplicating());
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_a, "a1", 1)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_b, "b", 1)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_a, "a2", 1)));
+                const auto header_a1 = package->tryGetAssetHeaderData("a1");
+                const auto header_a2 = package->tryGetAssetHeaderData("a2");
+                Assert::IsTrue(header_a1->m_offset == header_a2->m_offset);
+                Assert::IsTrue(package->getDeduplicatedBytes() == header_a1->m_size);
+                // 指定不同的 codec 不共用, 另外寫入
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_a, "a_fast", 1, AssetCodecId::fastLz)));
+                const auto header_a_fast = package->tryGetAssetHeaderData("a_fast");
+                Assert::IsTrue((header_a_fast->m_offset != header_a1->m_offset) && (header_a_fast->m_codec == AssetCodecId::fastLz));
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("a_fast")));
+                // 移除一個參照, 內容還在
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("a1")));
+                Assert::IsTrue(package->getFreeSpaceBytes() == header_a_fast->m_size);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("a2").value() == content_a);
+            }
+            {
+                // 重新開啟後還是可以找到相同內容
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_a, "a3", 2)));
+                const auto header_a3 = package->tryGetAssetHeaderData("a3");
+                Assert::IsTrue(header_a3->m_offset == package->tryGetAssetHeaderData("a2")->m_offset);
+                Assert::IsTrue(header_a3->m_version == 2);
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("a2")));
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("a3")));
+                Assert::IsTrue(package->getFreeSpaceBytes() >= header_a3->m_size);
+
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_c, "c1", 1)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_c, "c2", 1)));
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("b")));
+                Assert::IsFalse(static_cast<bool>(package->compact()));
+                Assert::IsTrue(package->getFreeSpaceBytes() == 0);
+                const auto header_c1 = package->tryGetAssetHeaderData("c1");
+                Assert::IsTrue(header_c1->m_offset == 0);
+                Assert::IsTrue(package->tryGetAssetHeaderData("c2")->m_offset == 0);
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".epb") == header_c1->m_size);
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("c1").value() == content_c);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("c2").value() == content_c);
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_c, "c3", 1)));
+                Assert::IsTrue(package->tryGetAssetHeaderData("c3")->m_offset == 0);
+                // stored 跟 seekable 的要求不會被相同內容的 zlib asset 蓋掉
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_c, "c_stored", 1, AssetCodecId::stored)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemorySeekable(content_c, "c_seekable", 1, AssetCodecId::zlib, 4096)));
+                const auto header_stored = package->tryGetAssetHeaderData("c_stored");
+                const auto header_seekable = package->tryGetAssetHeaderData("c_seekable");
+                Assert::IsTrue((header_stored->m_codec == AssetCodecId::stored) && (header_stored->m_offset != 0));
+                Assert::IsTrue((header_seekable->m_blockSize == 4096) && (header_seekable->m_offset != 0));
+                Assert::IsTrue(header_seekable->m_offset != header_stored->m_offset);
+                // 相同要求的還是共用
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(content_c, "c_stored_2", 1, AssetCodecId::stored)));
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemorySeekable(content_c, "c_seekable_2", 1, AssetCodecId::zlib, 4096)));
+                Assert::IsTrue(package->tryGetAssetHeaderData("c_stored_2")->m_offset == header_stored->m_offset);
+                Assert::IsTrue(package->tryGetAssetHeaderData("c_seekable_2")->m_offset == header_seekable->m_offset);
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                const auto view = package->tryRetrieveAssetView("c_stored");
+                Assert::IsTrue(view.has_value());
+                Assert::IsTrue(std::vector<char>(view->m_data, view->m_data + view->m_size) == content_c);
+                std::vector<char> range(1000);
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetRange("c_seekable", 5000, range.data(), range.size())));
+                Assert::IsTrue(std::equal(range.begin(), range.end(), content_c.begin() + 5000));
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestBuilderDeduplication)
+        {
+            const std::string base_filename = makeTestPackageName("test_builder_dedup");
+            const std::filesystem::path asset_dir = std::filesystem::temp_directory_path() / "test_builder_dedup_assets";
+            std::filesystem::remove_all(asset_dir);
+            std::filesystem::create_directories(asset_dir);
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto shared_content = makeAssetContent(generator, 40000);
+            const auto other_content = makeAssetContent(generator, 40000);
+            for (int i = 0; i < 8; i++)
+            {
+                const auto& content = (i == 3) ? other_content : shared_content;
+                std::ofstream file{ asset_dir / ("texture_" + std::to_string(i) + ".png"), std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                file.write(content.data(), static_cast<std::streamsize>(content.size()));
+            }
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                // 已經以其他 codec 寫入的相同內容, 不會被 builder 共用
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(shared_content, "stored_copy", 1, AssetCodecId::stored)));
+                AssetPackageBuilder builder(package);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetDirectory(asset_dir.string(), "", 1)));
+                Assert::IsFalse(static_cast<bool>(builder.build(4)));
+                const auto shared_offset = package->tryGetAssetHeaderData("texture_0.png")->m_offset;
+                Assert::IsTrue(shared_offset != package->tryGetAssetHeaderData("stored_copy")->m_offset);
+                for (int i = 0; i < 8; i++)
+                {
+                    const std::string key = "texture_" + std::to_string(i) + ".png";
+                    Assert::IsTrue((package->tryGetAssetHeaderData(key)->m_offset == shared_offset) == (i != 3));
+                    Assert::IsTrue(package->tryGetAssetHeaderData(key)->m_codec == AssetCodecId::zlib);
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == ((i == 3) ? other_content : shared_content));
+                }
+                Assert::IsTrue(package->getDeduplicatedBytes() == package->tryGetAssetHeaderData("texture_0.png")->m_size * 6);
+            }
+            std::filesystem::remove_all(asset_dir);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestDictionaryCompression)
+        {
+            const std::string base_filename = makeTestPackageName("test_dictionary");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            for (unsigned i = 0; i < 200; i++)
+            {
+                contents.emplace_back(makeConfigContent(generator, i));
+            }
+            const std::vector<char> dictionary = AssetDictionaryTrainer::trainDictionary(contents);
+            Assert::IsFalse(dictionary.empty());
+            Assert::IsTrue(dictionary.size() <= AssetDictionaryTrainer::MAX_DICTIONARY_SIZE);
+            size_t zlib_bytes = 0;
+            size_t dictionary_bytes = 0;
+            for (const auto& content : contents)
+            {
+                zlib_bytes += AssetCodec::compressContent(AssetCodecId::zlib, content.data(), content.size())->size();
+                const auto comp_buff = AssetCodec::compressContent(AssetCodecId::zlibDictionary, content.data(), content.size(), AssetCodec::DEFAULT_ZLIB_LEVEL, { dictionary.data(), dictionary.size() });
+                dictionary_bytes += comp_buff->size();
+                std::vector<char> out(content.size());
+                Assert::IsFalse(static_cast<bool>(AssetCodec::uncompressContentTo(AssetCodecId::zlibDictionary, reinterpret_cast<const char*>(comp_buff->data()), comp_buff->size(), out.data(), out.size(), { dictionary.data(), dictionary.size() })));
+                Assert::IsTrue(out == content);
+                // 沒有 dictionary 解不開
+                Assert::IsTrue(static_cast<bool>(AssetCodec::uncompressContentTo(AssetCodecId::zlibDictionary, reinterpret_cast<const char*>(comp_buff->data()), comp_buff->size(), out.data(), out.size())));
+            }
+            Assert::IsTrue(dictionary_bytes * 2 < zlib_bytes);
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                Assert::IsTrue(package->addAssetMemory(contents[0], "config_0", 1, AssetCodecId::zlibDictionary) == ErrorCode::missingDictionary);
+                Assert::IsFalse(static_cast<bool>(package->setCompressionDictionary(dictionary)));
+                for (unsigned i = 0; i < 20; i++)
+                {
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[i], "config_" + std::to_string(i), 1, AssetCodecId::zlibDictionary)));
+                }
+                Assert::IsTrue(package->setCompressionDictionary({ 'a', 'b', 'c' }) == ErrorCode::dictionaryInUse);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("config_3").value() == contents[3]);
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                Assert::IsTrue(package->getCompressionDictionary() == dictionary);
+                for (unsigned i = 0; i < 20; i++)
+                {
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory("config_" + std::to_string(i)).value() == contents[i]);
+                }
+                std::vector<char> streamed;
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetStreaming("config_5", [&streamed](const char* data, size_t size)
+                    {
+                        streamed.insert(streamed.end(), data, data + size);
+                        return true;
+                    }, 16)));
+                Assert::IsTrue(streamed == contents[5]);
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                Assert::IsTrue(package->getCompressionDictionary() == dictionary);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("config_7").value() == contents[7]);
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestBuilderDictionary)
+        {
+            const std::string base_filename = makeTestPackageName("test_builder_dictionary");
+            const std::filesystem::path asset_dir = std::filesystem::temp_directory_path() / "test_builder_dictionary_assets";
+            std::filesystem::remove_all(asset_dir);
+            std::filesystem::create_directories(asset_dir);
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            for (unsigned i = 0; i < 100; i++)
+            {
+                contents.emplace_back(makeConfigContent(generator, i));
+                std::ofstream file{ asset_dir / ("config_" + std::to_string(i) + ".json"), std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                file.write(contents.back().data(), static_cast<std::streamsize>(contents.back().size()));
+            }
+            const auto large_content = makeAssetContent(generator, 100000);
+            {
+                std::ofstream file{ asset_dir / "large.bin", std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                file.write(large_content.data(), static_cast<std::streamsize>(large_content.size()));
+            }
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                AssetPackageBuilder builder(package);
+                AssetPackageBuilder::CodecPolicy policy;
+                policy.m_dictionaryMaxAssetSize = 4096;
+                builder.setCodecPolicy(policy);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetDirectory(asset_dir.string(), "", 1)));
+                Assert::IsFalse(static_cast<bool>(builder.build(4)));
+                Assert::IsFalse(package->getCompressionDictionary().empty());
+                Assert::IsTrue(package->tryGetAssetHeaderData("large.bin")->m_codec == AssetCodecId::zlib);
+                for (unsigned i = 0; i < 100; i++)
+                {
+                    const std::string key = "config_" + std::to_string(i) + ".json";
+                    Assert::IsTrue(package->tryGetAssetHeaderData(key)->m_codec == AssetCodecId::zlibDictionary);
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == contents[i]);
+                }
+                Assert::IsTrue(package->verifyPackage().empty());
+            }
+            removeTestPackage(base_filename);
+            // 不依壓縮率挑選, 直接指定 zlibDictionary; 太大的 asset 改用 zlib
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                AssetPackageBuilder builder(package);
+                AssetPackageBuilder::CodecPolicy policy;
+                policy.m_codec = AssetCodecId::zlibDictionary;
+                policy.m_dictionaryMaxAssetSize = 4096;
+                builder.setCodecPolicy(policy);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetDirectory(asset_dir.string(), "", 1)));
+                Assert::IsFalse(static_cast<bool>(builder.build(4)));
+                Assert::IsTrue(package->tryGetAssetHeaderData("large.bin")->m_codec == AssetCodecId::zlib);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("large.bin").value() == large_content);
+                for (unsigned i = 0; i < 100; i++)
+                {
+                    const std::string key = "config_" + std::to_string(i) + ".json";
+                    Assert::IsTrue(package->tryGetAssetHeaderData(key)->m_codec == AssetCodecId::zlibDictionary);
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == contents[i]);
+                }
+            }
+            removeTestPackage(base_filename);
+            // 沒有 dictionary 時, 一般 asset 跟 solid block 都用 zlib
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                AssetPackageBuilder builder(package);
+                AssetPackageBuilder::CodecPolicy policy;
+                policy.m_codec = AssetCodecId::zlibDictionary;
+                policy.m_solidMaxAssetSize = 4096;
+                builder.setCodecPolicy(policy);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetDirectory(asset_dir.string(), "", 1)));
+                Assert::IsFalse(static_cast<bool>(builder.build(4)));
+                Assert::IsTrue(package->getCompressionDictionary().empty());
+                Assert::IsTrue(package->tryGetAssetHeaderData("large.bin")->m_codec == AssetCodecId::zlib);
+                for (unsigned i = 0; i < 100; i++)
+                {
+                    const std::string key = "config_" + std::to_string(i) + ".json";
+                    const auto header = package->tryGetAssetHeaderData(key);
+                    Assert::IsTrue((header->isSolidMember()) && (header->m_codec == AssetCodecId::zlib));
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == contents[i]);
+                }
+                Assert::IsTrue(package->verifyPackage().empty());
+            }
+            std::filesystem::remove_all(asset_dir);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestAsyncRequestQueue)
+        {
+            const std::string base_filename = makeTestPackageName("test_request_queue");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            std::vector<std::vector<char>> large_contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                for (unsigned i = 0; i < 12; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 20000 + i * 100));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+                // 每個都超過合併讀取的上限一半, 不會合併, 用來檢查優先順序
+                for (unsigned i = 0; i < 3; i++)
+                {
+                    large_contents.emplace_back(makeAssetContent(generator, static_cast<size_t>(AssetRequestQueue::COALESCE_MAX_READ_SIZE / 2 + 1000)));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(large_contents.back(), "large_" + std::to_string(i), 1, AssetCodecId::stored)));
+                }
+            }
+            const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+            {
+                AssetRequestQueue queue(package, 1);
+                queue.pause();
+                std::vector<AssetRequestQueue::FutureRequest> requests;
+                for (unsigned i = 0; i < 12; i++)
+                {
+                    requests.push_back(queue.requestAsset("asset_" + std::to_string(i), AssetRequestQueue::Priority::normal));
+                }
+                auto missing_request = queue.requestAsset("not_existed", AssetRequestQueue::Priority::high);
+                Assert::IsTrue(queue.cancelRequest(requests[4].m_id));
+                Assert::IsFalse(queue.cancelRequest(requests[4].m_id));
+                Assert::IsTrue(queue.getPendingCount() == 12);
+                queue.resume();
+                Assert::IsTrue(missing_request.m_future.get().m_error == ErrorCode::notExistedKey);
+                for (unsigned i = 0; i < 12; i++)
+                {
+                    const auto result = requests[i].m_future.get();
+                    if (i == 4)
+                    {
+                        Assert::IsTrue(result.m_error == ErrorCode::requestCanceled);
+                        continue;
+                    }
+                    Assert::IsFalse(static_cast<bool>(result.m_error));
+                    Assert::IsTrue(*result.m_content == contents[i]);
+                }
+                const auto statistics = queue.getStatistics();
+                Assert::IsTrue(statistics.m_canceledCount == 1);
+                Assert::IsTrue(statistics.m_completedCount == 12);
+                Assert::IsTrue(statistics.m_coalescedCount > 0);
+                Assert::IsTrue(statistics.m_readCount < 11);
+            }
+            {
+                AssetRequestQueue queue(package, 1);
+                queue.pause();
+                std::mutex order_locker;
+                std::vector<std::string> completed_keys;
+                std::atomic<unsigned> completed_count = 0;
+                const AssetRequestQueue::Completion completion = [&](const std::string& asset_key, const AssetRequestQueue::Result& result)
+                    {
+                        Assert::IsFalse(static_cast<bool>(result.m_error));
+                        const std::lock_guard<std::mutex> lock{ order_locker };
+                        completed_keys.push_back(asset_key);
+                        completed_count++;
+                    };
+                queue.requestAsset("large_0", AssetRequestQueue::Priority::background, completion);
+                queue.requestAsset("large_1", AssetRequestQueue::Priority::normal, completion);
+                queue.requestAsset("large_2", AssetRequestQueue::Priority::high, completion);
+                queue.resume();
+                while (completed_count < 3)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                Assert::IsTrue(completed_keys == std::vector<std::string>{ "large_2", "large_1", "large_0" });
+            }
+            {
+                // queue 結束時還沒開始的 request 都會完成, future 不會一直等
+                std::future<AssetRequestQueue::Result> future;
+                {
+                    AssetRequestQueue queue(package, 2);
+                    queue.pause();
+                    future = queue.requestAsset("asset_0", AssetRequestQueue::Priority::normal).m_future;
+                }
+                Assert::IsTrue(future.get().m_error == ErrorCode::requestCanceled);
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestAccessTraceRelayout)
+        {
+            const std::string base_filename = makeTestPackageName("test_relayout");
+            const std::string trace_filename = makeTestPackageName("test_relayout_trace.txt");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            std::vector<std::string> access_order;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                for (unsigned i = 0; i < 10; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 5000 + i * 700));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[7], "asset_dup", 1)));
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_3")));
+
+                package->enableAccessTrace();
+                for (const unsigned i : { 8, 2, 8, 5 })
+                {
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_" + std::to_string(i)).value() == contents[i]);
+                }
+                Assert::IsTrue(*package->tryRetrieveAssetShared("asset_dup") == contents[7]);
+                std::vector<char> buff(contents[0].size());
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetToMemory("asset_0", buff.data(), buff.size())));
+                access_order = package->getAccessTrace()->getAccessOrder();
+                Assert::IsTrue(access_order == std::vector<std::string>{ "asset_8", "asset_2", "asset_5", "asset_dup", "asset_0" });
+                Assert::IsFalse(static_cast<bool>(package->getAccessTrace()->exportToFile(trace_filename)));
+                AssetAccessTrace imported_trace;
+                Assert::IsFalse(static_cast<bool>(imported_trace.importFromFile(trace_filename)));
+                Assert::IsTrue(imported_trace.getAccessOrder() == access_order);
+                package->disableAccessTrace();
+
+                Assert::IsFalse(static_cast<bool>(package->relayoutBundle(access_order)));
+                Assert::IsTrue(package->getFreeSpaceBytes() == 0);
+                std::uint64_t expected_offset = 0;
+                for (const auto& asset_key : access_order)
+                {
+                    const auto header = package->tryGetAssetHeaderData(asset_key);
+                    Assert::IsTrue(header->m_offset == expected_offset);
+                    expected_offset += header->m_size;
+                }
+                Assert::IsTrue(package->tryGetAssetHeaderData("asset_7")->m_offset == package->tryGetAssetHeaderData("asset_dup")->m_offset);
+                // 沒有讀過的依原本順序接在後面
+                Assert::IsTrue(package->tryGetAssetHeaderData("asset_1")->m_offset == expected_offset);
+                Assert::IsTrue(package->tryGetAssetHeaderData("asset_4")->m_offset > expected_offset);
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                std::uint64_t bundle_bytes = 0;
+                for (unsigned i = 0; i < 10; i++)
+                {
+                    if (i == 3) continue;
+                    const std::string asset_key = "asset_" + std::to_string(i);
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(asset_key).value() == contents[i]);
+                    bundle_bytes += package->tryGetAssetHeaderData(asset_key)->m_size;
+                }
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".epb") == bundle_bytes);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[7], "asset_dup_2", 1)));
+                Assert::IsTrue(package->tryGetAssetHeaderData("asset_dup_2")->m_offset == package->tryGetAssetHeaderData("asset_7")->m_offset);
+            }
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                AssetPackageBuilder builder(package);
+                for (unsigned i = 0; i < 4; i++)
+                {
+                    Assert::IsFalse(static_cast<bool>(builder.appendAssetFile(trace_filename, "file_" + std::to_string(i), 1)));
+                }
+                builder.applyAccessOrder({ "file_2", "not_in_builder", "file_0" });
+                const auto& entries = builder.getEntries();
+                Assert::IsTrue((entries[0].m_assetKey == "file_2") && (entries[1].m_assetKey == "file_0"));
+                Assert::IsTrue((entries[2].m_assetKey == "file_1") && (entries[3].m_assetKey == "file_3"));
+            }
+            std::filesystem::remove(trace_filename);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestAccessStatistics)
+        {
+            const std::string base_filename = makeTestPackageName("test_access_statistics");
+            const std::string statistics_filename = makeTestPackageName("test_access_statistics.txt");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                package->enableAccessStatistics();
+                for (unsigned i = 0; i < 4; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 20000 + i * 3000));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_3")));
+                const auto snapshot = package->getAccessStatistics()->getSnapshot();
+                Assert::IsTrue(snapshot.m_assets.empty());
+                Assert::IsTrue(snapshot.m_bundleLockWait.m_acquireCount >= 5);
+                Assert::IsTrue(snapshot.m_headerLockWait.m_acquireCount >= 5);
+                Assert::IsTrue(snapshot.m_bundleLockWait.m_contendedCount <= snapshot.m_bundleLockWait.m_acquireCount);
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                package->enableAccessStatistics();
+                package->enableContentCache(1024 * 1024);
+                for (unsigned r = 0; r < 3; r++)
+                {
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_0").value() == contents[0]);
+                }
+                // 第一次沒命中要解壓, 第二次從 cache 取得, 兩次都算讀取
+                Assert::IsTrue(*package->tryRetrieveAssetShared("asset_1") == contents[1]);
+                Assert::IsTrue(*package->tryRetrieveAssetShared("asset_1") == contents[1]);
+                std::vector<char> range(1000);
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetRange("asset_2", 5000, range.data(), range.size())));
+                Assert::IsFalse(package->tryRetrieveAssetToMemory("not_existed").has_value());
+
+                const auto snapshot = package->getAccessStatistics()->getSnapshot();
+                Assert::IsTrue(snapshot.m_assets.size() == 3);
+                Assert::IsTrue((snapshot.m_assets[0].m_key == "asset_0") && (snapshot.m_assets[0].m_hitCount == 3));
+                Assert::IsTrue((snapshot.m_assets[1].m_key == "asset_1") && (snapshot.m_assets[1].m_hitCount == 2));
+                Assert::IsTrue((snapshot.m_assets[2].m_key == "asset_2") && (snapshot.m_assets[2].m_hitCount == 1));
+                const auto header_0 = package->tryGetAssetHeaderData("asset_0");
+                const auto header_1 = package->tryGetAssetHeaderData("asset_1");
+                Assert::IsTrue(snapshot.m_assets[0].m_readBytes == header_0->m_size * 3);
+                Assert::IsTrue((snapshot.m_assets[0].m_decompressCount == 3) && (snapshot.m_assets[0].m_decompressedBytes == contents[0].size() * 3));
+                Assert::IsTrue(snapshot.m_assets[1].m_readBytes == header_1->m_size);
+                Assert::IsTrue(snapshot.m_assets[1].m_decompressCount == 1);
+                // 範圍讀取只記讀取的 bytes
+                Assert::IsTrue((snapshot.m_assets[2].m_readBytes > 0) && (snapshot.m_assets[2].m_decompressCount == 0));
+                Assert::IsTrue(snapshot.m_hitCount == 6);
+                Assert::IsTrue(snapshot.m_decompressCount == 4);
+                std::uint64_t histogram_count = 0;
+                for (const std::uint64_t count : snapshot.m_decompressHistogram) histogram_count += count;
+                Assert::IsTrue(histogram_count == snapshot.m_decompressCount);
+                Assert::IsTrue(snapshot.m_assets[0].m_maxDecompressNanoseconds <= snapshot.m_assets[0].m_decompressNanoseconds);
+
+                Assert::IsFalse(static_cast<bool>(AssetAccessStatistics::exportToFile(snapshot, statistics_filename)));
+                std::ifstream statistics_file{ statistics_filename };
+                std::string line;
+                std::map<std::string, unsigned> line_counts;
+                while (std::getline(statistics_file, line))
+                {
+                    line_counts[line.substr(0, line.find('\t'))]++;
+                }
+                Assert::IsTrue(line_counts == std::map<std::string, unsigned>{ { "total", 1 }, { "decompress_histogram", 1 }, { "lock_wait", 2 }, { "asset", 3 } });
+
+                package->getAccessStatistics()->clear();
+                Assert::IsTrue(package->getAccessStatistics()->getSnapshot().m_hitCount == 0);
+                package->disableAccessStatistics();
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_0").value() == contents[0]);
+                Assert::IsFalse(static_cast<bool>(package->getAccessStatistics()));
+            }
+            std::filesystem::remove(statistics_filename);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestPackageOverlay)
+        {
+            const std::string base_filename = makeTestPackageName("test_overlay_base");
+            const std::string patch_filename = makeTestPackageName("test_overlay_patch");
+            const std::string dlc_filename = makeTestPackageName("test_overlay_dlc");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::unordered_map<std::string, std::vector<char>> base_contents;
+            std::unordered_map<std::string, std::vector<char>> patch_contents;
+            std::unordered_map<std::string, std::vector<char>> dlc_contents;
+            const auto make_package = [&generator](const std::string& filename, const std::vector<std::string>& keys, std::unordered_map<std::string, std::vector<char>>& contents)
+                {
+                    const auto package = AssetPackageFile::createNewPackage(filename);
+                    for (const auto& key : keys)
+                    {
+                        contents[key] = makeAssetContent(generator, 3000);
+                        Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[key], key, 1)));
+                    }
+                };
+            make_package(base_filename, { "a", "b", "c" }, base_contents);
+            make_package(patch_filename, { "b", "d" }, patch_contents);
+            make_package(dlc_filename, { "c", "e" }, dlc_contents);
+
+            const auto base_package = AssetPackageFile::openPackageReadOnly(base_filename);
+            const auto patch_package = AssetPackageFile::openPackageReadOnly(patch_filename);
+            const auto dlc_package = AssetPackageFile::openPackageReadOnly(dlc_filename);
+            AssetPackageOverlay overlay;
+            Assert::IsFalse(static_cast<bool>(overlay.mountPackage(base_package, 0)));
+            Assert::IsFalse(static_cast<bool>(overlay.mountPackage(patch_package, 10)));
+            // 後 mount 但 priority 比 patch 低, 插在中間
+            Assert::IsFalse(static_cast<bool>(overlay.mountPackage(dlc_package, 5)));
+            Assert::IsTrue(overlay.mountPackage(dlc_package, 20) == ErrorCode::duplicatedKey);
+            Assert::IsTrue(overlay.getLayerCount() == 3);
+            Assert::IsTrue(overlay.getAssetCount() == 5);
+            Assert::IsTrue(overlay.tryFindPackage("a") == base_package);
+            Assert::IsTrue(overlay.tryFindPackage("b") == patch_package);
+            Assert::IsTrue(overlay.tryFindPackage("c") == dlc_package);
+            Assert::IsTrue(overlay.tryRetrieveAssetToMemory("b").value() == patch_contents["b"]);
+            Assert::IsTrue(overlay.tryRetrieveAssetToMemory("c").value() == dlc_contents["c"]);
+            Assert::IsTrue(*overlay.tryRetrieveAssetShared("e") == dlc_contents["e"]);
+            std::vector<char> buff(3000);
+            Assert::IsFalse(static_cast<bool>(overlay.tryRetrieveAssetToMemory("a", buff.data(), buff.size())));
+            Assert::IsTrue(buff == base_contents["a"]);
+            Assert::IsTrue(overlay.tryRetrieveAssetToMemory("f", buff.data(), buff.size()) == ErrorCode::notExistedKey);
+            Assert::IsFalse(overlay.tryGetAssetHeaderData("f").has_value());
+
+            // 拿掉 patch, 被蓋住的 b 回到 base
+            Assert::IsFalse(static_cast<bool>(overlay.unmountPackage(patch_package)));
+            Assert::IsTrue(overlay.unmountPackage(patch_package) == ErrorCode::notExistedKey);
+            Assert::IsTrue(overlay.getAssetCount() == 4);
+            Assert::IsFalse(overlay.hasAssetKey("d"));
+            Assert::IsTrue(overlay.tryRetrieveAssetToMemory("b").value() == base_contents["b"]);
+            Assert::IsTrue(overlay.tryRetrieveAssetToMemory("c").value() == dlc_contents["c"]);
+            overlay.unmountAll();
+            Assert::IsTrue(overlay.getAssetCount() == 0);
+
+            removeTestPackage(base_filename);
+            removeTestPackage(patch_filename);
+            removeTestPackage(dlc_filename);
+        }
+        TEST_METHOD(TestPackagePatch)
+        {
+            const std::string old_filename = makeTestPackageName("test_patch_old");
+            const std::string new_filename = makeTestPackageName("test_patch_new");
+            const std::string patch_filename = makeTestPackageName("test_patch_delta");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::unordered_map<std::string, std::vector<char>> new_contents;
+            const auto old_package = AssetPackageFile::createNewPackage(old_filename);
+            const auto new_package = AssetPackageFile::createNewPackage(new_filename);
+            for (const std::string key : { "a", "b", "c", "d" })
+            {
+                const auto content = makeAssetContent(generator, 3000);
+                Assert::IsFalse(static_cast<bool>(old_package->addAssetMemory(content, key, 1)));
+                // d 在新版被移除, 其他的先原樣複製
+                if (key == "d") continue;
+                new_contents[key] = content;
+                Assert::IsFalse(static_cast<bool>(new_package->addAssetMemory(content, key, 1)));
+            }
+            new_contents["b"] = makeAssetContent(generator, 5000);
+            Assert::IsFalse(static_cast<bool>(new_package->removeAsset("b")));
+            Assert::IsFalse(static_cast<bool>(new_package->addAssetMemory(new_contents["b"], "b", 2)));
+            new_contents["e"] = makeAssetContent(generator, 2000);
+            Assert::IsFalse(static_cast<bool>(new_package->addAssetMemory(new_contents["e"], "e", 1)));
+
+            const auto summary = AssetPackagePatch::diffPackages(old_package, new_package);
+            Assert::IsTrue(summary.m_changedKeys == std::vector<std::string>{ "b" });
+            Assert::IsTrue(summary.m_addedKeys == std::vector<std::string>{ "e" });
+            Assert::IsTrue(summary.m_removedKeys == std::vector<std::string>{ "d" });
+            Assert::IsTrue(summary.m_contentBytes == new_package->tryGetAssetHeaderData("b")->m_size + new_package->tryGetAssetHeaderData("e")->m_size);
+
+            const auto patch_package = AssetPackageFile::createNewPackage(patch_filename);
+            Assert::IsFalse(static_cast<bool>(AssetPackagePatch::createPatch(old_package, new_package, patch_package)));
+            // 沒變的 a, c 不會進 patch
+            Assert::IsTrue(patch_package->getAssetKeys().size() == 3);
+            Assert::IsFalse(patch_package->tryGetAssetHeaderData("a").has_value());
+
+            const auto patch_read_only = AssetPackageFile::openPackageReadOnly(patch_filename);
+            Assert::IsFalse(static_cast<bool>(AssetPackagePatch::applyPatch(old_package, patch_read_only)));
+            Assert::IsFalse(old_package->tryGetAssetHeaderData("d").has_value());
+            Assert::IsTrue(old_package->tryGetAssetHeaderData("b")->m_version == 2);
+            for (const auto& [key, content] : new_contents)
+            {
+                Assert::IsTrue(old_package->tryRetrieveAssetToMemory(key).value() == content);
+            }
+            const auto resummary = AssetPackagePatch::diffPackages(old_package, new_package);
+            Assert::IsTrue(resummary.m_changedKeys.empty() && resummary.m_addedKeys.empty() && resummary.m_removedKeys.empty());
+
+            removeTestPackage(old_filename);
+            removeTestPackage(new_filename);
+            removeTestPackage(patch_filename);
+        }
+        TEST_METHOD(TestPackagePatchDedupCodecs)
+        {
+            const std::string old_filename = makeTestPackageName("test_patch_codec_old");
+            const std::string new_filename = makeTestPackageName("test_patch_codec_new");
+            const std::string patch_filename = makeTestPackageName("test_patch_codec_delta");
+            const std::filesystem::path asset_dir = std::filesystem::temp_directory_path() / "test_patch_codec_assets";
+            std::filesystem::remove_all(asset_dir);
+            std::filesystem::create_directories(asset_dir);
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto plain_content = makeAssetContent(generator, 6000);
+            const auto solid_content = makeAssetContent(generator, 1500);
+            const auto pad_content = makeAssetContent(generator, 1200);
+            for (const auto& [key, content] : { std::make_pair("solid_a.bin", &solid_content), std::make_pair("solid_b.bin", &solid_content),
+                std::make_pair("pad_a.bin", &pad_content), std::make_pair("pad_b.bin", &plain_content) })
+            {
+                std::ofstream file{ asset_dir / key, std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                file.write(content->data(), static_cast<std::streamsize>(content->size()));
+            }
+            {
+                const auto old_package = AssetPackageFile::createNewPackage(old_filename);
+                Assert::IsFalse(static_cast<bool>(old_package->addAssetMemory(pad_content, "stale", 1)));
+                // 新版的內容全部重複, 只是 codec 或 block size 不同
+                const auto new_package = AssetPackageFile::createNewPackage(new_filename);
+                Assert::IsFalse(static_cast<bool>(new_package->addAssetMemory(plain_content, "plain_zlib", 1)));
+                Assert::IsFalse(static_cast<bool>(new_package->addAssetMemory(plain_content, "plain_fast", 1, AssetCodecId::fastLz)));
+                Assert::IsFalse(static_cast<bool>(new_package->addAssetMemory(plain_content, "plain_stored", 1, AssetCodecId::stored)));
+                Assert::IsFalse(static_cast<bool>(new_package->addAssetMemorySeekable(plain_content, "plain_seekable", 1, AssetCodecId::zlib, 1024)));
+                // 兩個 solid block 各有一個相同內容的成員, block 的 codec 不同
+                for (const auto& [codec, solid_key, pad_key] : { std::make_tuple(AssetCodecId::zlib, "solid_a.bin", "pad_a.bin"), std::make_tuple(AssetCodecId::fastLz, "solid_b.bin", "pad_b.bin") })
+                {
+                    AssetPackageBuilder::CodecPolicy policy;
+                    policy.m_codec = codec;
+                    policy.m_solidMaxAssetSize = 8192;
+                    AssetPackageBuilder builder(new_package);
+                    builder.setCodecPolicy(policy);
+                    Assert::IsFalse(static_cast<bool>(builder.appendAssetFile((asset_dir / solid_key).string(), solid_key, 1)));
+                    Assert::IsFalse(static_cast<bool>(builder.appendAssetFile((asset_dir / pad_key).string(), pad_key, 1)));
+                    Assert::IsFalse(static_cast<bool>(builder.build(1)));
+                }
+                Assert::IsTrue(new_package->tryGetAssetHeaderData("solid_b.bin")->isSolidMember());
+                Assert::IsTrue(new_package->tryGetAssetHeaderData("solid_b.bin")->m_codec == AssetCodecId::fastLz);
+
+                const auto patch_package = AssetPackageFile::createNewPackage(patch_filename);
+                Assert::IsFalse(static_cast<bool>(AssetPackagePatch::createPatch(old_package, new_package, patch_package)));
+                // solid 成員在 patch 裡是一般 asset, codec 不同的相同內容不能共用
+                const auto patch_a = patch_package->tryGetAssetHeaderData("solid_a.bin");
+                const auto patch_b = patch_package->tryGetAssetHeaderData("solid_b.bin");
+                Assert::IsTrue((patch_a->m_codec == AssetCodecId::zlib) && (patch_b->m_codec == AssetCodecId::fastLz));
+                Assert::IsTrue(patch_a->m_offset != patch_b->m_offset);
+
+                const auto patch_read_only = AssetPackageFile::openPackageReadOnly(patch_filename);
+                Assert::IsFalse(static_cast<bool>(AssetPackagePatch::applyPatch(old_package, patch_read_only)));
+                Assert::IsFalse(old_package->tryGetAssetHeaderData("stale").has_value());
+                for (const auto& key : new_package->getAssetKeys())
+                {
+                    const auto new_header = new_package->tryGetAssetHeaderData(key);
+                    const auto applied_header = old_package->tryGetAssetHeaderData(key);
+                    Assert::IsTrue(applied_header->m_codec == new_header->m_codec);
+                    Assert::IsTrue(applied_header->m_blockSize == new_header->m_blockSize);
+                    Assert::IsTrue(old_package->tryRetrieveAssetToMemory(key).value() == new_package->tryRetrieveAssetToMemory(key).value());
+                }
+            }
+            {
+                const auto applied_read_only = AssetPackageFile::openPackageReadOnly(old_filename);
+                const auto view = applied_read_only->tryRetrieveAssetView("plain_stored");
+                Assert::IsTrue(view.has_value());
+                Assert::IsTrue(std::vector<char>(view->m_data, view->m_data + view->m_size) == plain_content);
+                std::vector<char> range(1000);
+                Assert::IsFalse(static_cast<bool>(applied_read_only->tryRetrieveAssetRange("plain_seekable", 3000, range.data(), range.size())));
+                Assert::IsTrue(std::equal(range.begin(), range.end(), plain_content.begin() + 3000));
+            }
+
+            std::filesystem::remove_all(asset_dir);
+            removeTestPackage(old_filename);
+            removeTestPackage(new_filename);
+            removeTestPackage(patch_filename);
+        }
+        TEST_METHOD(TestHeaderJournal)
+        {
+            const std::string base_filename = makeTestPackageName("test_header_journal");
+            const std::string crash_filename = makeTestPackageName("test_header_journal_crash");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            const std::vector<char> added_content = makeAssetContent(generator, 4000);
+            std::uint64_t removed_size = 0;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                Assert::IsFalse(static_cast<bool>(package->beginBatch()));
+                for (unsigned int i = 0; i < 100; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 1000 + i));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+                Assert::IsFalse(static_cast<bool>(package->commitBatch()));
+                const auto snapshot_size = std::filesystem::file_size(base_filename + ".eph");
+
+                // 單筆修改只 append 一筆 record, 不會重寫 100 筆的 index
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(added_content, "added", 2)));
+                removed_size = package->tryGetAssetHeaderData("asset_7")->m_size;
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_7")));
+                const auto journal_size = std::filesystem::file_size(base_filename + ".eph");
+                Assert::IsTrue(journal_size > snapshot_size);
+                Assert::IsTrue(journal_size - snapshot_size < 256);
+
+                // 模擬寫到一半中斷: 尾端接上不完整的 record, 再把檔案複製走當作當機後留下的 package
+                {
+                    std::ofstream header_file{ base_filename + ".eph", std::fstream::out | std::fstream::binary | std::fstream::app };
+                    const std::vector<char> torn_record(10, 0x5a);
+                    header_file.write(torn_record.data(), static_cast<std::streamsize>(torn_record.size()));
+                }
+                std::filesystem::copy_file(base_filename + ".eph", crash_filename + ".eph", std::filesystem::copy_options::overwrite_existing);
+                std::filesystem::copy_file(base_filename + ".epb", crash_filename + ".epb", std::filesystem::copy_options::overwrite_existing);
+                // 整份重寫 header 時中斷, 留下寫到一半的 checkpoint 暫存檔
+                std::ofstream checkpoint_file{ crash_filename + ".eph.checkpoint", std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                const std::vector<char> torn_snapshot(64, 0x5a);
+                checkpoint_file.write(torn_snapshot.data(), static_cast<std::streamsize>(torn_snapshot.size()));
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(crash_filename);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("added").value() == added_content);
+                Assert::IsFalse(package->tryGetAssetHeaderData("asset_7").has_value());
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_8").value() == contents[8]);
+            }
+            {
+                // 可寫入開啟時丟掉不完整的 record, 移除留下的空間也要還原
+                const auto package = AssetPackageFile::openPackage(crash_filename);
+                Assert::IsFalse(std::filesystem::exists(crash_filename + ".eph.checkpoint"));
+                Assert::IsTrue(package->getFreeSpaceBytes() == removed_size);
+                Assert::IsTrue(package->getAssetKeys().size() == 100);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[7], "asset_7", 3)));
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_7").value() == contents[7]);
+            }
+            {
+                // 關檔時 journal 已經併回 index
+                const auto package = AssetPackageFile::openPackageReadOnly(crash_filename);
+                Assert::IsTrue(package->tryGetAssetHeaderData("asset_7")->m_version == 3);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("added").value() == added_content);
+                const auto base_package = AssetPackageFile::openPackageReadOnly(base_filename);
+                Assert::IsTrue(base_package->tryRetrieveAssetToMemory("added").value() == added_content);
+                Assert::IsFalse(base_package->tryGetAssetHeaderData("asset_7").has_value());
+            }
+            removeTestPackage(base_filename);
+            removeTestPackage(crash_filename);
+        }
+        TEST_METHOD(TestHeaderDataMapRemove)
+        {
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            AssetHeaderDataMap header_map;
+            std::map<std::string, std::uint64_t> expected_offsets;
+            std::uniform_int_distribution<unsigned int> key_rand(0, 2999);
+            for (unsigned int i = 0; i < 20000; i++)
+            {
+                // 反覆加入移除, 會經過 rehash, backward shift 跟名稱 arena 的重整
+                const std::string key = "textures/terrain/tile_" + std::to_string(key_rand(generator)) + ".dds";
+                if (expected_offsets.count(key) > 0)
+                {
+                    Assert::IsFalse(static_cast<bool>(header_map.removeHeaderData(key)));
+                    expected_offsets.erase(key);
+                    continue;
+                }
+                AssetHeaderDataMap::AssetHeaderData header;
+                header.m_name = key;
+                header.m_offset = i;
+                Assert::IsFalse(static_cast<bool>(header_map.insertHeaderData(header)));
+                Assert::IsTrue(header_map.insertHeaderData(header) == ErrorCode::duplicatedKey);
+                expected_offsets[key] = i;
+            }
+            Assert::IsTrue(header_map.getTotalDataCount() == expected_offsets.size());
+            Assert::IsTrue(header_map.removeHeaderData("textures/none.dds") == ErrorCode::notExistedKey);
+            const auto headers = header_map.getHeaderDataOrderByName();
+            Assert::IsTrue(headers.size() == expected_offsets.size());
+            auto expected_iter = expected_offsets.begin();
+            for (const auto& header : headers)
+            {
+                Assert::IsTrue(header.m_name == expected_iter->first);
+                Assert::IsTrue(header.m_offset == expected_iter->second);
+                Assert::IsTrue(header_map.tryGetHeaderData(header.m_name)->m_offset == expected_iter->second);
+                ++expected_iter;
+            }
+        }
+        TEST_METHOD(TestAlignedStoredView)
+        {
+            const std::string base_filename = makeTestPackageName("test_aligned_view");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            constexpr std::uint64_t alignment = 4096;
+            std::unordered_map<std::string, std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                package->setDeduplication(false);
+                Assert::IsTrue(package->setStoredAlignment(100) == ErrorCode::invalidRange);
+                Assert::IsFalse(static_cast<bool>(package->setStoredAlignment(alignment)));
+                for (unsigned int i = 0; i < 6; i++)
+                {
+                    const std::string small_key = "small_" + std::to_string(i);
+                    const std::string mesh_key = "mesh_" + std::to_string(i);
+                    contents[small_key] = makeAssetContent(generator, 300 + i * 7);
+                    contents[mesh_key] = makeAssetContent(generator, 10000 + i * 1001);
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[small_key], small_key, 1)));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[mesh_key], mesh_key, 1, AssetCodecId::stored)));
+                }
+                // 對齊補的空間給之後的壓縮 asset 用
+                Assert::IsTrue(package->getFreeSpaceBytes() > 0);
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("mesh_1")));
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("small_3")));
+                contents.erase("mesh_1");
+                contents.erase("small_3");
+                contents["mesh_6"] = makeAssetContent(generator, 9000);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents["mesh_6"], "mesh_6", 1, AssetCodecId::stored)));
+                Assert::IsFalse(static_cast<bool>(package->compact()));
+                for (const auto& [key, content] : contents)
+                {
+                    const auto header = package->tryGetAssetHeaderData(key);
+                    if (header->m_codec == AssetCodecId::stored) Assert::IsTrue(header->m_offset % alignment == 0);
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == content);
+                }
+                // 可寫入開啟時沒有 mapping
+                Assert::IsFalse(package->tryRetrieveAssetView("mesh_0").has_value());
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                package->setVerifyOnRetrieve(true);
+                for (const auto& [key, content] : contents)
+                {
+                    const auto view = package->tryRetrieveAssetView(key);
+                    if (key.rfind("small_", 0) == 0)
+                    {
+                        Assert::IsFalse(view.has_value());
+                        continue;
+                    }
+                    Assert::IsTrue(view.has_value());
+                    Assert::IsTrue(reinterpret_cast<std::uintptr_t>(view->m_data) % alignment == 0);
+                    Assert::IsTrue(std::vector<char>(view->m_data, view->m_data + view->m_size) == content);
+                }
+                Assert::IsFalse(package->tryRetrieveAssetView("mesh_none").has_value());
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestBuilderSolidBlock)
+        {
+            const std::string base_filename = makeTestPackageName("test_builder_solid");
+            const std::filesystem::path asset_dir = std::filesystem::temp_directory_path() / "test_builder_solid_assets";
+            std::filesystem::remove_all(asset_dir);
+            std::filesystem::create_directories(asset_dir);
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::map<std::string, std::vector<char>> contents;
+            for (unsigned i = 0; i < 200; i++)
+            {
+                contents["config_" + std::to_string(i) + ".json"] = makeConfigContent(generator, i);
+            }
+            // 相同內容的小 asset 在 block 裡只存一次
+            contents["copy_of_config_7.json"] = contents["config_7.json"];
+            contents["large.bin"] = makeAssetContent(generator, 100000);
+            for (const auto& [key, content] : contents)
+            {
+                std::ofstream file{ asset_dir / key, std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                file.write(content.data(), static_cast<std::streamsize>(content.size()));
+            }
+            const auto get_block_offsets = [&contents](const std::shared_ptr<AssetPackageFile>& package)
+                {
+                    std::map<std::uint64_t, unsigned> block_offsets;
+                    for (const auto& [key, content] : contents)
+                    {
+                        const auto header = package->tryGetAssetHeaderData(key);
+                        if ((header) && (header->isSolidMember())) block_offsets[header->m_offset]++;
+                    }
+                    return block_offsets;
+                };
+            size_t block_count = 0;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                AssetPackageBuilder builder(package);
+                AssetPackageBuilder::CodecPolicy policy;
+                policy.m_solidMaxAssetSize = 4096;
+                policy.m_solidBlockSize = 16 * 1024;
+                builder.setCodecPolicy(policy);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetDirectory(asset_dir.string(), "", 1)));
+                Assert::IsFalse(static_cast<bool>(builder.build(4)));
+                Assert::IsFalse(package->tryGetAssetHeaderData("large.bin")->isSolidMember());
+                const auto config_7 = package->tryGetAssetHeaderData("config_7.json");
+                const auto copy_of_config_7 = package->tryGetAssetHeaderData("copy_of_config_7.json");
+                Assert::IsTrue(config_7->isSolidMember());
+                Assert::IsTrue((copy_of_config_7->m_offset == config_7->m_offset) && (copy_of_config_7->m_solidOffset == config_7->m_solidOffset));
+                block_count = get_block_offsets(package).size();
+                Assert::IsTrue((block_count > 1) && (block_count < 10));
+                for (const auto& [key, content] : contents)
+                {
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == content);
+                }
+                // 依 entry 順序讀取, 每個 block 只解壓一次
+                Assert::IsTrue(package->getSolidBlockCacheStatistics().m_missCount == block_count);
+                char range_buff[16];
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetRange("config_42.json", 10, range_buff, sizeof(range_buff))));
+                Assert::IsTrue(std::equal(range_buff, range_buff + sizeof(range_buff), contents["config_42.json"].begin() + 10));
+                Assert::IsTrue(package->verifyPackage().empty());
+            }
+            {
+                // 移除成員後 block 還在, 整個 block 的成員都移除才釋放空間
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                const auto block_offsets = get_block_offsets(package);
+                const std::uint64_t removed_offset = block_offsets.begin()->first;
+                for (auto it = contents.begin(); it != contents.end();)
+                {
+                    const auto header = package->tryGetAssetHeaderData(it->first);
+                    if ((header->isSolidMember()) && (header->m_offset == removed_offset))
+                    {
+                        Assert::IsFalse(static_cast<bool>(package->removeAsset(it->first)));
+                        it = contents.erase(it);
+                        continue;
+                    }
+                    ++it;
+                }
+                Assert::IsTrue(package->getFreeSpaceBytes() > 0);
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("config_199.json")));
+                contents.erase("config_199.json");
+            }
+            {
+                // journal 重建的 reference count 要跟寫入時一樣
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                Assert::IsTrue(get_block_offsets(package).size() == block_count - 1);
+                Assert::IsFalse(static_cast<bool>(package->compact()));
+                Assert::IsTrue(package->getFreeSpaceBytes() == 0);
+                for (const auto& [key, content] : contents)
+                {
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == content);
+                }
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                package->setVerifyOnRetrieve(true);
+                for (const auto& [key, content] : contents)
+                {
+                    Assert::IsTrue(package->tryRetrieveAssetToMemory(key).value() == content);
+                }
+                Assert::IsTrue(package->getSolidBlockCacheStatistics().m_missCount == block_count - 1);
+                Assert::IsTrue(package->verifyPackage().empty());
+            }
+            std::filesystem::remove_all(asset_dir);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestSolidBlockSharedRemove)
+        {
+            const std::string base_filename = makeTestPackageName("test_solid_shared_remove");
+            const std::filesystem::path asset_dir = std::filesystem::temp_directory_path() / "test_solid_shared_remove_assets";
+            std::filesystem::remove_all(asset_dir);
+            std::filesystem::create_directories(asset_dir);
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto first_content = makeAssetContent(generator, 2000);
+            const std::vector<char> second_content(2000, 'x');
+            for (const auto& [key, content] : { std::make_pair("first.bin", &first_content), std::make_pair("second.bin", &second_content) })
+            {
+                std::ofstream file{ asset_dir / key, std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                file.write(content->data(), static_cast<std::streamsize>(content->size()));
+            }
+            AssetPackageBuilder::CodecPolicy policy;
+            policy.m_solidMaxAssetSize = 4096;
+            const auto package = AssetPackageFile::createNewPackage(base_filename);
+            {
+                AssetPackageBuilder builder(package);
+                builder.setCodecPolicy(policy);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetFile((asset_dir / "first.bin").string(), "first.bin", 1)));
+                Assert::IsFalse(static_cast<bool>(builder.build(1)));
+            }
+            // 只有一個成員的 block, 內容跟成員相同, 一般的 asset 會共用整個 block
+            const auto first_header = package->tryGetAssetHeaderData("first.bin");
+            Assert::IsTrue(first_header->isSolidMember());
+            Assert::IsFalse(static_cast<bool>(package->addAssetMemory(first_content, "first_copy", 1, first_header->m_codec)));
+            const auto copy_header = package->tryGetAssetHeaderData("first_copy");
+            Assert::IsTrue((!copy_header->isSolidMember()) && (copy_header->m_offset == first_header->m_offset));
+            Assert::IsTrue(package->tryRetrieveAssetToMemory("first.bin").value() == first_content);
+            // 最後一個參照不是 solid 成員, block 的 cache 也要丟掉
+            Assert::IsFalse(static_cast<bool>(package->removeAsset("first.bin")));
+            Assert::IsFalse(static_cast<bool>(package->removeAsset("first_copy")));
+            {
+                AssetPackageBuilder builder(package);
+                builder.setCodecPolicy(policy);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetFile((asset_dir / "second.bin").string(), "second.bin", 1)));
+                Assert::IsFalse(static_cast<bool>(builder.build(1)));
+            }
+            Assert::IsTrue(package->tryGetAssetHeaderData("second.bin")->m_offset == first_header->m_offset);
+            Assert::IsTrue(package->tryRetrieveAssetToMemory("second.bin").value() == second_content);
+            std::filesystem::remove_all(asset_dir);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestBatchRetrieve)
+        {
+            const std::string base_filename = makeTestPackageName("test_batch_retrieve");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::unordered_map<std::string, std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                for (unsigned int i = 0; i < 80; i++)
+                {
+                    const std::string key = "asset_" + std::to_string(i);
+                    contents[key] = makeAssetContent(generator, 100 + (i % 7) * 5000);
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[key], key, 1, i % 3 == 0 ? AssetCodecId::stored : AssetCodecId::zlib)));
+                }
+                // 移除再加入, offset 順序跟 key 順序不同, bundle 裡也有空洞
+                for (unsigned int i = 0; i < 80; i += 5)
+                {
+                    const std::string key = "asset_" + std::to_string(i);
+                    Assert::IsFalse(static_cast<bool>(package->removeAsset(key)));
+                    contents.erase(key);
+                }
+                for (unsigned int i = 80; i < 90; i++)
+                {
+                    const std::string key = "asset_" + std::to_string(i);
+                    contents[key] = makeAssetContent(generator, 300 + i);
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[key], key, 1)));
+                }
+            }
+            std::vector<std::string> asset_keys;
+            for (const auto& [key, content] : contents)
+            {
+                asset_keys.push_back(key);
+            }
+            std::shuffle(asset_keys.begin(), asset_keys.end(), generator);
+            asset_keys.push_back("asset_0");  // 已移除
+            asset_keys.push_back(asset_keys.front());  // 同一個 key 要兩次
+            const auto check_results = [&](const std::vector<std::optional<std::vector<char>>>& results)
+                {
+                    Assert::IsTrue(results.size() == asset_keys.size());
+                    for (size_t i = 0; i < asset_keys.size(); i++)
+                    {
+                        const auto it = contents.find(asset_keys[i]);
+                        if (it == contents.end())
+                        {
+                            Assert::IsFalse(results[i].has_value());
+                            continue;
+                        }
+                        Assert::IsTrue(results[i].value() == it->second);
+                    }
+                };
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                check_results(package->tryRetrieveAssetsToMemory(asset_keys, 1));
+                check_results(package->tryRetrieveAssetsToMemory(asset_keys, 4));
+                Assert::IsTrue(package->tryRetrieveAssetsToMemory({}).empty());
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                package->setVerifyOnRetrieve(true);
+                check_results(package->tryRetrieveAssetsToMemory(asset_keys));
+                AssetPackageOverlay overlay;
+                Assert::IsFalse(static_cast<bool>(overlay.mountPackage(package, 0)));
+                check_results(overlay.tryRetrieveAssetsToMemory(asset_keys));
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestSortedIndexReadOnly)
+        {
+            const std::string base_filename = makeTestPackageName("test_sorted_index");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            constexpr unsigned int asset_count = 200;
+            std::vector<std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                Assert::IsFalse(static_cast<bool>(package->beginBatch()));
+                for (unsigned int i = 0; i < asset_count; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 100 + i * 10));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), i + 1)));
+                }
+                Assert::IsFalse(static_cast<bool>(package->commitBatch()));
+            }
+            {
+                const auto package = AssetPackageFile::openPackageReadOnly(base_filename);
+                for (unsigned int i = 0; i < asset_count; i += 7)
+                {
+                    const std::string key = "asset_" + std::to_string(i);
+                    const auto header = package->tryGetAssetHeaderData(key);
+                    Assert::IsTrue(header.has_value());
+                    Assert::IsTrue(header->m_version == i + 1);
+                    Assert::IsTrue(header->m_orgSize == contents[i].size());
+                    const auto buff = package->tryRetrieveAssetToMemory(key);
+                    Assert::IsTrue(buff.has_value());
+                    Assert::IsTrue(buff.value() == contents[i]);
+                }
+                Assert::IsFalse(package->tryGetAssetHeaderData("asset_none").has_value());
+                Assert::IsTrue(package->getAssetOriginalSize("asset_none") == 0);
+                Assert::IsTrue(package->getAssetKeys().size() == asset_count);
+            }
+            {
+                // 可寫入模式開啟時從 index 區段還原 header map
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                Assert::IsTrue(package->getAssetOriginalSize("asset_3") == contents[3].size());
+                Assert::IsFalse(static_cast<bool>(package->removeAsset("asset_3")));
+                Assert::IsFalse(package->tryGetAssetHeaderData("asset_3").has_value());
+                Assert::IsTrue(package->getAssetKeys().size() == asset_count - 1);
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestWideOffsetHeaderData)
+        {
+            constexpr std::uint64_t giga_bytes = 1024ULL * 1024ULL * 1024ULL;
+            AssetHeaderDataMap header_map;
+            AssetHeaderDataMap::AssetHeaderData header;
+            header.m_name = "huge_asset";
+            header.m_version = 3;
+            header.m_offset = 5 * giga_bytes + 17;
+            header.m_size = 4 * giga_bytes + 1;
+            header.m_orgSize = 9 * giga_bytes;
+            header.m_crc = 0x1234;
+            Assert::IsFalse(static_cast<bool>(header_map.insertHeaderData(header)));
+            const std::vector<char> buff = header_map.exportToByteBuffer(PACKAGE_FORMAT_TAG);
+            AssetHeaderDataMap import_map;
+            Assert::IsFalse(static_cast<bool>(import_map.importFromByteBuffer(buff, PACKAGE_FORMAT_TAG)));
+            const auto import_header = import_map.tryGetHeaderData("huge_asset");
+            Assert::IsTrue(import_header.has_value());
+            Assert::IsTrue(import_header->m_offset == header.m_offset);
+            Assert::IsTrue(import_header->m_size == header.m_size);
+            Assert::IsTrue(import_header->m_orgSize == header.m_orgSize);
+            Assert::IsTrue(import_header->m_crc == header.m_crc);
+        }
+        TEST_METHOD(TestBatchInsert)
+        {
+            const std::string base_filename = makeTestPackageName("test_batch_insert");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                const auto empty_header_size = std::filesystem::file_size(base_filename + ".eph");
+                Assert::IsFalse(static_cast<bool>(package->beginBatch()));
+                Assert::IsTrue(package->isBatching());
+                for (unsigned i = 0; i < 100; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, 500 + i * 17));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+                // 批次中加入的 asset 在 commit 之前就可以讀取; 小的 asset 壓縮後可能還在 fstream 的 buffer 裡
+                const std::vector<char> small_content(64, 'a');
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(small_content, "asset_small", 1)));
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_small").value() == small_content);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_99").value() == contents[99]);
+                std::vector<char> buff(contents[42].size());
+                Assert::IsFalse(static_cast<bool>(package->tryRetrieveAssetToMemory("asset_42", buff.data(), buff.size())));
+                Assert::IsTrue(buff == contents[42]);
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents[7], "asset_dup", 1)));
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("asset_dup").value() == contents[7]);
+                // commit 之前 header 檔不會被改寫
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".eph") == empty_header_size);
+                Assert::IsFalse(static_cast<bool>(package->commitBatch()));
+                Assert::IsFalse(package->isBatching());
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".eph") > empty_header_size);
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                for (unsigned i = 0; i < 100; i++)
+                {
+                    const auto buff = package->tryRetrieveAssetToMemory("asset_" + std::to_string(i));
+                    Assert::IsTrue(buff.has_value());
+                    Assert::IsTrue(buff.value() == contents[i]);
+                }
+            }
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestNestedBatch)
+        {
+            const std::string base_filename = makeTestPackageName("test_nested_batch");
+            const std::string old_filename = makeTestPackageName("test_nested_batch_old");
+            const std::string new_filename = makeTestPackageName("test_nested_batch_new");
+            const std::string patch_filename = makeTestPackageName("test_nested_batch_delta");
+            const std::filesystem::path asset_dir = std::filesystem::temp_directory_path() / "test_nested_batch_assets";
+            std::filesystem::remove_all(asset_dir);
+            std::filesystem::create_directories(asset_dir);
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            const auto built_content = makeAssetContent(generator, 3000);
+            const auto added_content = makeAssetContent(generator, 2000);
+            const auto patched_content = makeAssetContent(generator, 2500);
+            {
+                std::ofstream file{ asset_dir / "built.bin", std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                file.write(built_content.data(), static_cast<std::streamsize>(built_content.size()));
+            }
+            {
+                const auto old_package = AssetPackageFile::createNewPackage(old_filename);
+                const auto new_package = AssetPackageFile::createNewPackage(new_filename);
+                Assert::IsFalse(static_cast<bool>(new_package->addAssetMemory(patched_content, "patched", 1)));
+                // createPatch 併入呼叫端的 batch
+                const auto patch_package = AssetPackageFile::createNewPackage(patch_filename);
+                Assert::IsFalse(static_cast<bool>(patch_package->beginBatch()));
+                Assert::IsFalse(static_cast<bool>(AssetPackagePatch::createPatch(old_package, new_package, patch_package)));
+                Assert::IsTrue(patch_package->isBatching());
+                Assert::IsFalse(static_cast<bool>(patch_package->commitBatch()));
+            }
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                const auto empty_header_size = std::filesystem::file_size(base_filename + ".eph");
+                Assert::IsFalse(static_cast<bool>(package->beginBatch()));
+                Assert::IsTrue(package->beginBatch() == ErrorCode::batchInProgress);
+                Assert::IsTrue(package->isBatching());
+                // builder 跟 applyPatch 不會 commit 呼叫端的 batch
+                {
+                    AssetPackageBuilder builder(package);
+                    Assert::IsFalse(static_cast<bool>(builder.appendAssetFile((asset_dir / "built.bin").string(), "built.bin", 1)));
+                    Assert::IsFalse(static_cast<bool>(builder.build(1)));
+                }
+                Assert::IsTrue(package->isBatching());
+                const auto patch_package = AssetPackageFile::openPackageReadOnly(patch_filename);
+                Assert::IsFalse(static_cast<bool>(AssetPackagePatch::applyPatch(package, patch_package)));
+                Assert::IsTrue(package->isBatching());
+                Assert::IsFalse(static_cast<bool>(package->addAssetMemory(added_content, "added", 1)));
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".eph") == empty_header_size);
+                Assert::IsFalse(static_cast<bool>(package->commitBatch()));
+                Assert::IsFalse(package->isBatching());
+                Assert::IsTrue(std::filesystem::file_size(base_filename + ".eph") > empty_header_size);
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("built.bin").value() == built_content);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("patched").value() == patched_content);
+                Assert::IsTrue(package->tryRetrieveAssetToMemory("added").value() == added_content);
+            }
+            std::filesystem::remove_all(asset_dir);
+            removeTestPackage(base_filename);
+            removeTestPackage(old_filename);
+            removeTestPackage(new_filename);
+            removeTestPackage(patch_filename);
+        }
+        TEST_METHOD(TestParallelBuilder)
+        {
+            const std::string base_filename = makeTestPackageName("test_parallel_builder");
+            const std::filesystem::path asset_dir = std::filesystem::temp_directory_path() / "test_parallel_builder_assets";
+            std::filesystem::remove_all(asset_dir);
+            std::filesystem::create_directories(asset_dir / "sub");
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            for (unsigned i = 0; i < 64; i++)
+            {
+                contents.emplace_back(makeAssetContent(generator, 2000 + i * 97));
+                const std::filesystem::path file_path = asset_dir / ((i % 2 == 0) ? "" : "sub") / ("asset_" + std::to_string(i) + ".bin");
+                std::ofstream file{ file_path, std::fstream::out | std::fstream::binary | std::fstream::trunc };
+                file.write(contents.back().data(), static_cast<std::streamsize>(contents.back().size()));
+            }
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                AssetPackageBuilder builder(package);
+                Assert::IsFalse(static_cast<bool>(builder.appendAssetDirectory(asset_dir.string(), "res/", 1)));
+                Assert::IsTrue(builder.getEntries().size() == 64);
+                Assert::IsFalse(static_cast<bool>(builder.build(4)));
+            }
+            {
+                const auto package = AssetPackageFile::openPackage(base_filename);
+                for (unsigned i = 0; i < 64; i++)
+                {
+                    const std::string asset_key = std::string("res/") + ((i % 2 == 0) ? "" : "sub/") + "asset_" + std::to_string(i) + ".bin";
+                    const auto buff = package->tryRetrieveAssetToMemory(asset_key);
+                    Assert::IsTrue(buff.has_value());
+                    Assert::IsTrue(buff.value() == contents[i]);
+                }
+            }
+            std::filesystem::remove_all(asset_dir);
+            removeTestPackage(base_filename);
+        }
+        TEST_METHOD(TestConcurrentRetrieveThroughput)
+        {
+            const std::string base_filename = makeTestPackageName("test_concurrent_retrieve");
+            constexpr unsigned asset_count = 256;
+            constexpr size_t asset_size = 64 * 1024;
+            constexpr unsigned rounds = 4;
+            std::random_device rd;
+            std::default_random_engine generator(rd());
+            std::vector<std::vector<char>> contents;
+            {
+                const auto package = AssetPackageFile::createNewPackage(base_filename);
+                for (unsigned i = 0; i < asset_count; i++)
+                {
+                    contents.emplace_back(makeAssetContent(generator, asset_size));
+                    Assert::IsFalse(static_cast<bool>(package->addAssetMemory(contents.back(), "asset_" + std::to_string(i), 1)));
+                }
+            }
+            const auto package = AssetPackageFile::openPackage(base_filename);
+            const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+            double single_thread_rate = 0.0;
+            double four_thread_rate = 0.0;
+            for (unsigned thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+            {
+                std::atomic<unsigned> fail_count{ 0 };
+                const auto start = std::chrono::steady_clock::now();
+                std::vector<std::thread> workers;
+                for (unsigned t = 0; t < thread_count; t++)
+                {
+                    workers.emplace_back([&, t]()
+                        {
+                            for (unsigned r = 0; r < rounds; r++)
+                            {
+                                for (unsigned i = t; i < asset_count; i += thread_count)
+                                {
+                                    const auto buff = package->tryRetrieveAssetToMemory("asset_" + std::to_string(i));
+                                    if ((!buff) || (buff.value() != contents[i])) ++fail_count;
+                                }
+                            }
+                        });
+                }
+                for (auto& worker : workers) worker.join();
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                Assert::IsTrue(fail_count.load() == 0);
+                const double rate = static_cast<double>(asset_count) * rounds * asset_size / (1024.0 * 1024.0) / elapsed.count();
+                if (thread_count == 1) single_thread_rate = rate;
+                if (thread_count == 4) four_thread_rate = rate;
+                const std::string msg = std::to_string(thread_count) + " threads : " + std::to_string(rate) + " MB/s, speedup "
+                    + std::to_string(rate / single_thread_rate) + "\n";
+                Logger::WriteMessage(msg.c_str());
+            }
+            // 讀取不互相阻擋才會隨核心數成長; 門檻放寬, 避免被機器上其他工作影響
+            if (max_threads >= 4) Assert::IsTrue(four_thread_rate >= single_thread_rate * 1.5);
+            removeTestPackage(base_filename);
+        }
+    };
+}